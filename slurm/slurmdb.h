@@ -747,6 +747,8 @@ typedef struct {
 				      * PACK for state file)*/
 	List user_limit_list; /* slurmdb_used_limits_t's (DON'T PACK
 			       * for state file) */
+	void *user_limit_hash; /* index of user_limit_list by uid
+				* (DON'T PACK for state file) */
 } slurmdb_qos_usage_t;
 
 typedef struct {
@@ -63,6 +63,16 @@
 
 #define MAX_RETRIES 3
 
+/* Nodes which could not be reached within this many seconds are not used
+ * as the head of a forwarding span while other nodes remain */
+#define FWD_FAIL_TIME	60
+#define FWD_FAIL_MAX	128
+
+typedef struct {
+	char *name;
+	time_t fail_time;
+} fwd_fail_t;
+
 typedef struct {
 	pthread_cond_t *notify;
 	int            *p_thr_count;
@@ -73,6 +83,10 @@ typedef struct {
 	pthread_mutex_t *tree_mutex;
 } fwd_tree_t;
 
+static pthread_mutex_t fwd_fail_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fwd_fail_t fwd_fail[FWD_FAIL_MAX];
+static int fwd_fail_next = 0;
+
 static void _start_msg_tree_internal(hostlist_t hl, hostlist_t* sp_hl,
 				     fwd_tree_t *fwd_tree_in,
 				     int hl_count);
@@ -81,6 +95,72 @@ static void _forward_msg_internal(hostlist_t hl, hostlist_t* sp_hl,
 				  header_t *header, int timeout,
 				  int hl_count);
 
+/* Record that a node could not be reached to forward a message */
+static void _fwd_fail_add(char *name)
+{
+	int i;
+
+	slurm_mutex_lock(&fwd_fail_mutex);
+	for (i = 0; i < FWD_FAIL_MAX; i++) {
+		if (fwd_fail[i].name && !strcmp(fwd_fail[i].name, name))
+			break;
+	}
+	if (i >= FWD_FAIL_MAX) {
+		/* Replace the oldest record */
+		i = fwd_fail_next;
+		fwd_fail_next = (fwd_fail_next + 1) % FWD_FAIL_MAX;
+		xfree(fwd_fail[i].name);
+		fwd_fail[i].name = xstrdup(name);
+	}
+	fwd_fail[i].fail_time = time(NULL);
+	slurm_mutex_unlock(&fwd_fail_mutex);
+}
+
+/* Return true if a node could not be reached within FWD_FAIL_TIME */
+static bool _fwd_fail_recent(char *name, time_t now)
+{
+	bool rc = false;
+	int i;
+
+	slurm_mutex_lock(&fwd_fail_mutex);
+	for (i = 0; i < FWD_FAIL_MAX; i++) {
+		if (fwd_fail[i].name && !strcmp(fwd_fail[i].name, name)) {
+			rc = (difftime(now, fwd_fail[i].fail_time) <
+			      FWD_FAIL_TIME);
+			break;
+		}
+	}
+	slurm_mutex_unlock(&fwd_fail_mutex);
+
+	return rc;
+}
+
+/*
+ * Remove and return the node to send a message to, it forwards the message
+ * to the nodes remaining in the hostlist. Nodes which recently could not be
+ * reached are moved to the end of the hostlist so that they are not waited
+ * for before the rest of the span gets the message. The returned name must
+ * be released with free().
+ */
+static char *_fwd_next_head(hostlist_t hl)
+{
+	int i, cnt = hostlist_count(hl);
+	time_t now = time(NULL);
+	char *name = NULL;
+
+	for (i = 0; i < cnt; i++) {
+		if (!(name = hostlist_shift(hl)))
+			break;
+		if ((i == (cnt - 1)) || !_fwd_fail_recent(name, now))
+			break;
+		hostlist_push_host(hl, name);
+		free(name);
+		name = NULL;
+	}
+
+	return name;
+}
+
 void _destroy_tree_fwd(fwd_tree_t *fwd_tree)
 {
 	if (fwd_tree) {
@@ -116,7 +196,7 @@ void *_forward_thread(void *arg)
 	int start_timeout = fwd_msg->timeout;
 
 	/* repeat until we are sure the message was sent */
-	while ((name = hostlist_shift(hl))) {
+	while ((name = _fwd_next_head(hl))) {
 		if (slurm_conf_get_addr(name, &addr) == SLURM_ERROR) {
 			error("forward_thread: can't find address for host "
 			      "%s, check slurm.conf", name);
@@ -132,6 +212,7 @@ void *_forward_thread(void *arg)
 		}
 		if ((fd = slurm_open_msg_conn(&addr)) < 0) {
 			error("forward_thread to %s: %m", name);
+			_fwd_fail_add(name);
 
 			slurm_mutex_lock(&fwd_struct->forward_mutex);
 			mark_as_failed_forward(
@@ -191,6 +272,7 @@ void *_forward_thread(void *arg)
 				     get_buf_offset(buffer),
 				     SLURM_PROTOCOL_NO_SEND_RECV_FLAGS ) < 0) {
 			error("forward_thread: slurm_msg_sendto: %m");
+			_fwd_fail_add(name);
 
 			slurm_mutex_lock(&fwd_struct->forward_mutex);
 			mark_as_failed_forward(&fwd_struct->ret_list, name,
@@ -259,6 +341,7 @@ void *_forward_thread(void *arg)
 
 		if (!ret_list || (fwd_msg->header.forward.cnt != 0
 				  && list_count(ret_list) <= 1)) {
+			_fwd_fail_add(name);
 			slurm_mutex_lock(&fwd_struct->forward_mutex);
 			mark_as_failed_forward(&fwd_struct->ret_list, name,
 					       errno);
@@ -361,9 +444,10 @@ void *_fwd_tree_thread(void *arg)
 	send_msg.msg_type = fwd_tree->orig_msg->msg_type;
 	send_msg.data = fwd_tree->orig_msg->data;
 	send_msg.protocol_version = fwd_tree->orig_msg->protocol_version;
+	send_msg.flags = fwd_tree->orig_msg->flags & SLURM_REDUCE_RET_LIST;
 
 	/* repeat until we are sure the message was sent */
-	while ((name = hostlist_shift(fwd_tree->tree_hl))) {
+	while ((name = _fwd_next_head(fwd_tree->tree_hl))) {
 		if (slurm_conf_get_addr(name, &send_msg.address)
 		    == SLURM_ERROR) {
 			error("fwd_tree_thread: can't find address for host "
@@ -398,7 +482,7 @@ void *_fwd_tree_thread(void *arg)
 		xfree(send_msg.forward.nodelist);
 
 		if (ret_list) {
-			int ret_cnt = list_count(ret_list);
+			int ret_cnt = ret_list_node_count(ret_list);
 			/* This is most common if a slurmd is running
 			   an older version of Slurm than the
 			   originator of the message.
@@ -409,6 +493,7 @@ void *_fwd_tree_thread(void *arg)
 				      "the message, expecting %d ret got only "
 				      "%d",
 				      name, send_msg.forward.cnt + 1, ret_cnt);
+				_fwd_fail_add(name);
 				if (ret_cnt > 1) { /* not likely */
 					ret_data_info_t *ret_data_info = NULL;
 					ListIterator itr =
@@ -417,7 +502,7 @@ void *_fwd_tree_thread(void *arg)
 						list_next(itr))) {
 						if (strcmp(ret_data_info->
 							   node_name, name))
-							hostlist_delete_host(
+							hostlist_delete(
 								fwd_tree->
 								tree_hl,
 								ret_data_info->
@@ -728,6 +813,8 @@ extern List start_msg_tree(hostlist_t hl, slurm_msg_t *msg, int timeout)
 		count = list_count(ret_list);
 		debug2("Tree head got back %d", count);
 	}
+	if (msg->flags & SLURM_REDUCE_RET_LIST)
+		count = ret_list_node_count(ret_list);
 	xassert(count >= host_count);	/* Tree head did not get all responses,
 					 * but no more active fwd threads!*/
 	slurm_mutex_unlock(&tree_mutex);
@@ -793,6 +880,71 @@ extern void forward_wait(slurm_msg_t * msg)
 	return;
 }
 
+/* Return true if a ret_list record holds the responses of several nodes */
+static bool _is_reduced_ret(ret_data_info_t *ret_data_info)
+{
+	return (ret_data_info->node_name &&
+		strpbrk(ret_data_info->node_name, "[,"));
+}
+
+extern void forward_reduce_ret_list(List ret_list)
+{
+	ListIterator itr;
+	ret_data_info_t *ret_data_info, *reduced = NULL;
+	hostlist_t hl = NULL;
+	int cnt = 0;
+
+	itr = list_iterator_create(ret_list);
+	while ((ret_data_info = list_next(itr))) {
+		if (!ret_data_info->node_name || ret_data_info->err ||
+		    (ret_data_info->type != RESPONSE_SLURM_RC) ||
+		    (slurm_get_return_code(ret_data_info->type,
+					   ret_data_info->data) !=
+		     SLURM_SUCCESS))
+			continue;
+		if (!hl) {
+			/* Keep the first record, it becomes the merged one */
+			reduced = ret_data_info;
+			hl = hostlist_create(ret_data_info->node_name);
+		} else {
+			hostlist_push(hl, ret_data_info->node_name);
+			list_delete_item(itr);
+		}
+		cnt++;
+	}
+	list_iterator_destroy(itr);
+
+	if (cnt > 1) {
+		xfree(reduced->node_name);
+		reduced->node_name = hostlist_ranged_string_xmalloc(hl);
+		debug3("reduced %d return codes to one for %s",
+		       cnt, reduced->node_name);
+	}
+	if (hl)
+		hostlist_destroy(hl);
+}
+
+extern int ret_list_node_count(List ret_list)
+{
+	ListIterator itr;
+	ret_data_info_t *ret_data_info;
+	hostlist_t hl;
+	int cnt = 0;
+
+	itr = list_iterator_create(ret_list);
+	while ((ret_data_info = list_next(itr))) {
+		if (_is_reduced_ret(ret_data_info)) {
+			hl = hostlist_create(ret_data_info->node_name);
+			cnt += hostlist_count(hl);
+			hostlist_destroy(hl);
+		} else
+			cnt++;
+	}
+	list_iterator_destroy(itr);
+
+	return cnt;
+}
+
 void destroy_data_info(void *object)
 {
 	ret_data_info_t *ret_data_info = (ret_data_info_t *)object;
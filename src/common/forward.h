@@ -115,6 +115,23 @@ extern void mark_as_failed_forward(List *ret_list, char *node_name, int err);
 
 extern void forward_wait(slurm_msg_t *msg);
 
+/*
+ * forward_reduce_ret_list - merge the RESPONSE_SLURM_RC records reporting
+ *                   success in a ret_list into one record, whose node_name
+ *                   is a hostlist expression of the nodes. Records with
+ *                   errors or other response types are left unchanged.
+ * IN/OUT: ret_list - List    - list of ret_data_info_t
+ */
+extern void forward_reduce_ret_list(List ret_list);
+
+/*
+ * ret_list_node_count - count the nodes with records in a ret_list
+ * IN: ret_list    - List     - list of ret_data_info_t, possibly reduced
+ *                              by forward_reduce_ret_list()
+ * RET: int        - node count
+ */
+extern int ret_list_node_count(List ret_list);
+
 /*
  * no_resp_forward - Used to respond for nodes not able to respond since
  *                   the parent had failed in some way
@@ -61,6 +61,8 @@
 
 typedef struct {
 	pthread_mutex_t	aggr_mutex;
+	uint64_t        arrival_gap;	/* mean usec between msgs */
+	uint64_t        arrival_last;	/* usec time of last msg */
 	pthread_cond_t	cond;
 	uint32_t        debug_flags;
 	bool		max_msgs;
@@ -126,6 +128,53 @@ static msg_aggr_t *_handle_msg_aggr_ret(uint32_t msg_index, bool locked)
 	return msg_aggr;
 }
 
+static uint64_t _now_usec(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return ((uint64_t) now.tv_sec * 1000000) + now.tv_usec;
+}
+
+/*
+ * Update the mean time between collected msgs, used to size collection
+ * windows. Gaps are capped at twice the window so that the mean recovers
+ * within a few msgs when a burst follows an idle period.
+ * Caller must hold msg_collection.mutex.
+ */
+static void _record_arrival(void)
+{
+	uint64_t now = _now_usec();
+	uint64_t max_gap = msg_collection.window * 2000;
+	uint64_t gap = max_gap;
+
+	if (msg_collection.arrival_last &&
+	    (now >= msg_collection.arrival_last))
+		gap = MIN(now - msg_collection.arrival_last, max_gap);
+	msg_collection.arrival_gap = (msg_collection.arrival_gap * 7 + gap) / 8;
+	msg_collection.arrival_last = now;
+}
+
+/*
+ * Return the usec time at which a collection window opened at "start"
+ * should close. If msgs arrive too slowly for another one to be expected
+ * within WindowTime, the window closes at once rather than delaying the
+ * msg. Otherwise it stays open while msgs keep arriving, until WindowTime
+ * is reached.
+ * Caller must hold msg_collection.mutex.
+ */
+static uint64_t _window_end(uint64_t start)
+{
+	uint64_t window = msg_collection.window * 1000;
+	uint64_t idle_end;
+
+	if ((msg_collection.arrival_gap * 2) >= window)
+		return start;
+	idle_end = msg_collection.arrival_last +
+		   (msg_collection.arrival_gap * 2);
+	return MIN(start + window, idle_end);
+}
+
 static int _send_to_backup_collector(slurm_msg_t *msg, int rc)
 {
 	slurm_addr_t *next_dest = NULL;
@@ -199,7 +248,7 @@ static int _send_to_next_collector(slurm_msg_t *msg)
  */
 static void * _msg_aggregation_sender(void *arg)
 {
-	struct timeval now;
+	uint64_t start, end;
 	struct timespec timeout;
 	slurm_msg_t msg;
 	composite_msg_t cmp;
@@ -218,15 +267,16 @@ static void * _msg_aggregation_sender(void *arg)
 			break;
 
 		/* A msg has been collected; start new window */
-		gettimeofday(&now, NULL);
-		timeout.tv_sec = now.tv_sec + (msg_collection.window / 1000);
-		timeout.tv_nsec = (now.tv_usec * 1000) +
-			(1000000 * (msg_collection.window % 1000));
-		timeout.tv_sec += timeout.tv_nsec / 1000000000;
-		timeout.tv_nsec %= 1000000000;
-
-		pthread_cond_timedwait(&msg_collection.cond,
-				       &msg_collection.mutex, &timeout);
+		start = _now_usec();
+		while (msg_collection.running && !msg_collection.max_msgs) {
+			end = _window_end(start);
+			if (_now_usec() >= end)
+				break;
+			timeout.tv_sec = end / 1000000;
+			timeout.tv_nsec = (end % 1000000) * 1000;
+			pthread_cond_timedwait(&msg_collection.cond,
+					       &msg_collection.mutex, &timeout);
+		}
 
 		if (!msg_collection.running &&
 		    !list_count(msg_collection.msg_list))
@@ -361,6 +411,7 @@ extern void msg_aggr_add_msg(slurm_msg_t *msg, bool wait,
 
 	/* Add msg to message collection */
 	list_append(msg_collection.msg_list, msg);
+	_record_arrival();
 
 	count = list_count(msg_collection.msg_list);
 
@@ -82,6 +82,7 @@
 /* Global variables */
 List config_list  = NULL;	/* list of config_record entries */
 List feature_list = NULL;	/* list of features_record entries */
+uint32_t feature_list_gen = 0;	/* incremented on feature_list changes */
 List front_end_list = NULL;	/* list of slurm_conf_frontend_t entries */
 time_t last_node_update = (time_t) 0;	/* time of last update */
 struct node_record *node_record_table_ptr = NULL;	/* node records */
@@ -319,6 +320,7 @@ static int _delete_config_record (void)
 	last_node_update = time (NULL);
 	(void) list_delete_all (config_list,    &_list_find_config,  NULL);
 	(void) list_delete_all (feature_list,   &_list_find_feature, NULL);
+	feature_list_gen++;
 	(void) list_delete_all (front_end_list, &list_find_frontend, NULL);
 	return SLURM_SUCCESS;
 }
@@ -699,6 +701,8 @@ extern void  build_config_feature_list(struct config_record *config_ptr)
 	int i, j;
 	char *tmp_str, *token, *last = NULL;
 
+	feature_list_gen++;
+
 	/* Clear these nodes from the feature_list record,
 	 * then restore as needed */
 	feature_iter = list_iterator_create(feature_list);
@@ -933,6 +937,7 @@ extern int init_node_conf (void)
 		config_list    = list_create (_list_delete_config);
 		feature_list   = list_create (_list_delete_feature);
 		front_end_list = list_create (destroy_frontend);
+		feature_list_gen++;
 	}
 
 	return SLURM_SUCCESS;
@@ -949,6 +954,7 @@ extern void node_fini2 (void)
 		FREE_NULL_LIST(config_list);
 		FREE_NULL_LIST(feature_list);
 		FREE_NULL_LIST(front_end_list);
+		feature_list_gen++;
 	}
 
 	xhash_free(node_hash_table);
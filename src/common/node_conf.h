@@ -94,6 +94,7 @@ struct features_record {
 	bitstr_t *node_bitmap;	/* bitmap of nodes with this feature */
 };
 extern List feature_list;	/* list of features_record entries */
+extern uint32_t feature_list_gen; /* incremented on feature_list changes */
 
 struct node_record {
 	uint32_t magic;			/* magic cookie for data integrity */
@@ -3447,6 +3447,10 @@ int slurm_receive_msg_and_forward(slurm_fd_t fd, slurm_addr_t *orig_addr,
 	 */
 	if (header.orig_addr.sin_addr.s_addr != 0) {
 		memcpy(&msg->orig_addr, &header.orig_addr, sizeof(slurm_addr_t));
+		/* Only the node replying directly to the originator may
+		 * reduce its ret_list, the nodes forwarding the message count
+		 * the responses they get back */
+		header.flags &= (~SLURM_REDUCE_RET_LIST);
 	} else {
 		memcpy(&header.orig_addr, orig_addr, sizeof(slurm_addr_t));
 	}
@@ -3575,54 +3579,19 @@ _pack_msg(slurm_msg_t *msg, header_t *hdr, Buf buffer)
 	set_buf_offset(buffer, tmplen);
 }
 
-/*
- *  Send a slurm message over an open file descriptor `fd'
- *    Returns the size of the message sent in bytes, or -1 on failure.
- */
-int slurm_send_node_msg(slurm_fd_t fd, slurm_msg_t * msg)
+/* Pack a message's header, auth credential and body for transmission.
+ * RET buffer to send, free with free_buf(), or NULL and set errno */
+static Buf _pack_node_msg(slurm_msg_t *msg, void *auth_cred)
 {
 	header_t header;
 	Buf      buffer;
 	int      rc;
-	void *   auth_cred;
-	time_t   start_time = time(NULL);
 
-	/*
-	 * Initialize header with Auth credential and message type.
-	 * We get the credential now rather than later so the work can
-	 * can be done in parallel with waiting for message to forward,
-	 * but we may need to generate the credential again later if we
-	 * wait too long for the incoming message.
-	 */
-	if (msg->flags & SLURM_GLOBAL_AUTH_KEY) {
-		auth_cred = g_slurm_auth_create(NULL, 2, _global_auth_key());
-	} else {
-		char *auth_info = slurm_get_auth_info();
-		auth_cred = g_slurm_auth_create(NULL, 2, auth_info);
-		xfree(auth_info);
-	}
-
-	if (msg->forward.init != FORWARD_INIT) {
-		forward_init(&msg->forward, NULL);
-		msg->ret_list = NULL;
-	}
-	forward_wait(msg);
-
-	if (difftime(time(NULL), start_time) >= 60) {
-		(void) g_slurm_auth_destroy(auth_cred);
-		if (msg->flags & SLURM_GLOBAL_AUTH_KEY) {
-			auth_cred = g_slurm_auth_create(NULL, 2,
-							_global_auth_key());
-		} else {
-			char *auth_info = slurm_get_auth_info();
-			auth_cred = g_slurm_auth_create(NULL, 2, auth_info);
-			xfree(auth_info);
-		}
-	}
 	if (auth_cred == NULL) {
 		error("authentication: %s",
 		      g_slurm_auth_errstr(g_slurm_auth_errno(NULL)) );
-		slurm_seterrno_ret(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
+		slurm_seterrno(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
+		return NULL;
 	}
 
 	init_header(&header, msg, msg->flags);
@@ -3637,12 +3606,12 @@ int slurm_send_node_msg(slurm_fd_t fd, slurm_msg_t * msg)
 	 * Pack auth credential
 	 */
 	rc = g_slurm_auth_pack(auth_cred, buffer);
-	(void) g_slurm_auth_destroy(auth_cred);
 	if (rc) {
 		error("authentication: %s",
 		      g_slurm_auth_errstr(g_slurm_auth_errno(auth_cred)));
 		free_buf(buffer);
-		slurm_seterrno_ret(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
+		slurm_seterrno(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
+		return NULL;
 	}
 
 	/*
@@ -3653,6 +3622,65 @@ int slurm_send_node_msg(slurm_fd_t fd, slurm_msg_t * msg)
 #if	_DEBUG
 	_print_data (get_buf_data(buffer),get_buf_offset(buffer));
 #endif
+	return buffer;
+}
+
+/* Create the auth credential used to send a message */
+static void *_create_msg_cred(slurm_msg_t *msg)
+{
+	void *auth_cred;
+
+	if (msg->flags & SLURM_GLOBAL_AUTH_KEY) {
+		auth_cred = g_slurm_auth_create(NULL, 2, _global_auth_key());
+	} else {
+		char *auth_info = slurm_get_auth_info();
+		auth_cred = g_slurm_auth_create(NULL, 2, auth_info);
+		xfree(auth_info);
+	}
+
+	return auth_cred;
+}
+
+/*
+ *  Send a slurm message over an open file descriptor `fd'
+ *    Returns the size of the message sent in bytes, or -1 on failure.
+ */
+int slurm_send_node_msg(slurm_fd_t fd, slurm_msg_t * msg)
+{
+	Buf      buffer;
+	int      rc;
+	void *   auth_cred;
+	time_t   start_time = time(NULL);
+
+	/*
+	 * Initialize header with Auth credential and message type.
+	 * We get the credential now rather than later so the work can
+	 * can be done in parallel with waiting for message to forward,
+	 * but we may need to generate the credential again later if we
+	 * wait too long for the incoming message.
+	 */
+	auth_cred = _create_msg_cred(msg);
+
+	if (msg->forward.init != FORWARD_INIT) {
+		forward_init(&msg->forward, NULL);
+		msg->ret_list = NULL;
+	}
+	forward_wait(msg);
+	if ((msg->flags & SLURM_REDUCE_RET_LIST) && msg->ret_list)
+		forward_reduce_ret_list(msg->ret_list);
+
+	if (difftime(time(NULL), start_time) >= 60) {
+		if (auth_cred)
+			(void) g_slurm_auth_destroy(auth_cred);
+		auth_cred = _create_msg_cred(msg);
+	}
+
+	buffer = _pack_node_msg(msg, auth_cred);
+	if (auth_cred)
+		(void) g_slurm_auth_destroy(auth_cred);
+	if (!buffer)
+		return SLURM_ERROR;
+
 	/*
 	 * Send message
 	 */
@@ -4208,6 +4236,62 @@ int slurm_send_only_node_msg(slurm_msg_t *req)
 	return rc;
 }
 
+/*
+ * slurm_pack_only_node_msg - Pack a message, including a new auth credential,
+ *	so that the same buffer can be sent to many nodes with
+ *	slurm_send_only_node_buf(). The message must not be a reply that
+ *	includes forwarded responses.
+ * IN msg - message to pack
+ * RET buffer, free with free_buf(), or NULL on error with errno set
+ */
+extern Buf slurm_pack_only_node_msg(slurm_msg_t *msg)
+{
+	Buf buffer;
+	void *auth_cred;
+
+	if (msg->forward.init != FORWARD_INIT) {
+		forward_init(&msg->forward, NULL);
+		msg->ret_list = NULL;
+	}
+
+	auth_cred = _create_msg_cred(msg);
+	buffer = _pack_node_msg(msg, auth_cred);
+	if (auth_cred)
+		(void) g_slurm_auth_destroy(auth_cred);
+
+	return buffer;
+}
+
+/*
+ * slurm_send_only_node_buf - Open a connection to a node, send it a message
+ *	packed by slurm_pack_only_node_msg() and close the connection
+ * IN addr - address of the node
+ * IN buffer - packed message
+ * RET SLURM_SUCCESS or an error code
+ */
+extern int slurm_send_only_node_buf(slurm_addr_t *addr, Buf buffer)
+{
+	int      rc = SLURM_SUCCESS;
+	int      retry = 0;
+	slurm_fd_t fd = -1;
+
+	if ((fd = slurm_open_msg_conn(addr)) < 0)
+		return SLURM_SOCKET_ERROR;
+
+	if (slurm_msg_sendto(fd, get_buf_data(buffer), get_buf_offset(buffer),
+			     SLURM_PROTOCOL_NO_SEND_RECV_FLAGS) < 0) {
+		debug3("slurm_send_only_node_buf: slurm_msg_sendto: %m");
+		rc = SLURM_ERROR;
+	}
+
+	while ((slurm_shutdown_msg_conn(fd) < 0) && (errno == EINTR)) {
+		if (retry++ > MAX_SHUTDOWN_RETRY)
+			return SLURM_SOCKET_ERROR;
+	}
+
+	return rc;
+}
+
 /*
  *  Send a message to the nodelist specificed using fanout
  *    Then return List containing type (ret_data_info_t).
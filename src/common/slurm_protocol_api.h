@@ -1224,6 +1224,25 @@ int slurm_send_only_controller_msg(slurm_msg_t * request_msg);
  */
 int slurm_send_only_node_msg(slurm_msg_t * request_msg);
 
+/*
+ * slurm_pack_only_node_msg - Pack a message, including a new auth credential,
+ *	so that the same buffer can be sent to many nodes with
+ *	slurm_send_only_node_buf(). The message must not be a reply that
+ *	includes forwarded responses.
+ * IN msg - message to pack
+ * RET buffer, free with free_buf(), or NULL on error with errno set
+ */
+extern Buf slurm_pack_only_node_msg(slurm_msg_t *msg);
+
+/*
+ * slurm_send_only_node_buf - Open a connection to a node, send it a message
+ *	packed by slurm_pack_only_node_msg() and close the connection
+ * IN addr - address of the node
+ * IN buffer - packed message
+ * RET SLURM_SUCCESS or an error code
+ */
+extern int slurm_send_only_node_buf(slurm_addr_t *addr, Buf buffer);
+
 /* Slurm message functions */
 
 /* set_span
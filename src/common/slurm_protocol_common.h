@@ -77,12 +77,18 @@
  * src/plugins/accounting_storage/mysql/as_mysql_archive.c when we are
  * done here with them since we have to support old version of archive
  * files since they don't update once they are created.
+ * NOTE: SLURM_16_05_PROTOCOL_VERSION was added for REQUEST_TERMINATE_JOBS
+ * and the shape cache, row update and node registration sdiag statistics,
+ * which 15.08 daemons can not unpack. State files written with it keep the
+ * 15.08 layout unless tested otherwise, so test them with ">=" rather than
+ * for an exact version.
  */
+#define SLURM_16_05_PROTOCOL_VERSION ((30 << 8) | 0)
 #define SLURM_15_08_PROTOCOL_VERSION ((29 << 8) | 0)
 #define SLURM_14_11_PROTOCOL_VERSION ((28 << 8) | 0)
 #define SLURM_14_03_PROTOCOL_VERSION ((27 << 8) | 0)
 
-#define SLURM_PROTOCOL_VERSION SLURM_15_08_PROTOCOL_VERSION
+#define SLURM_PROTOCOL_VERSION SLURM_16_05_PROTOCOL_VERSION
 #define SLURM_MIN_PROTOCOL_VERSION SLURM_14_03_PROTOCOL_VERSION
 
 #if 0
@@ -100,6 +106,8 @@
 /* used to set flags to empty */
 #define SLURM_PROTOCOL_NO_FLAGS 0
 #define SLURM_GLOBAL_AUTH_KEY   0x0001
+#define SLURM_REDUCE_RET_LIST   0x0002	/* merge successful return codes,
+					 * see forward_reduce_ret_list() */
 
 #include "src/common/slurm_protocol_socket_common.h"
 
@@ -904,6 +904,17 @@ extern void slurm_free_kill_job_msg(kill_job_msg_t * msg)
 	}
 }
 
+extern void slurm_free_kill_jobs_msg(kill_jobs_msg_t * msg)
+{
+	if (msg) {
+		int i;
+		for (i = 0; i < msg->job_cnt; i++)
+			slurm_free_kill_job_msg(msg->kill_job[i]);
+		xfree(msg->kill_job);
+		xfree(msg);
+	}
+}
+
 extern void slurm_free_signal_job_msg(signal_job_msg_t * msg)
 {
 	xfree(msg);
@@ -3640,6 +3651,9 @@ extern int slurm_free_msg_data(slurm_msg_type_t type, void *data)
 	case REQUEST_TERMINATE_JOB:
 		slurm_free_kill_job_msg(data);
 		break;
+	case REQUEST_TERMINATE_JOBS:
+		slurm_free_kill_jobs_msg(data);
+		break;
 	case REQUEST_UPDATE_JOB_TIME:
 		slurm_free_update_job_time_msg(data);
 		break;
@@ -4110,6 +4124,8 @@ rpc_num2string(uint16_t opcode)
 		return "REQUEST_SIGNAL_JOB";
 	case REQUEST_TERMINATE_JOB:
 		return "REQUEST_TERMINATE_JOB";
+	case REQUEST_TERMINATE_JOBS:
+		return "REQUEST_TERMINATE_JOBS";
 	case MESSAGE_EPILOG_COMPLETE:
 		return "MESSAGE_EPILOG_COMPLETE";
 	case REQUEST_ABORT_JOB:
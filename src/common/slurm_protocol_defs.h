@@ -349,6 +349,7 @@ typedef enum {
 	REQUEST_LAUNCH_PROLOG,
 	REQUEST_COMPLETE_PROLOG,
 	RESPONSE_PROLOG_EXECUTING,
+	REQUEST_TERMINATE_JOBS,	/* several kill_job_msg_t for one node */
 
 	SRUN_PING = 7001,
 	SRUN_TIMEOUT,
@@ -865,6 +866,15 @@ typedef struct kill_job_msg {
 	uint32_t spank_job_env_size;
 } kill_job_msg_t;
 
+#define KILL_JOB_BATCH_MAX	64	/* jobs per REQUEST_TERMINATE_JOBS */
+
+typedef struct kill_jobs_msg {
+	uint16_t msg_type;	/* REQUEST_TERMINATE_JOB, REQUEST_KILL_PREEMPTED
+				 * or REQUEST_KILL_TIMELIMIT for every job */
+	uint32_t job_cnt;	/* count of kill_job records */
+	kill_job_msg_t **kill_job;
+} kill_jobs_msg_t;
+
 typedef struct signal_job_msg {
 	uint32_t job_id;
 	uint32_t signal;
@@ -1266,6 +1276,7 @@ extern void slurm_free_reattach_tasks_request_msg(
 extern void slurm_free_reattach_tasks_response_msg(
 		reattach_tasks_response_msg_t * msg);
 extern void slurm_free_kill_job_msg(kill_job_msg_t * msg);
+extern void slurm_free_kill_jobs_msg(kill_jobs_msg_t * msg);
 extern void slurm_free_signal_job_msg(signal_job_msg_t * msg);
 extern void slurm_free_update_job_time_msg(job_time_msg_t * msg);
 extern void slurm_free_job_step_kill_msg(job_step_kill_msg_t * msg);
@@ -224,6 +224,10 @@ static void _pack_kill_job_msg(kill_job_msg_t * msg, Buf buffer,
 			       uint16_t protocol_version);
 static int _unpack_kill_job_msg(kill_job_msg_t ** msg, Buf buffer,
 				uint16_t protocol_version);
+static void _pack_kill_jobs_msg(kill_jobs_msg_t * msg, Buf buffer,
+				uint16_t protocol_version);
+static int _unpack_kill_jobs_msg(kill_jobs_msg_t ** msg, Buf buffer,
+				 uint16_t protocol_version);
 
 static void _pack_signal_job_msg(signal_job_msg_t * msg, Buf buffer,
 				 uint16_t protocol_version);
@@ -1300,6 +1304,10 @@ pack_msg(slurm_msg_t const *msg, Buf buffer)
 		_pack_kill_job_msg((kill_job_msg_t *) msg->data, buffer,
 				   msg->protocol_version);
 		break;
+	case REQUEST_TERMINATE_JOBS:
+		_pack_kill_jobs_msg((kill_jobs_msg_t *) msg->data, buffer,
+				    msg->protocol_version);
+		break;
 	case MESSAGE_EPILOG_COMPLETE:
 		_pack_epilog_comp_msg((epilog_complete_msg_t *) msg->data,
 				      buffer,
@@ -1968,6 +1976,11 @@ unpack_msg(slurm_msg_t * msg, Buf buffer)
 					  buffer,
 					  msg->protocol_version);
 		break;
+	case REQUEST_TERMINATE_JOBS:
+		rc = _unpack_kill_jobs_msg((kill_jobs_msg_t **) & (msg->data),
+					   buffer,
+					   msg->protocol_version);
+		break;
 	case MESSAGE_EPILOG_COMPLETE:
 		rc = _unpack_epilog_comp_msg((epilog_complete_msg_t **)
 					     & (msg->data), buffer,
@@ -5036,6 +5049,68 @@ unpack_error:
 	return SLURM_ERROR;
 }
 
+static void
+_pack_kill_jobs_msg(kill_jobs_msg_t * msg, Buf buffer,
+		    uint16_t protocol_version)
+{
+	int i;
+
+	xassert(msg != NULL);
+
+	if (protocol_version >= SLURM_16_05_PROTOCOL_VERSION) {
+		pack16(msg->msg_type, buffer);
+		pack32(msg->job_cnt, buffer);
+		for (i = 0; i < msg->job_cnt; i++) {
+			_pack_kill_job_msg(msg->kill_job[i], buffer,
+					   protocol_version);
+		}
+	} else {
+		error("_pack_kill_jobs_msg: protocol_version "
+		      "%hu not supported", protocol_version);
+	}
+}
+
+static int
+_unpack_kill_jobs_msg(kill_jobs_msg_t ** msg, Buf buffer,
+		      uint16_t protocol_version)
+{
+	kill_jobs_msg_t *tmp_ptr;
+	int i;
+
+	/* alloc memory for structure */
+	xassert(msg);
+	tmp_ptr = xmalloc(sizeof(kill_jobs_msg_t));
+	*msg = tmp_ptr;
+
+	if (protocol_version >= SLURM_16_05_PROTOCOL_VERSION) {
+		safe_unpack16(&tmp_ptr->msg_type, buffer);
+		safe_unpack32(&tmp_ptr->job_cnt, buffer);
+		if (tmp_ptr->job_cnt > KILL_JOB_BATCH_MAX) {
+			tmp_ptr->job_cnt = 0;
+			goto unpack_error;
+		}
+		tmp_ptr->kill_job = xmalloc(sizeof(kill_job_msg_t *) *
+					    (tmp_ptr->job_cnt + 1));
+		for (i = 0; i < tmp_ptr->job_cnt; i++) {
+			if (_unpack_kill_job_msg(&tmp_ptr->kill_job[i], buffer,
+						 protocol_version)) {
+				tmp_ptr->job_cnt = i;
+				goto unpack_error;
+			}
+		}
+	} else {
+		error("_unpack_kill_jobs_msg: protocol_version "
+		      "%hu not supported", protocol_version);
+		goto unpack_error;
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_kill_jobs_msg(tmp_ptr);
+	*msg = NULL;
+	return SLURM_ERROR;
+}
+
 static void
 _pack_signal_job_msg(signal_job_msg_t * msg, Buf buffer,
 		     uint16_t protocol_version)
@@ -13616,6 +13691,22 @@ static int  _unpack_stats_response_msg(stats_info_response_msg_t **msg_ptr,
 			safe_unpack32(&msg->bf_queue_len_sum,	buffer);
 			safe_unpack32(&msg->bf_active,		buffer);
 		}
+		if (msg->parts_packed &&
+		    (protocol_version >= SLURM_16_05_PROTOCOL_VERSION)) {
+			safe_unpack32(&msg->schedule_shape_hits,	buffer);
+			safe_unpack32(&msg->schedule_shape_misses, buffer);
+			safe_unpack32(&msg->bf_shape_hits,	buffer);
+			safe_unpack32(&msg->bf_shape_misses,	buffer);
+
+			safe_unpack32(&msg->cr_row_update_cnt,	buffer);
+			safe_unpack64(&msg->cr_row_update_time_sum, buffer);
+			safe_unpack32(&msg->cr_row_update_time_max, buffer);
+			safe_unpack32(&msg->cr_row_jobs_moved,	buffer);
+
+			safe_unpack32(&msg->node_reg_cnt,	buffer);
+			safe_unpack32(&msg->node_reg_lock_cnt,	buffer);
+			safe_unpack32(&msg->node_reg_batch_max,	buffer);
+		}
 
 		safe_unpack32(&msg->rpc_type_size,		buffer);
 		safe_unpack16_array(&msg->rpc_type_id,   &uint32_tmp, buffer);
@@ -46,6 +46,7 @@
 #include "src/common/slurm_protocol_defs.h"
 #include "src/common/slurm_time.h"
 #include "src/common/slurmdb_defs.h"
+#include "src/common/xhash.h"
 #include "src/common/xmalloc.h"
 #include "src/common/xstring.h"
 #include "src/slurmdbd/read_config.h"
@@ -563,6 +564,7 @@ extern void slurmdb_destroy_qos_usage(void *object)
 
 	if (usage) {
 		FREE_NULL_LIST(usage->job_list);
+		xhash_free_ptr((xhash_t **) &usage->user_limit_hash);
 		FREE_NULL_LIST(usage->user_limit_list);
 		xfree(usage->grp_used_tres_run_secs);
 		xfree(usage->grp_used_tres);
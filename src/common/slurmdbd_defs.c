@@ -2354,11 +2354,13 @@ static void _load_dbd_state(void)
 		buffer = NULL;
 	unpack_error:
 		if (ver_str) {
-			char curr_ver_str[10];
-			snprintf(curr_ver_str, sizeof(curr_ver_str),
-				 "VER%d", SLURM_PROTOCOL_VERSION);
-			if (!strcmp(ver_str, curr_ver_str))
-				rpc_version = SLURM_PROTOCOL_VERSION;
+			/* Messages saved by any supported version are
+			 * recovered, not only those of the current one */
+			int ver = 0;
+			if ((sscanf(ver_str, "VER%d", &ver) == 1) &&
+			    (ver >= SLURM_MIN_PROTOCOL_VERSION) &&
+			    (ver <= SLURM_PROTOCOL_VERSION))
+				rpc_version = ver;
 		}
 
 		xfree(ver_str);
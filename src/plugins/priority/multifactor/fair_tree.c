@@ -40,10 +40,34 @@
 #endif
 
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#include "src/common/macros.h"
+#include "src/common/timers.h"
 
 #include "fair_tree.h"
 
+/* Limits on the threads used to calculate level_fs and sort each level */
+#define FT_MAX_THREADS		8
+#define FT_LEVELS_PER_THREAD	32	/* fewer levels are done inline */
+
+/* An account's children, with level_fs calculated and sorted */
+typedef struct {
+	slurmdb_assoc_rec_t *assoc;	/* the account */
+	slurmdb_assoc_rec_t **children;	/* null-terminated, by level_fs */
+	size_t child_cnt;
+} ft_level_t;
+
+/* Levels to be sorted, shared by the sorting threads */
+typedef struct {
+	ft_level_t *levels;
+	size_t level_cnt;
+	size_t next_level;		/* protected by mutex */
+	pthread_mutex_t mutex;
+} ft_sort_args_t;
+
 static int  _ft_decay_apply_new_usage(struct job_record *job, time_t *start);
 static void _apply_priority_fs(void);
 
@@ -68,7 +92,7 @@ extern void fair_tree_decay(List jobs, time_t start)
 
 	/* assign job priorities */
 	lock_slurmctld(job_write_lock);
-	list_for_each(jobs, (ListForF) decay_apply_weighted_factors, &start);
+	decay_apply_weighted_factors_all(jobs, start);
 	unlock_slurmctld(job_write_lock);
 }
 
@@ -260,16 +284,43 @@ static size_t _count_tied_accounts(slurmdb_assoc_rec_t** assocs,
 }
 
 
-/* Copy the children of accounts [begin, end] into a single array.
+/* Sort levels by account pointer for _find_level() */
+static int _cmp_level_assoc(const void *x, const void *y)
+{
+	const ft_level_t *a = (const ft_level_t *)x;
+	const ft_level_t *b = (const ft_level_t *)y;
+
+	if (a->assoc == b->assoc)
+		return 0;
+	return (a->assoc < b->assoc) ? -1 : 1;
+}
+
+
+/* Find an account's level, NULL if it has no children */
+static ft_level_t *_find_level(ft_level_t *levels, size_t level_cnt,
+			       slurmdb_assoc_rec_t *assoc)
+{
+	ft_level_t key;
+
+	key.assoc = assoc;
+	return bsearch(&key, levels, level_cnt, sizeof(ft_level_t),
+		       _cmp_level_assoc);
+}
+
+
+/* Copy the children of accounts [begin, end] into a single sorted array.
  * IN siblings - array of siblings, sorted by level_fs
  * IN begin - index of first account to merge
  * IN end - index of last account to merge
  * IN assoc_level - depth in the tree (root is 0)
+ * IN levels - sorted children of each account
+ * IN level_cnt - number of entries in levels
  * RET - Array of the children. Must be freed.
  */
 static slurmdb_assoc_rec_t** _merge_accounts(
 	slurmdb_assoc_rec_t** siblings,
-	size_t begin, size_t end, uint16_t assoc_level)
+	size_t begin, size_t end, uint16_t assoc_level,
+	ft_level_t *levels, size_t level_cnt)
 {
 	size_t i;
 	/* number of associations in merged array */
@@ -277,25 +328,135 @@ static slurmdb_assoc_rec_t** _merge_accounts(
 	/* merged is a null terminated array */
 	slurmdb_assoc_rec_t** merged = (slurmdb_assoc_rec_t **)
 		xmalloc(sizeof(slurmdb_assoc_rec_t *));
+	ft_level_t *level;
 	merged[0] = NULL;
 
 	for (i = begin; i <= end; i++) {
-		List children = siblings[i]->usage->children_list;
-
 		/* the first account's debug was already printed */
 		if (priority_debug && i > begin)
 			_ft_debug(siblings[i], assoc_level, true);
 
-		if (!children || list_is_empty(children)) {
+		level = _find_level(levels, level_cnt, siblings[i]);
+		if (!level)
 			continue;
-		}
 
-		merged = _append_list_to_array(children, merged, &merged_size);
+		merged = xrealloc(merged, sizeof(slurmdb_assoc_rec_t *) *
+				  (merged_size + level->child_cnt + 1));
+		memcpy(merged + merged_size, level->children,
+		       sizeof(slurmdb_assoc_rec_t *) * level->child_cnt);
+		merged_size += level->child_cnt;
+		merged[merged_size] = NULL;
 	}
+
+	/* level_fs is already set, only the order needs to be fixed */
+	qsort(merged, merged_size, sizeof(slurmdb_assoc_rec_t *),
+	      _cmp_level_fs);
 	return merged;
 }
 
 
+/* Calculate level_fs for an account's children and sort them */
+static void _sort_level(ft_level_t *level)
+{
+	size_t i;
+
+	for (i = 0; i < level->child_cnt; i++)
+		_calc_assoc_fs(level->children[i]);
+	qsort(level->children, level->child_cnt,
+	      sizeof(slurmdb_assoc_rec_t *), _cmp_level_fs);
+}
+
+
+static void *_sort_levels_thread(void *arg)
+{
+	ft_sort_args_t *args = (ft_sort_args_t *)arg;
+	size_t inx;
+
+	while (1) {
+		slurm_mutex_lock(&args->mutex);
+		inx = args->next_level++;
+		slurm_mutex_unlock(&args->mutex);
+		if (inx >= args->level_cnt)
+			break;
+		_sort_level(&args->levels[inx]);
+	}
+	return NULL;
+}
+
+
+/* Calculate level_fs and sort the children of every account. Each level only
+ * reads its own children and their parent's usage, so the levels are spread
+ * across threads. */
+static void _sort_levels(ft_level_t *levels, size_t level_cnt)
+{
+	pthread_t thread_ids[FT_MAX_THREADS];
+	pthread_attr_t attr;
+	ft_sort_args_t args;
+	long cpu_cnt;
+	int i, thread_cnt;
+
+	cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+	thread_cnt = MIN(level_cnt / FT_LEVELS_PER_THREAD, FT_MAX_THREADS);
+	if (cpu_cnt > 0)
+		thread_cnt = MIN(thread_cnt, cpu_cnt);
+
+	memset(&args, 0, sizeof(ft_sort_args_t));
+	args.levels = levels;
+	args.level_cnt = level_cnt;
+	slurm_mutex_init(&args.mutex);
+
+	/* The calling thread also works, create one thread less */
+	for (i = 0; i < (thread_cnt - 1); i++) {
+		slurm_attr_init(&attr);
+		if (pthread_create(&thread_ids[i], &attr,
+				   _sort_levels_thread, &args)) {
+			error("%s: pthread_create: %m", __func__);
+			slurm_attr_destroy(&attr);
+			break;
+		}
+		slurm_attr_destroy(&attr);
+	}
+	thread_cnt = i;
+
+	_sort_levels_thread(&args);
+	for (i = 0; i < thread_cnt; i++)
+		pthread_join(thread_ids[i], NULL);
+	slurm_mutex_destroy(&args.mutex);
+}
+
+
+/* Build the children array of every account with children
+ * IN assoc - account to start with
+ * IN/OUT levels - array of levels to append to
+ * IN/OUT level_cnt - number of entries in levels
+ * IN/OUT level_size - allocated size of levels
+ */
+static void _build_levels(slurmdb_assoc_rec_t *assoc, ft_level_t **levels,
+			  size_t *level_cnt, size_t *level_size)
+{
+	List children = assoc->usage->children_list;
+	slurmdb_assoc_rec_t **child_array;
+	size_t i, inx, child_cnt = 0;
+
+	if (assoc->user || !children || list_is_empty(children))
+		return;
+
+	if (*level_cnt >= *level_size) {
+		*level_size = MAX(*level_size * 2, 64);
+		*levels = xrealloc(*levels, sizeof(ft_level_t) * *level_size);
+	}
+	inx = (*level_cnt)++;
+	child_array = _append_list_to_array(children, NULL, &child_cnt);
+	(*levels)[inx].assoc = assoc;
+	(*levels)[inx].children = child_array;
+	(*levels)[inx].child_cnt = child_cnt;
+
+	/* *levels may move while recursing, so use child_array */
+	for (i = 0; i < child_cnt; i++)
+		_build_levels(child_array[i], levels, level_cnt, level_size);
+}
+
+
 /* Calculate fairshare for each child then sort children by fairshare value
  * (level_fs). Once they are sorted, operate on each child in sorted order.
  * This portion of the tree is now sorted and users are given a fairshare value
@@ -310,28 +471,27 @@ static slurmdb_assoc_rec_t** _merge_accounts(
  *	3) A user with the same level_fs as a sibling account will receive
  *	   the same rank as the account's highest ranked user
  *
- * IN siblings - array of siblings
+ * The level_fs of every association is calculated and each account's children
+ * sorted beforehand by _sort_levels(), only the ranking is done here.
+ *
+ * IN siblings - array of siblings, sorted by level_fs
  * IN assoc_level - depth in the tree (root is 0)
  * IN/OUT rank - current user ranking, starting at g_user_assoc_count
  * IN/OUT rnt - rank, no ties (what rank would be if no tie exists)
  * IN account_tied - is this account tied with the previous user
+ * IN levels - sorted children of each account, ordered by account pointer
+ * IN level_cnt - number of entries in levels
  */
 static void _calc_tree_fs(slurmdb_assoc_rec_t** siblings,
 			  uint16_t assoc_level, uint32_t *rank,
-			  uint32_t *rnt, bool account_tied)
+			  uint32_t *rnt, bool account_tied,
+			  ft_level_t *levels, size_t level_cnt)
 {
 	slurmdb_assoc_rec_t *assoc = NULL;
 	long double prev_level_fs = (long double) NO_VAL;
 	bool tied = false;
 	size_t i;
 
-	/* Calculate level_fs for each child */
-	for (i = 0; (assoc = siblings[i]); i++)
-		_calc_assoc_fs(assoc);
-
-	/* Sort children by level_fs */
-	qsort(siblings, i, sizeof(slurmdb_assoc_rec_t *), _cmp_level_fs);
-
 	/* Iterate through children in sorted order. If it's a user, calculate
 	 * fs_factor, otherwise recurse. */
 	for (i = 0; (assoc = siblings[i]); i++) {
@@ -361,22 +521,30 @@ static void _calc_tree_fs(slurmdb_assoc_rec_t** siblings,
 			(*rnt)--;
 		} else {
 			slurmdb_assoc_rec_t** children;
+			ft_level_t *level;
 			size_t merge_count = _count_tied_accounts(siblings, i);
 
 			/* Merging does not affect child level_fs calculations
 			 * since the necessary information is stored on each
 			 * assoc's usage struct */
-			children = _merge_accounts(siblings, i,
-						   i + merge_count,
-						   assoc_level);
-
-			_calc_tree_fs(children, assoc_level+1,
-				      rank, rnt, tied);
+			if (merge_count) {
+				children = _merge_accounts(siblings, i,
+							   i + merge_count,
+							   assoc_level,
+							   levels, level_cnt);
+				_calc_tree_fs(children, assoc_level+1,
+					      rank, rnt, tied,
+					      levels, level_cnt);
+				xfree(children);
+			} else if ((level = _find_level(levels, level_cnt,
+							assoc))) {
+				_calc_tree_fs(level->children, assoc_level+1,
+					      rank, rnt, tied,
+					      levels, level_cnt);
+			}
 
 			/* Skip over any merged accounts */
 			i += merge_count;
-
-			xfree(children);
 		}
 		prev_level_fs = assoc->usage->level_fs;
 	}
@@ -384,26 +552,37 @@ static void _calc_tree_fs(slurmdb_assoc_rec_t** siblings,
 }
 
 
-/* Start fairshare calculations at root. Call assoc_mgr_lock before this. */
+/* Start fairshare calculations at root. Call assoc_mgr_lock before this.
+ * Every result is written while holding the assoc_mgr write lock, so readers
+ * never see a partially ranked tree. */
 static void _apply_priority_fs(void)
 {
-	slurmdb_assoc_rec_t** children = NULL;
+	ft_level_t *levels = NULL, *root_level;
+	size_t i, level_cnt = 0, level_size = 0;
 	uint32_t rank = g_user_assoc_count;
 	uint32_t rnt = rank;
-	size_t child_count = 0;
+	DEF_TIMERS;
 
 	if (priority_debug)
 		info("Fair Tree fairshare algorithm, starting at root:");
 
 	assoc_mgr_root_assoc->usage->level_fs = (long double) NO_VAL;
 
-	/* _calc_tree_fs requires an array instead of List */
-	children = _append_list_to_array(
-		assoc_mgr_root_assoc->usage->children_list,
-		children,
-		&child_count);
+	START_TIMER;
+	/* _calc_tree_fs requires arrays instead of Lists */
+	_build_levels(assoc_mgr_root_assoc, &levels, &level_cnt, &level_size);
+	_sort_levels(levels, level_cnt);
+	qsort(levels, level_cnt, sizeof(ft_level_t), _cmp_level_assoc);
 
-	_calc_tree_fs(children, 0, &rank, &rnt, false);
+	root_level = _find_level(levels, level_cnt, assoc_mgr_root_assoc);
+	if (root_level) {
+		_calc_tree_fs(root_level->children, 0, &rank, &rnt, false,
+			      levels, level_cnt);
+	}
 
-	xfree(children);
+	for (i = 0; i < level_cnt; i++)
+		xfree(levels[i].children);
+	xfree(levels);
+	END_TIMER;
+	debug2("%s: ranked %zu accounts in %s", __func__, level_cnt, TIME_STR);
 }
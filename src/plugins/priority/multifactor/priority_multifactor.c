@@ -75,6 +75,7 @@
 
 #include "src/common/parse_time.h"
 #include "src/common/slurm_time.h"
+#include "src/common/timers.h"
 #include "src/common/xstring.h"
 #include "src/common/gres.h"
 
@@ -162,11 +163,51 @@ static uint32_t prevflags;    /* Priority Flags before _internal_setup() resets
 static time_t g_last_ran = 0; /* when the last poll ran */
 static double decay_factor = 1; /* The decay factor when decaying time. */
 
+/* Priority factors of the jobs handled by decay_apply_weighted_factors_all(),
+ * stored as one array per factor so the weighting is a single tight loop.
+ * Reused between passes, protected by decay_lock. */
+typedef struct {
+	struct job_record **job;
+	double *accrue;	/* 1.0 if job is accruing age, else 0.0 */
+	double *age;	/* seconds of age, later the weighted age factor */
+	double *fs;
+	double *part;
+	double *qos;
+	double *base;	/* job's prio_base */
+	double *prio;
+	int cnt;
+	int size;
+} prio_batch_t;
+static prio_batch_t prio_batch;
+
+/* A pending job's weighted job size and TRES factors (its prio_base) only
+ * change when the job is updated, which recalculates its priority through
+ * priority_p_set(), when it is requeued, which is detected from a change of
+ * its restart_cnt, or when the configuration changes. Passes of the decay
+ * thread reuse prio_base while its generation is current, recomputing only
+ * the age, fairshare, partition and QOS terms. prio_base_epoch is changed
+ * under the job write lock. */
+#define PRIO_FULL_CALC_PASSES 10	/* recompute prio_base every N passes */
+static uint32_t prio_base_epoch = 1;
+static bool     prio_base_reset = false; /* set on reconfig */
+static uint32_t prio_base_passes = 0;
+static time_t   prio_base_part_update = 0;
+static uint32_t prio_base_cpus = 0, prio_base_nodes = 0;
+
+/* Fairshare factor computed for an association during one pass */
+typedef struct {
+	slurmdb_assoc_rec_t *assoc;
+	double fs;
+} fs_memo_t;
+static fs_memo_t *fs_memo = NULL;	/* open addressing table */
+static uint32_t fs_memo_size = 0;	/* power of 2 */
+
 /* variables defined in prirority_multifactor.h */
 bool priority_debug = 0;
 
 static void _priority_p_set_assoc_usage_debug(slurmdb_assoc_rec_t *assoc);
 static void _set_assoc_usage_efctv(slurmdb_assoc_rec_t *assoc);
+static void _prio_batch_free(prio_batch_t *batch);
 
 /*
  * apply decay factor to all associations usage_raw
@@ -439,26 +480,17 @@ static int _set_children_usage_efctv(List children_list)
 }
 
 
-/* job_ptr should already have the partition priority and such added here
- * before had we will be adding to it
- */
-static double _get_fairshare_priority(struct job_record *job_ptr)
+/* Compute a job's fairshare factor.
+ * Call with the assoc_mgr association read lock held. */
+static double _get_fairshare_priority_locked(struct job_record *job_ptr)
 {
 	slurmdb_assoc_rec_t *job_assoc;
 	slurmdb_assoc_rec_t *fs_assoc = NULL;
 	double priority_fs = 0.0;
-	assoc_mgr_lock_t locks = { READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK,
-				   NO_LOCK, NO_LOCK, NO_LOCK };
-
-	if (!calc_fairshare)
-		return 0;
-
-	assoc_mgr_lock(&locks);
 
 	job_assoc = (slurmdb_assoc_rec_t *)job_ptr->assoc_ptr;
 
 	if (!job_assoc) {
-		assoc_mgr_unlock(&locks);
 		error("Job %u has no association.  Unable to "
 		      "compute fairshare.", job_ptr->job_id);
 		return 0;
@@ -494,19 +526,229 @@ static double _get_fairshare_priority(struct job_record *job_ptr)
 			     fs_assoc->usage->shares_norm, priority_fs);
 		}
 	}
+
+	return priority_fs;
+}
+
+/* job_ptr should already have the partition priority and such added here
+ * before had we will be adding to it
+ */
+static double _get_fairshare_priority(struct job_record *job_ptr)
+{
+	double priority_fs;
+	assoc_mgr_lock_t locks = { READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK,
+				   NO_LOCK, NO_LOCK, NO_LOCK };
+
+	if (!calc_fairshare)
+		return 0;
+
+	assoc_mgr_lock(&locks);
+	priority_fs = _get_fairshare_priority_locked(job_ptr);
 	assoc_mgr_unlock(&locks);
 
 	return priority_fs;
 }
 
 
+/* Clear a job's priority factors, allocating the record if needed. The TRES
+ * arrays are kept (and zeroed) when their size is still valid, this avoids
+ * two allocations per job and calculation cycle. */
+static void _reset_prio_factors(struct job_record *job_ptr)
+{
+	priority_factors_object_t *factors = job_ptr->prio_factors;
+	double *priority_tres, *tres_weights;
+
+	if (!factors) {
+		job_ptr->prio_factors =
+			xmalloc(sizeof(priority_factors_object_t));
+		return;
+	}
+
+	if (weight_tres && factors->priority_tres && factors->tres_weights &&
+	    (factors->tres_cnt == slurmctld_tres_cnt)) {
+		priority_tres = factors->priority_tres;
+		tres_weights  = factors->tres_weights;
+		memset(factors, 0, sizeof(priority_factors_object_t));
+		memset(priority_tres, 0, sizeof(double) * slurmctld_tres_cnt);
+		memcpy(tres_weights, weight_tres,
+		       sizeof(double) * slurmctld_tres_cnt);
+		factors->priority_tres = priority_tres;
+		factors->tres_weights  = tres_weights;
+		factors->tres_cnt      = slurmctld_tres_cnt;
+	} else {
+		xfree(factors->tres_weights);
+		xfree(factors->priority_tres);
+		memset(factors, 0, sizeof(priority_factors_object_t));
+	}
+}
+
+/* Returns the job size factor of a job, 0.0 -> 1.0 */
+static double _get_js_factor(struct job_record *job_ptr)
+{
+	/* FIXME: this should work off the product of TRESBillingWeights */
+	uint32_t cpu_cnt = 0, min_nodes = 1;
+	double priority_js;
+
+	/* On the initial run of this we don't have total_cpus
+	   so go off the requesting.  After the first shot
+	   total_cpus should be filled in.
+	*/
+	if (job_ptr->total_cpus)
+		cpu_cnt = job_ptr->total_cpus;
+	else if (job_ptr->details
+		 && (job_ptr->details->max_cpus != NO_VAL))
+		cpu_cnt = job_ptr->details->max_cpus;
+	else if (job_ptr->details && job_ptr->details->min_cpus)
+		cpu_cnt = job_ptr->details->min_cpus;
+	if (job_ptr->details)
+		min_nodes = job_ptr->details->min_nodes;
+
+	if (flags & PRIORITY_FLAGS_SIZE_RELATIVE) {
+		uint32_t time_limit = 1;
+		/* Job size in CPUs (based upon average CPUs/Node */
+		priority_js = (double)min_nodes * (double)cluster_cpus /
+			      (double)node_record_count;
+		if (cpu_cnt > priority_js)
+			priority_js = (double)cpu_cnt;
+		/* Divide by job time limit */
+		if (job_ptr->time_limit != NO_VAL)
+			time_limit = job_ptr->time_limit;
+		else if (job_ptr->part_ptr)
+			time_limit = job_ptr->part_ptr->max_time;
+		priority_js /= time_limit;
+		/* Normalize to max value of 1.0 */
+		priority_js /= cluster_cpus;
+		if (favor_small)
+			priority_js = (double) 1.0 - priority_js;
+	} else if (favor_small) {
+		priority_js = (double)(node_record_count - min_nodes)
+			/ (double)node_record_count;
+		if (cpu_cnt) {
+			priority_js += (double)(cluster_cpus - cpu_cnt)
+				/ (double)cluster_cpus;
+			priority_js /= 2;
+		}
+	} else {	/* favor large */
+		priority_js = (double)min_nodes / (double)node_record_count;
+		if (cpu_cnt) {
+			priority_js += (double)cpu_cnt / (double)cluster_cpus;
+			priority_js /= 2;
+		}
+	}
+	if (priority_js < .0)
+		priority_js = 0.0;
+	else if (priority_js > 1.0)
+		priority_js = 1.0;
+
+	return priority_js;
+}
+
+/* Set the unweighted TRES factors of a job, weight_tres must be set */
+static void _set_tres_factors(struct job_record *job_ptr)
+{
+	int i;
+	double *tres_factors = NULL;
+
+	if (!job_ptr->prio_factors->priority_tres) {
+		job_ptr->prio_factors->priority_tres =
+			xmalloc(sizeof(double) * slurmctld_tres_cnt);
+		job_ptr->prio_factors->tres_weights =
+			xmalloc(sizeof(double) * slurmctld_tres_cnt);
+		memcpy(job_ptr->prio_factors->tres_weights, weight_tres,
+		       sizeof(double) * slurmctld_tres_cnt);
+		job_ptr->prio_factors->tres_cnt = slurmctld_tres_cnt;
+	}
+	tres_factors = job_ptr->prio_factors->priority_tres;
+
+	/* can't memcpy because of different types
+	 * uint64_t vs. double */
+	for (i = 0; i < slurmctld_tres_cnt; i++) {
+		uint64_t value = 0;
+		if (job_ptr->tres_alloc_cnt)
+			value = job_ptr->tres_alloc_cnt[i];
+		else if (job_ptr->tres_req_cnt)
+			value = job_ptr->tres_req_cnt[i];
+
+		if (value &&
+		    job_ptr->part_ptr &&
+		    job_ptr->part_ptr->tres_cnt &&
+		    job_ptr->part_ptr->tres_cnt[i])
+			tres_factors[i] = value /
+				(double)job_ptr->part_ptr->tres_cnt[i];
+	}
+}
+
+/* Clamp a job's weighted priority into the valid range and fill in its
+ * per-partition priorities. The job's prio_factors must already hold the
+ * weighted factor values.
+ * RET the job's priority */
+static double _finalize_priority(struct job_record *job_ptr, double priority)
+{
+	/* All terms except the partition's */
+	double other_prio = priority - job_ptr->prio_factors->priority_part;
+	uint64_t tmp_64;
+
+	/* Priority 0 is reserved for held jobs */
+	if (priority < 1)
+		priority = 1;
+
+	tmp_64 = (uint64_t) priority;
+	if (tmp_64 > 0xffffffff) {
+		error("Job %u priority exceeds 32 bits", job_ptr->job_id);
+		tmp_64 = 0xffffffff;
+		priority = (double) tmp_64;
+	}
+
+	if (job_ptr->part_ptr_list) {
+		struct part_record *part_ptr;
+		double priority_part;
+		ListIterator part_iterator;
+		int i = 0;
+
+		if (!job_ptr->priority_array) {
+			i = list_count(job_ptr->part_ptr_list) + 1;
+			job_ptr->priority_array = xmalloc(sizeof(uint32_t) * i);
+		}
+
+		i = 0;
+		part_iterator = list_iterator_create(job_ptr->part_ptr_list);
+		while ((part_ptr = (struct part_record *)
+			list_next(part_iterator))) {
+			priority_part = part_ptr->priority /
+				(double)part_max_priority *
+				(double)weight_part;
+			priority_part += other_prio;
+
+			/* Priority 0 is reserved for held jobs */
+			if (priority_part < 1)
+				priority_part = 1;
+
+			tmp_64 = (uint64_t) priority_part;
+			if (tmp_64 > 0xffffffff) {
+				error("Job %u priority exceeds 32 bits",
+				      job_ptr->job_id);
+				tmp_64 = 0xffffffff;
+				priority_part = (double) tmp_64;
+			}
+			job_ptr->priority_array[i] = (uint32_t) priority_part;
+
+			debug("Job %u has more than one partition (%s)(%u)",
+			      job_ptr->job_id, part_ptr->name,
+			      job_ptr->priority_array[i]);
+			i++;
+		}
+		list_iterator_destroy(part_iterator);
+	}
+
+	return priority;
+}
+
 /* Returns the priority after applying the weight factors */
 static uint32_t _get_priority_internal(time_t start_time,
 				       struct job_record *job_ptr)
 {
 	double priority	= 0.0;
 	priority_factors_object_t pre_factors;
-	uint64_t tmp_64;
 	double tmp_tres = 0.0;
 
 	if (job_ptr->direct_set_prio && (job_ptr->priority > 0)) {
@@ -572,64 +814,12 @@ static uint32_t _get_priority_internal(time_t start_time,
 		+ tmp_tres
 		- (double)(job_ptr->prio_factors->nice - NICE_OFFSET);
 
-	/* Priority 0 is reserved for held jobs */
-	if (priority < 1)
-		priority = 1;
-
-	tmp_64 = (uint64_t) priority;
-	if (tmp_64 > 0xffffffff) {
-		error("Job %u priority exceeds 32 bits", job_ptr->job_id);
-		tmp_64 = 0xffffffff;
-		priority = (double) tmp_64;
-	}
-
-	if (job_ptr->part_ptr_list) {
-		struct part_record *part_ptr;
-		double priority_part;
-		ListIterator part_iterator;
-		int i = 0;
-
-		if (!job_ptr->priority_array) {
-			i = list_count(job_ptr->part_ptr_list) + 1;
-			job_ptr->priority_array = xmalloc(sizeof(uint32_t) * i);
-		}
-
-		i = 0;
-		part_iterator = list_iterator_create(job_ptr->part_ptr_list);
-		while ((part_ptr = (struct part_record *)
-			list_next(part_iterator))) {
-			priority_part = part_ptr->priority /
-				(double)part_max_priority *
-				(double)weight_part;
-			priority_part +=
-				 (job_ptr->prio_factors->priority_age
-				 + job_ptr->prio_factors->priority_fs
-				 + job_ptr->prio_factors->priority_js
-				 + job_ptr->prio_factors->priority_qos
-				 + tmp_tres
-				 - (double)(job_ptr->prio_factors->nice
-					    - NICE_OFFSET));
-
-			/* Priority 0 is reserved for held jobs */
-			if (priority_part < 1)
-				priority_part = 1;
-
-			tmp_64 = (uint64_t) priority_part;
-			if (tmp_64 > 0xffffffff) {
-				error("Job %u priority exceeds 32 bits",
-				      job_ptr->job_id);
-				tmp_64 = 0xffffffff;
-				priority_part = (double) tmp_64;
-			}
-			job_ptr->priority_array[i] = (uint32_t) priority_part;
+	job_ptr->prio_base = job_ptr->prio_factors->priority_js + tmp_tres
+		- (double)(job_ptr->prio_factors->nice - NICE_OFFSET);
+	job_ptr->prio_base_epoch = prio_base_epoch;
+	job_ptr->prio_base_restart = job_ptr->restart_cnt;
 
-			debug("Job %u has more than one partition (%s)(%u)",
-			      job_ptr->job_id, part_ptr->name,
-			      job_ptr->priority_array[i]);
-			i++;
-		}
-		list_iterator_destroy(part_iterator);
-	}
+	priority = _finalize_priority(job_ptr, priority);
 
 	if (priority_debug) {
 		int i;
@@ -1168,17 +1358,12 @@ static int _apply_new_usage(struct job_record *job_ptr,
 }
 
 
-static int _decay_apply_new_usage_and_weighted_factors(
-	struct job_record *job_ptr,
-	time_t *start_time_ptr)
+static int _decay_apply_new_usage(struct job_record *job_ptr,
+				  time_t *start_time_ptr)
 {
 	/* Always return SUCCESS so that list_for_each will
 	 * continue processing list of jobs. */
-
-	if (!decay_apply_new_usage(job_ptr, start_time_ptr))
-		return SLURM_SUCCESS;
-
-	decay_apply_weighted_factors(job_ptr, start_time_ptr);
+	decay_apply_new_usage(job_ptr, start_time_ptr);
 
 	return SLURM_SUCCESS;
 }
@@ -1343,11 +1528,10 @@ static void *_decay_thread(void *no_data)
 
 		if (!(flags & PRIORITY_FLAGS_FAIR_TREE)) {
 			lock_slurmctld(job_write_lock);
-			list_for_each(
-				job_list,
-				(ListForF) _decay_apply_new_usage_and_weighted_factors,
-				&start_time
-				);
+			list_for_each(job_list,
+				      (ListForF) _decay_apply_new_usage,
+				      &start_time);
+			decay_apply_weighted_factors_all(job_list, start_time);
 			unlock_slurmctld(job_write_lock);
 		}
 
@@ -1697,6 +1881,7 @@ int fini ( void )
 		pthread_join(cleanup_handler_thread, NULL);
 
 	xfree(weight_tres);
+	_prio_batch_free(&prio_batch);
 
 	slurm_mutex_unlock(&decay_lock);
 
@@ -1718,6 +1903,7 @@ extern void priority_p_reconfig(bool assoc_clear)
 				   NO_LOCK, NO_LOCK, NO_LOCK };
 
 	reconfig = 1;
+	prio_base_reset = true;
 	prevflags = flags;
 	_internal_setup();
 
@@ -1927,21 +2113,265 @@ extern int decay_apply_weighted_factors(struct job_record *job_ptr,
 }
 
 
+/* Grow the batch arrays to hold at least cnt jobs */
+static void _prio_batch_grow(prio_batch_t *batch, int cnt)
+{
+	if (cnt <= batch->size)
+		return;
+	batch->size = MAX(cnt, batch->size * 2);
+	xrealloc(batch->job,    sizeof(struct job_record *) * batch->size);
+	xrealloc(batch->accrue, sizeof(double) * batch->size);
+	xrealloc(batch->age,    sizeof(double) * batch->size);
+	xrealloc(batch->fs,     sizeof(double) * batch->size);
+	xrealloc(batch->part,   sizeof(double) * batch->size);
+	xrealloc(batch->qos,    sizeof(double) * batch->size);
+	xrealloc(batch->base,   sizeof(double) * batch->size);
+	xrealloc(batch->prio,   sizeof(double) * batch->size);
+}
+
+static void _prio_batch_free(prio_batch_t *batch)
+{
+	xfree(batch->job);
+	xfree(batch->accrue);
+	xfree(batch->age);
+	xfree(batch->fs);
+	xfree(batch->part);
+	xfree(batch->qos);
+	xfree(batch->base);
+	xfree(batch->prio);
+	memset(batch, 0, sizeof(prio_batch_t));
+	xfree(fs_memo);
+	fs_memo_size = 0;
+}
+
+/* Return the fairshare factor of a job, computing it only once per
+ * association and pass. Call with the assoc_mgr association read lock held
+ * and after clearing fs_memo. */
+static double _get_fairshare_memo(struct job_record *job_ptr)
+{
+	slurmdb_assoc_rec_t *assoc = job_ptr->assoc_ptr;
+	uint32_t inx = (uint32_t) (((uintptr_t) assoc >> 4) * 2654435761U);
+
+	inx &= (fs_memo_size - 1);
+	while (fs_memo[inx].assoc) {
+		if (fs_memo[inx].assoc == assoc)
+			return fs_memo[inx].fs;
+		inx = (inx + 1) & (fs_memo_size - 1);
+	}
+	fs_memo[inx].assoc = assoc;
+	fs_memo[inx].fs = _get_fairshare_priority_locked(job_ptr);
+	return fs_memo[inx].fs;
+}
+
+/* Start a new prio_base generation if anything other than the job itself
+ * might have changed its job size or TRES factors */
+static void _validate_prio_base(void)
+{
+	if (prio_base_reset ||
+	    (++prio_base_passes >= PRIO_FULL_CALC_PASSES) ||
+	    (prio_base_part_update != last_part_update) ||
+	    (prio_base_cpus != cluster_cpus) ||
+	    (prio_base_nodes != node_record_count)) {
+		prio_base_reset = false;
+		prio_base_passes = 0;
+		prio_base_part_update = last_part_update;
+		prio_base_cpus = cluster_cpus;
+		prio_base_nodes = node_record_count;
+		if (++prio_base_epoch == 0)	/* 0 is never valid */
+			prio_base_epoch = 1;
+	}
+}
+
+/* Set a job's prio_base and the job size, TRES and nice members of its
+ * prio_factors */
+static void _set_prio_base(struct job_record *job_ptr)
+{
+	double tmp_tres = 0.0;
+	int i;
+
+	_reset_prio_factors(job_ptr);
+	if (weight_js) {
+		job_ptr->prio_factors->priority_js =
+			_get_js_factor(job_ptr) * (double)weight_js;
+	}
+	if (weight_tres) {
+		double *tres_factors;
+		_set_tres_factors(job_ptr);
+		tres_factors = job_ptr->prio_factors->priority_tres;
+		for (i = 0; i < slurmctld_tres_cnt; i++) {
+			tres_factors[i] *= weight_tres[i];
+			tmp_tres += tres_factors[i];
+		}
+	}
+	job_ptr->prio_factors->nice = job_ptr->details->nice;
+
+	job_ptr->prio_base = job_ptr->prio_factors->priority_js + tmp_tres
+		- (double)(job_ptr->prio_factors->nice - NICE_OFFSET);
+	job_ptr->prio_base_epoch = prio_base_epoch;
+	job_ptr->prio_base_restart = job_ptr->restart_cnt;
+}
+
+/* Recalculate the priority of every job in job_list which needs it.
+ * Factors which only depend upon the job are gathered into prio_batch, the
+ * fairshare factors are computed once per association under a single
+ * assoc_mgr lock and the weighting is then done in one pass over the arrays.
+ * A pending job's job size and TRES terms are reused from its prio_base
+ * while still valid, so the usual pass only follows the job's details,
+ * partition, QOS and association pointers.
+ * Equivalent to calling decay_apply_weighted_factors() for each job.
+ * Call with the job write lock held. */
+extern void decay_apply_weighted_factors_all(List job_list, time_t start_time)
+{
+	prio_batch_t *batch = &prio_batch;
+	struct job_record *job_ptr;
+	ListIterator job_iterator;
+	double d_max_age = (double) max_age;
+	double w_age = (double) weight_age, w_fs = (double) weight_fs;
+	double w_part = (double) weight_part, w_qos = (double) weight_qos;
+	uint32_t memo_size, new_prio;
+	int i, base_cnt = 0, change_cnt = 0;
+	DEF_TIMERS;
+
+	if (priority_debug) {
+		/* Log each factor of each job, no need to be fast */
+		list_for_each(job_list,
+			      (ListForF) decay_apply_weighted_factors,
+			      &start_time);
+		return;
+	}
+
+	START_TIMER;
+	_validate_prio_base();
+	_prio_batch_grow(batch, list_count(job_list));
+	batch->cnt = 0;
+	job_iterator = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		slurmdb_qos_rec_t *qos_ptr;
+		time_t use_time;
+
+		/* Priority 0 is reserved for held jobs. Also skip priority
+		 * calculation for non-pending jobs. */
+		if ((job_ptr->priority == 0) ||
+		    (!IS_JOB_PENDING(job_ptr) &&
+		     !(flags & PRIORITY_FLAGS_CALCULATE_RUNNING)) ||
+		    IS_JOB_FINISHED(job_ptr) || IS_JOB_COMPLETING(job_ptr))
+			continue;
+		if ((job_ptr->direct_set_prio && (job_ptr->priority > 0)) ||
+		    !job_ptr->details) {
+			decay_apply_weighted_factors(job_ptr, &start_time);
+			continue;
+		}
+
+		i = batch->cnt++;
+		batch->job[i] = job_ptr;
+
+		/* A running job's TRES and CPU counts change as it starts */
+		if (!job_ptr->prio_factors ||
+		    (job_ptr->prio_base_epoch != prio_base_epoch) ||
+		    (job_ptr->prio_base_restart != job_ptr->restart_cnt) ||
+		    !IS_JOB_PENDING(job_ptr)) {
+			_set_prio_base(job_ptr);
+			base_cnt++;
+		}
+		batch->base[i] = job_ptr->prio_base;
+
+		if (flags & PRIORITY_FLAGS_ACCRUE_ALWAYS)
+			use_time = job_ptr->details->submit_time;
+		else
+			use_time = job_ptr->details->begin_time;
+		if (weight_age && (job_ptr->details->begin_time ||
+				   (flags & PRIORITY_FLAGS_ACCRUE_ALWAYS)))
+			batch->accrue[i] = 1.0;
+		else
+			batch->accrue[i] = 0.0;
+		if (start_time > use_time)
+			batch->age[i] = (double) (uint32_t)
+					(start_time - use_time);
+		else
+			batch->age[i] = 0.0;
+
+		batch->fs[i] = 0.0;
+
+		if (job_ptr->part_ptr && job_ptr->part_ptr->priority &&
+		    weight_part)
+			batch->part[i] = job_ptr->part_ptr->norm_priority;
+		else
+			batch->part[i] = 0.0;
+
+		qos_ptr = (slurmdb_qos_rec_t *) job_ptr->qos_ptr;
+		if (qos_ptr && qos_ptr->priority && weight_qos)
+			batch->qos[i] = qos_ptr->usage->norm_priority;
+		else
+			batch->qos[i] = 0.0;
+	}
+	list_iterator_destroy(job_iterator);
+
+	if (weight_fs && calc_fairshare && batch->cnt) {
+		assoc_mgr_lock_t locks = { READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK,
+					   NO_LOCK, NO_LOCK, NO_LOCK };
+
+		for (memo_size = 64; memo_size < (batch->cnt * 2);
+		     memo_size *= 2)
+			;
+		if (memo_size > fs_memo_size) {
+			xfree(fs_memo);
+			fs_memo = xmalloc(sizeof(fs_memo_t) * memo_size);
+			fs_memo_size = memo_size;
+		} else
+			memset(fs_memo, 0, sizeof(fs_memo_t) * fs_memo_size);
+
+		assoc_mgr_lock(&locks);
+		for (i = 0; i < batch->cnt; i++) {
+			if (batch->job[i]->assoc_ptr)
+				batch->fs[i] = _get_fairshare_memo(
+					batch->job[i]);
+		}
+		assoc_mgr_unlock(&locks);
+	}
+
+	/* No pointers followed here, the compiler can vectorize this */
+	for (i = 0; i < batch->cnt; i++) {
+		batch->age[i] = batch->accrue[i] *
+			((batch->age[i] < d_max_age) ?
+			 (batch->age[i] / d_max_age) : 1.0);
+		batch->age[i]  *= w_age;
+		batch->fs[i]   *= w_fs;
+		batch->part[i] *= w_part;
+		batch->qos[i]  *= w_qos;
+		batch->prio[i]  = batch->age[i] + batch->fs[i] + batch->part[i]
+				  + batch->qos[i] + batch->base[i];
+	}
+
+	for (i = 0; i < batch->cnt; i++) {
+		job_ptr = batch->job[i];
+		job_ptr->prio_factors->priority_age  = batch->age[i];
+		job_ptr->prio_factors->priority_fs   = batch->fs[i];
+		job_ptr->prio_factors->priority_part = batch->part[i];
+		job_ptr->prio_factors->priority_qos  = batch->qos[i];
+		new_prio = (uint32_t) _finalize_priority(job_ptr,
+							 batch->prio[i]);
+		if (new_prio == job_ptr->priority)
+			continue;
+		job_ptr->priority = new_prio;
+		change_cnt++;
+		debug2("priority for job %u is now %u",
+		       job_ptr->job_id, job_ptr->priority);
+	}
+	if (change_cnt)
+		last_job_update = time(NULL);
+	END_TIMER;
+	debug2("%s: priority of %d jobs calculated (%d full, %d changed) in %s",
+	       __func__, batch->cnt, base_cnt, change_cnt, TIME_STR);
+}
+
+
 extern void set_priority_factors(time_t start_time, struct job_record *job_ptr)
 {
 	slurmdb_qos_rec_t *qos_ptr = NULL;
 
 	xassert(job_ptr);
 
-	if (!job_ptr->prio_factors)
-		job_ptr->prio_factors =
-			xmalloc(sizeof(priority_factors_object_t));
-	else {
-		xfree(job_ptr->prio_factors->tres_weights);
-		xfree(job_ptr->prio_factors->priority_tres);
-		memset(job_ptr->prio_factors, 0,
-		       sizeof(priority_factors_object_t));
-	}
+	_reset_prio_factors(job_ptr);
 
 	qos_ptr = (slurmdb_qos_rec_t *)job_ptr->qos_ptr;
 
@@ -1975,71 +2405,8 @@ extern void set_priority_factors(time_t start_time, struct job_record *job_ptr)
 			_get_fairshare_priority(job_ptr);
 	}
 
-	/* FIXME: this should work off the product of TRESBillingWeights */
-	if (weight_js) {
-		uint32_t cpu_cnt = 0, min_nodes = 1;
-		/* On the initial run of this we don't have total_cpus
-		   so go off the requesting.  After the first shot
-		   total_cpus should be filled in.
-		*/
-		if (job_ptr->total_cpus)
-			cpu_cnt = job_ptr->total_cpus;
-		else if (job_ptr->details
-			 && (job_ptr->details->max_cpus != NO_VAL))
-			cpu_cnt = job_ptr->details->max_cpus;
-		else if (job_ptr->details && job_ptr->details->min_cpus)
-			cpu_cnt = job_ptr->details->min_cpus;
-		if (job_ptr->details)
-			min_nodes = job_ptr->details->min_nodes;
-
-		if (flags & PRIORITY_FLAGS_SIZE_RELATIVE) {
-			uint32_t time_limit = 1;
-			/* Job size in CPUs (based upon average CPUs/Node */
-			job_ptr->prio_factors->priority_js =
-				(double)min_nodes *
-				(double)cluster_cpus /
-				(double)node_record_count;
-			if (cpu_cnt > job_ptr->prio_factors->priority_js) {
-				job_ptr->prio_factors->priority_js =
-					(double)cpu_cnt;
-			}
-			/* Divide by job time limit */
-			if (job_ptr->time_limit != NO_VAL)
-				time_limit = job_ptr->time_limit;
-			else if (job_ptr->part_ptr)
-				time_limit = job_ptr->part_ptr->max_time;
-			job_ptr->prio_factors->priority_js /= time_limit;
-			/* Normalize to max value of 1.0 */
-			job_ptr->prio_factors->priority_js /= cluster_cpus;
-			if (favor_small) {
-				job_ptr->prio_factors->priority_js =
-					(double) 1.0 -
-					job_ptr->prio_factors->priority_js;
-			}
-		} else if (favor_small) {
-			job_ptr->prio_factors->priority_js =
-				(double)(node_record_count - min_nodes)
-				/ (double)node_record_count;
-			if (cpu_cnt) {
-				job_ptr->prio_factors->priority_js +=
-					(double)(cluster_cpus - cpu_cnt)
-					/ (double)cluster_cpus;
-				job_ptr->prio_factors->priority_js /= 2;
-			}
-		} else {	/* favor large */
-			job_ptr->prio_factors->priority_js =
-				(double)min_nodes / (double)node_record_count;
-			if (cpu_cnt) {
-				job_ptr->prio_factors->priority_js +=
-					(double)cpu_cnt / (double)cluster_cpus;
-				job_ptr->prio_factors->priority_js /= 2;
-			}
-		}
-		if (job_ptr->prio_factors->priority_js < .0)
-			job_ptr->prio_factors->priority_js = 0.0;
-		else if (job_ptr->prio_factors->priority_js > 1.0)
-			job_ptr->prio_factors->priority_js = 1.0;
-	}
+	if (weight_js)
+		job_ptr->prio_factors->priority_js = _get_js_factor(job_ptr);
 
 	if (job_ptr->part_ptr && job_ptr->part_ptr->priority && weight_part) {
 		job_ptr->prio_factors->priority_part =
@@ -2056,38 +2423,8 @@ extern void set_priority_factors(time_t start_time, struct job_record *job_ptr)
 	else
 		job_ptr->prio_factors->nice = NICE_OFFSET;
 
-	if (weight_tres) {
-		int i;
-		double *tres_factors = NULL;
-
-		if (!job_ptr->prio_factors->priority_tres) {
-			job_ptr->prio_factors->priority_tres =
-				xmalloc(sizeof(double) * slurmctld_tres_cnt);
-			job_ptr->prio_factors->tres_weights =
-				xmalloc(sizeof(double) * slurmctld_tres_cnt);
-			memcpy(job_ptr->prio_factors->tres_weights, weight_tres,
-			       sizeof(double) * slurmctld_tres_cnt);
-			job_ptr->prio_factors->tres_cnt = slurmctld_tres_cnt;
-		}
-		tres_factors = job_ptr->prio_factors->priority_tres;
-
-		/* can't memcpy because of different types
-		 * uint64_t vs. double */
-		for (i = 0; i < slurmctld_tres_cnt; i++) {
-			uint64_t value = 0;
-			if (job_ptr->tres_alloc_cnt)
-				value = job_ptr->tres_alloc_cnt[i];
-			else if (job_ptr->tres_req_cnt)
-				value = job_ptr->tres_req_cnt[i];
-
-			if (value &&
-			    job_ptr->part_ptr &&
-			    job_ptr->part_ptr->tres_cnt &&
-			    job_ptr->part_ptr->tres_cnt[i])
-				tres_factors[i] = value /
-					(double)job_ptr->part_ptr->tres_cnt[i];
-		}
-	}
+	if (weight_tres)
+		_set_tres_factors(job_ptr);
 }
 
 
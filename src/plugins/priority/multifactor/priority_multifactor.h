@@ -57,6 +57,7 @@ extern bool decay_apply_new_usage(
 		struct job_record *job_ptr, time_t *start_time_ptr);
 extern int  decay_apply_weighted_factors(
 		struct job_record *job_ptr, time_t *start_time_ptr);
+extern void decay_apply_weighted_factors_all(List job_list, time_t start_time);
 extern void set_assoc_usage_norm(slurmdb_assoc_rec_t *assoc);
 extern void set_priority_factors(time_t start_time, struct job_record *job_ptr);
 
@@ -98,6 +98,75 @@ const uint32_t plugin_version   = SLURM_VERSION_NUMBER;
 static uint64_t debug_flags = 0;
 static pthread_mutex_t route_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Cache of recent splits, the same node sets (e.g. a job's allocation) are
+ * typically split repeatedly for launch, signal and termination messages.
+ * Entries hold ranged hostlist strings, protected by route_lock. */
+#define ROUTE_CACHE_MAX 128
+typedef struct route_cache {
+	char *key;		/* ranged string of the input hostlist */
+	int count;		/* count of sublists */
+	char **sp_str;		/* ranged string of each sublist */
+} route_cache_t;
+static route_cache_t route_cache[ROUTE_CACHE_MAX];
+static int route_cache_next = 0;
+
+/* Free every cached split. Caller must hold route_lock. */
+static void _route_cache_clear(void)
+{
+	int i, j;
+
+	for (i = 0; i < ROUTE_CACHE_MAX; i++) {
+		if (!route_cache[i].key)
+			continue;
+		for (j = 0; j < route_cache[i].count; j++)
+			xfree(route_cache[i].sp_str[j]);
+		xfree(route_cache[i].sp_str);
+		xfree(route_cache[i].key);
+		route_cache[i].count = 0;
+	}
+	route_cache_next = 0;
+}
+
+/* Build the sublists for hostlist string "key" from the cache.
+ * RET true if found. Caller must hold route_lock. */
+static bool _route_cache_get(char *key, hostlist_t **sp_hl, int *count)
+{
+	int i, j;
+
+	for (i = 0; i < ROUTE_CACHE_MAX; i++) {
+		if (!route_cache[i].key || strcmp(route_cache[i].key, key))
+			continue;
+		*sp_hl = (hostlist_t *) xmalloc(route_cache[i].count *
+						sizeof(hostlist_t));
+		for (j = 0; j < route_cache[i].count; j++)
+			(*sp_hl)[j] = hostlist_create(route_cache[i].sp_str[j]);
+		*count = route_cache[i].count;
+		return true;
+	}
+	return false;
+}
+
+/* Record a split, replacing the oldest entry once the cache is full.
+ * Takes ownership of key. Caller must hold route_lock. */
+static void _route_cache_add(char *key, hostlist_t *sp_hl, int count)
+{
+	route_cache_t *ent = &route_cache[route_cache_next];
+	int j;
+
+	if (ent->key) {
+		for (j = 0; j < ent->count; j++)
+			xfree(ent->sp_str[j]);
+		xfree(ent->sp_str);
+		xfree(ent->key);
+	}
+	ent->key = key;
+	ent->count = count;
+	ent->sp_str = xmalloc(sizeof(char *) * (count ? count : 1));
+	for (j = 0; j < count; j++)
+		ent->sp_str[j] = hostlist_ranged_string_xmalloc(sp_hl[j]);
+	route_cache_next = (route_cache_next + 1) % ROUTE_CACHE_MAX;
+}
+
 /*****************************************************************************\
  *  Functions required of all plugins
 \*****************************************************************************/
@@ -123,6 +192,9 @@ extern int init(void)
  */
 extern int fini(void)
 {
+	slurm_mutex_lock(&route_lock);
+	_route_cache_clear();
+	slurm_mutex_unlock(&route_lock);
 	return SLURM_SUCCESS;
 }
 
@@ -142,13 +214,15 @@ extern int fini(void)
  * Note: created hostlist will have to be freed independently using
  *       hostlist_destroy by the caller.
  * Note: the hostlist_t array will have to be xfree.
+ * Note: splits across switches are cached by node set, so repeated messages
+ *       to the same nodes (e.g. one job's allocation) skip the bitmap work.
  */
 extern int route_p_split_hostlist(hostlist_t hl,
 				  hostlist_t** sp_hl,
 				  int* count)
 {
 	int i, j, k, hl_ndx, msg_count, sw_count, lst_count;
-	char  *buf;
+	char  *buf, *key;
 	bitstr_t *nodes_bitmap = NULL;		/* nodes in message list */
 	bitstr_t *fwd_bitmap = NULL;		/* nodes in forward list */
 
@@ -168,6 +242,16 @@ extern int route_p_split_hostlist(hostlist_t hl,
 		if (slurm_topo_build_config() != SLURM_SUCCESS) {
 			fatal("ROUTE: Failed to build topology config");
 		}
+		_route_cache_clear();
+	}
+	key = hostlist_ranged_string_xmalloc(hl);
+	if (_route_cache_get(key, sp_hl, count)) {
+		slurm_mutex_unlock(&route_lock);
+		if (debug_flags & DEBUG_FLAG_ROUTE)
+			debug("ROUTE: cached split of %s into %d sublists",
+			      key, *count);
+		xfree(key);
+		return SLURM_SUCCESS;
 	}
 	slurm_mutex_unlock(&route_lock);
 	*sp_hl = (hostlist_t*) xmalloc(switch_record_cnt * sizeof(hostlist_t));
@@ -210,12 +294,14 @@ extern int route_p_split_hostlist(hostlist_t hl,
 		}
 		FREE_NULL_BITMAP(nodes_bitmap);
 		xfree(*sp_hl);
+		xfree(key);
 		return route_split_hostlist_treewidth(hl, sp_hl, count);
 	}
 	if (switch_record_table[j].level == 0) {
 		/* This is a leaf switch. Construct list based on TreeWidth */
 		FREE_NULL_BITMAP(nodes_bitmap);
 		xfree(*sp_hl);
+		xfree(key);
 		return route_split_hostlist_treewidth(hl, sp_hl, count);
 	}
 	/* loop through children, construction a hostlist for each child switch
@@ -249,6 +335,9 @@ extern int route_p_split_hostlist(hostlist_t hl,
 	FREE_NULL_BITMAP(nodes_bitmap);
 
 	*count = hl_ndx;
+	slurm_mutex_lock(&route_lock);
+	_route_cache_add(key, *sp_hl, hl_ndx);
+	slurm_mutex_unlock(&route_lock);
 	return SLURM_SUCCESS;
 
 }
@@ -261,6 +350,9 @@ extern int route_p_split_hostlist(hostlist_t hl,
 extern int route_p_reconfigure (void)
 {
 	debug_flags = slurm_get_debug_flags();
+	slurm_mutex_lock(&route_lock);
+	_route_cache_clear();
+	slurm_mutex_unlock(&route_lock);
 	return SLURM_SUCCESS;
 }
 
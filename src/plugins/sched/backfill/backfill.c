@@ -89,6 +89,7 @@
 #include "src/slurmctld/node_scheduler.h"
 #include "src/slurmctld/preempt.h"
 #include "src/slurmctld/reservation.h"
+#include "src/slurmctld/shape_cache.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/srun_comm.h"
 #include "backfill.h"
@@ -135,6 +136,7 @@ static bool backfill_continue = false;
 static int defer_rpc_cnt = 0;
 static int sched_timeout = SCHED_TIMEOUT;
 static int yield_sleep   = YIELD_SLEEP;
+static shape_cache_t *bf_shape_cache = NULL;
 
 /*********************** local functions *********************/
 static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
@@ -744,6 +746,8 @@ extern void *backfill_agent(void *args)
 		unlock_slurmctld(all_locks);
 		short_sleep = false;
 	}
+	shape_cache_destroy(bf_shape_cache);
+	bf_shape_cache = NULL;
 	return NULL;
 }
 
@@ -798,8 +802,10 @@ static int _yield_locks(int usec)
 	    (last_part_update == part_update) &&
 	    (! stop_backfill) && (! load_config))
 		return 0;
-	else
-		return 1;
+
+	/* Cached job rejections may no longer be valid */
+	shape_cache_clear(bf_shape_cache);
+	return 1;
 }
 
 /* Test if this job still has access to the specified partition. The job's
@@ -897,6 +903,11 @@ BEGINNING:
 	if (slurm_get_root_filter())
 		filter_root = true;
 
+	if (!bf_shape_cache)
+		bf_shape_cache = shape_cache_create();
+	else
+		shape_cache_clear(bf_shape_cache);
+
 	job_queue = build_job_queue(true, true);
 	job_test_count = list_count(job_queue);
 	if (job_test_count == 0) {		
@@ -1248,6 +1259,21 @@ next_task:
 		else if (job_ptr->time_min && (job_ptr->time_min < time_limit))
 			time_limit = job_ptr->time_limit = job_ptr->time_min;
 
+		if (shape_cache_test(bf_shape_cache, job_ptr, NULL)) {
+			/* Identical job can not run within backfill window */
+			slurmctld_diag_stats.bf_shape_hits++;
+			if (debug_flags & DEBUG_FLAG_BACKFILL)
+				info("backfill: job %u shape can not run",
+				     job_ptr->job_id);
+			_set_job_time_limit(job_ptr, orig_time_limit);
+			if (orig_start_time != 0)  /* Can start in other part */
+				job_ptr->start_time = orig_start_time;
+			else
+				job_ptr->start_time = 0;
+			continue;
+		}
+		slurmctld_diag_stats.bf_shape_misses++;
+
 		/* Determine impact of any resource reservations */
 		later_start = now;
  TRY_LATER:
@@ -1422,6 +1448,11 @@ next_task:
 			job_ptr->details->share_res = saved_share_res;
 		now = time(NULL);
 		if (j != SLURM_SUCCESS) {
+			/* Not runnable with reduced sharing on a retry pass
+			 * says nothing about identical jobs */
+			if (!saved_share_res)
+				shape_cache_add(bf_shape_cache, job_ptr,
+						window_end);
 			_set_job_time_limit(job_ptr, orig_time_limit);
 			if (orig_start_time != 0)  /* Can start in other part */
 				job_ptr->start_time = orig_start_time;
@@ -110,6 +110,35 @@
 /* Enables module specific debugging */
 #define _DEBUG 0
 
+/* Switch index: the nodes of every switch as an array of node indexes and
+ * the leaf switches below every switch. Derived from switch_record_table
+ * once rather than by a bitmap sweep for every job test. */
+typedef struct switch_index {
+	int *node_inx;		/* nodes attached to this switch */
+	int node_cnt;
+	int *leaf_inx;		/* leaf switches below (or equal to) this one */
+	int leaf_cnt;
+} switch_index_t;
+
+/* Candidate co-runner of a malleable job, see _find_job_mates() */
+typedef struct job_mate {
+	struct job_record *job_ptr;
+	bitstr_t *node_map;	/* usable nodes allocated to this job */
+	uint32_t node_cnt;	/* bits set in node_map */
+	uint32_t lend_cpus;	/* CPUs lent on the nodes of node_map */
+} job_mate_t;
+
+/* Maximum number of running jobs a malleable job may share nodes with, and
+ * number of candidates considered when searching for them */
+#define MAX_JOB_MATES		2
+#define MAX_MATE_CANDIDATES	32
+
+static switch_index_t *switch_index = NULL;
+static int switch_index_cnt = 0;
+static bool switch_index_built = false;
+static bool switch_index_valid = false;	/* leaf switches partition the
+					 * nodes of every switch */
+
 static uint16_t _allocate_sc(struct job_record *job_ptr, bitstr_t *core_map,
 			      bitstr_t *part_core_map, const uint32_t node_i,
 			      bool entire_sockets_only);
@@ -511,6 +540,44 @@ fini:
 }
 
 
+/* Memory Check: check pn_min_memory to see if:
+ *          - this node has enough memory (MEM_PER_CPU == 0)
+ *          - there are enough free_cores (MEM_PER_CPU == 1)
+ * RET the number of the given cpus usable with the node's memory
+ */
+static uint16_t _mem_limit_cpus(struct job_record *job_ptr,
+				const uint32_t node_i,
+				struct node_use_record *node_usage,
+				uint16_t cpus, int cpu_alloc_size,
+				bool test_only)
+{
+	uint32_t avail_mem, req_mem;
+	int i;
+
+	req_mem   = job_ptr->details->pn_min_memory & ~MEM_PER_CPU;
+	avail_mem = select_node_record[node_i].real_memory -
+		    select_node_record[node_i].mem_spec_limit;
+	if (!test_only)
+		avail_mem -= node_usage[node_i].alloc_memory;
+	if (job_ptr->details->pn_min_memory & MEM_PER_CPU) {
+		/* memory is per-cpu */
+		while ((cpus > 0) && ((req_mem * cpus) > avail_mem))
+			cpus -= cpu_alloc_size;
+		if (job_ptr->details->cpus_per_task > 1) {
+			i = cpus % job_ptr->details->cpus_per_task;
+			cpus -= i;
+		}
+		if (cpus < job_ptr->details->ntasks_per_node)
+			cpus = 0;
+		/* FIXME: Need to recheck min_cores, etc. here */
+	} else {
+		/* memory is per node */
+		if (req_mem > avail_mem)
+			cpus = 0;
+	}
+	return cpus;
+}
+
 /*
  * _can_job_run_on_node - Given the job requirements, determine which
  *                        resources from the given node (if any) can be
@@ -536,8 +603,8 @@ uint16_t _can_job_run_on_node(struct job_record *job_ptr, bitstr_t *core_map,
 			      bool test_only, bitstr_t *part_core_map)
 {
 	uint16_t cpus;
-	uint32_t avail_mem, req_mem, gres_cores, gres_cpus, cpus_per_core;
-	int core_start_bit, core_end_bit, cpu_alloc_size, i;
+	uint32_t gres_cores, gres_cpus, cpus_per_core;
+	int core_start_bit, core_end_bit, cpu_alloc_size;
 	struct node_record *node_ptr = node_record_table_ptr + node_i;
 	List gres_list;
 
@@ -586,31 +653,8 @@ uint16_t _can_job_run_on_node(struct job_record *job_ptr, bitstr_t *core_map,
 	}
 
 	if (cr_type & CR_MEMORY) {
-		/* Memory Check: check pn_min_memory to see if:
-		 *          - this node has enough memory (MEM_PER_CPU == 0)
-		 *          - there are enough free_cores (MEM_PER_CPU == 1)
-		 */
-		req_mem   = job_ptr->details->pn_min_memory & ~MEM_PER_CPU;
-		avail_mem = select_node_record[node_i].real_memory -
-			    select_node_record[node_i].mem_spec_limit;
-		if (!test_only)
-			avail_mem -= node_usage[node_i].alloc_memory;
-		if (job_ptr->details->pn_min_memory & MEM_PER_CPU) {
-			/* memory is per-cpu */
-			while ((cpus > 0) && ((req_mem * cpus) > avail_mem))
-				cpus -= cpu_alloc_size;
-			if (job_ptr->details->cpus_per_task > 1) {
-				i = cpus % job_ptr->details->cpus_per_task;
-				cpus -= i;
-			}
-			if (cpus < job_ptr->details->ntasks_per_node)
-				cpus = 0;
-			/* FIXME: Need to recheck min_cores, etc. here */
-		} else {
-			/* memory is per node */
-			if (req_mem > avail_mem)
-				cpus = 0;
-		}
+		cpus = _mem_limit_cpus(job_ptr, node_i, node_usage, cpus,
+				       cpu_alloc_size, test_only);
 	}
 
 	gres_cpus = gres_cores;
@@ -652,15 +696,27 @@ uint16_t _can_job_run_on_node(struct job_record *job_ptr, bitstr_t *core_map,
  * If (sharing_only) then only check sharing partitions. This is because
  * the job was submitted to a single-row partition which does not share
  * allocated CPUs with multi-row partitions.
+ * If (my_part_shared) then the job's own partition has multiple rows and
+ * the node's shared_cores summary can not be used.
  */
 static int _is_node_busy(struct part_res_record *p_ptr, uint32_t node_i,
 			 int sharing_only, struct part_record *my_part_ptr,
-			 bool qos_preemptor)
+			 bool qos_preemptor, struct node_use_record *node_usage,
+			 bool my_part_shared)
 {
 	uint32_t r, cpu_begin = cr_get_coremap_offset(node_i);
 	uint32_t i, cpu_end   = cr_get_coremap_offset(node_i+1);
 	uint16_t num_rows;
 
+	/* The node summary covers every row, including the extra row
+	 * reserved for QOS preemptors */
+	if (!preempt_by_qos || qos_preemptor) {
+		if (!sharing_only)
+			return (node_usage[node_i].alloc_cores != 0);
+		if (!my_part_shared)
+			return (node_usage[node_i].shared_cores != 0);
+	}
+
 	for (; p_ptr; p_ptr = p_ptr->next) {
 		num_rows = p_ptr->num_rows;
 		if (preempt_by_qos && !qos_preemptor)
@@ -710,10 +766,19 @@ static int _verify_node_state(struct part_res_record *cr_part_ptr,
 			      bitstr_t *exc_core_bitmap, bool qos_preemptor)
 {
 	struct node_record *node_ptr;
+	struct part_res_record *p_ptr;
 	uint32_t i, j, free_mem, gres_cpus, gres_cores, min_mem;
 	int core_start_bit, core_end_bit, cpus_per_core;
 	List gres_list;
 	int i_first, i_last;
+	bool my_part_shared = false;
+
+	for (p_ptr = cr_part_ptr; p_ptr; p_ptr = p_ptr->next) {
+		if (p_ptr->part_ptr == job_ptr->part_ptr) {
+			my_part_shared = (p_ptr->num_rows > 1);
+			break;
+		}
+	}
 
 	if (job_ptr->details->pn_min_memory & MEM_PER_CPU) {
 		uint16_t min_cpus;
@@ -809,7 +874,8 @@ static int _verify_node_state(struct part_res_record *cr_part_ptr,
 			/* cannot use this node if it is running jobs
 			 * in sharing partitions */
 			if (_is_node_busy(cr_part_ptr, i, 1,
-					  job_ptr->part_ptr, qos_preemptor)) {
+					  job_ptr->part_ptr, qos_preemptor,
+					  node_usage, my_part_shared)) {
 				debug3("cons_res: _vns: node %s sharing?",
 				       node_ptr->name);
 				goto clear_bit;
@@ -820,7 +886,8 @@ static int _verify_node_state(struct part_res_record *cr_part_ptr,
 			if (job_node_req == NODE_CR_RESERVED) {
 				if (_is_node_busy(cr_part_ptr, i, 0,
 						  job_ptr->part_ptr,
-						  qos_preemptor)) {
+						  qos_preemptor, node_usage,
+						  my_part_shared)) {
 					debug3("cons_res: _vns: node %s busy",
 					       node_ptr->name);
 					goto clear_bit;
@@ -830,7 +897,8 @@ static int _verify_node_state(struct part_res_record *cr_part_ptr,
 				 * in sharing partitions */
 				if (_is_node_busy(cr_part_ptr, i, 1,
 						  job_ptr->part_ptr,
-						  qos_preemptor)) {
+						  qos_preemptor, node_usage,
+						  my_part_shared)) {
 					debug3("cons_res: _vns: node %s vbusy",
 					       node_ptr->name);
 					goto clear_bit;
@@ -851,16 +919,62 @@ clear_bit:	/* This node is not usable by this job */
 }
 
 
-/* given an "avail" node_bitmap, return a corresponding "avail" core_bitmap */
-bitstr_t *_make_core_bitmap(bitstr_t *node_map, uint16_t core_spec)
+/* Set in core_map the "avail" cores of node n, less any specialized cores.
+ * core_spec must already have CORE_SPEC_THREAD filtered out.
+ * RET false if the node has no cores left for the job */
+static bool _make_node_cores(bitstr_t *core_map, uint32_t n,
+			     uint16_t core_spec)
 {
-	uint32_t n, c, nodes, size;
 	int spec_cores, res_core, res_sock, res_off;
-	int n_first, n_last;
-	uint32_t coff;
+	uint32_t c, coff;
 	uint16_t i;
 	struct node_record *node_ptr;
 
+	c    = cr_get_coremap_offset(n);
+	coff = cr_get_coremap_offset(n+1);
+	if ((core_spec != (uint16_t) NO_VAL) &&
+	    (core_spec >= (coff - c)))
+		return false;
+	bit_nset(core_map, c, coff-1);
+
+	if ((core_spec != 0) && (core_spec != (uint16_t) NO_VAL)) {
+		/* Remove specialized cores right now */
+		spec_cores = core_spec;
+		for (res_core = select_node_record[n].cores - 1;
+		     (spec_cores && (res_core >= 0)); res_core--) {
+			for (res_sock = select_node_record[n].sockets-1;
+			     (spec_cores && (res_sock >= 0));
+			     res_sock--) {
+				res_off = (res_sock*select_node_record[n].cores)
+					  + res_core;
+				bit_clear(core_map, c + res_off);
+				spec_cores--;
+			}
+		}
+		return true;
+	}
+	node_ptr = select_node_record[n].node_ptr;
+	if ((core_spec == 0) || !node_ptr->cpu_spec_list)
+		return true;
+	if (!node_ptr->node_spec_bitmap) {
+		info("CPUSpecList not registered for node %s yet",
+		     node_ptr->name);
+		return true;
+	}
+	/* remove node's specialized CPUs now */
+	for (i = 0; i < (coff - c) ; i++) {
+		if (!bit_test(node_ptr->node_spec_bitmap, i))
+			bit_clear(core_map, c + i);
+	}
+	return true;
+}
+
+/* given an "avail" node_bitmap, return a corresponding "avail" core_bitmap */
+bitstr_t *_make_core_bitmap(bitstr_t *node_map, uint16_t core_spec)
+{
+	uint32_t n, nodes, size;
+	int n_first, n_last;
+
 	nodes = bit_size(node_map);
 	size = cr_get_coremap_offset(nodes);
 	bitstr_t *core_map = bit_alloc(size);
@@ -877,45 +991,8 @@ bitstr_t *_make_core_bitmap(bitstr_t *node_map, uint16_t core_spec)
 	for (n = n_first; n <= n_last; n++) {
 		if (!bit_test(node_map, n))
 			continue;
-		c    = cr_get_coremap_offset(n);
-		coff = cr_get_coremap_offset(n+1);
-		if ((core_spec != (uint16_t) NO_VAL) &&
-		    (core_spec >= (coff - c))) {
+		if (!_make_node_cores(core_map, n, core_spec))
 			bit_clear(node_map, n);
-			continue;
-		}
-		bit_nset(core_map, c, coff-1);
-
-		if ((core_spec != 0) && (core_spec != (uint16_t) NO_VAL)) {
-			/* Remove specialized cores right now */
-			spec_cores = core_spec;
-			for (res_core = select_node_record[n].cores - 1;
-			     (spec_cores && (res_core >= 0)); res_core--) {
-				for (res_sock = select_node_record[n].sockets-1;
-				     (spec_cores && (res_sock >= 0));
-				     res_sock--) {
-					res_off =
-					  (res_sock*select_node_record[n].cores)
-					  + res_core;
-					bit_clear(core_map, c + res_off);
-					spec_cores--;
-				}
-			}
-			continue;
-		}
-		node_ptr = select_node_record[n].node_ptr;
-		if ((core_spec == 0) || !node_ptr->cpu_spec_list)
-			continue;
-		if (!node_ptr->node_spec_bitmap) {
-			info("CPUSpecList not registered for node %s yet",
-			     node_ptr->name);
-			continue;
-		}
-		/* remove node's specialized CPUs now */
-		for (i = 0; i < (coff - c) ; i++) {
-			if (!bit_test(node_ptr->node_spec_bitmap, i))
-				bit_clear(core_map, c + i);
-		}
 	}
 	return core_map;
 }
@@ -1707,6 +1784,105 @@ static int _eval_nodes_serial(struct job_record *job_ptr, bitstr_t *node_map,
 fini:	return error_code;
 }
 
+extern void cr_switch_index_fini(void)
+{
+	int i;
+
+	if (switch_index) {
+		for (i = 0; i < switch_index_cnt; i++) {
+			xfree(switch_index[i].node_inx);
+			xfree(switch_index[i].leaf_inx);
+		}
+		xfree(switch_index);
+	}
+	switch_index_cnt = 0;
+	switch_index_built = false;
+	switch_index_valid = false;
+}
+
+/* Build the switch index if needed.
+ * RET true if the leaf switches are disjoint and together make up the nodes
+ * of every higher level switch, so switch totals can be summed from leaves */
+static bool _switch_index_build(void)
+{
+	int *leaf_of_node = NULL, *leaf_stamp = NULL;
+	int i, j, l, n, first, last, sum;
+
+	if (switch_index_built)
+		return switch_index_valid;
+	switch_index_built = true;
+	switch_index_valid = false;
+	if ((switch_record_cnt <= 0) || !switch_record_table)
+		return false;
+
+	switch_index = xmalloc(sizeof(switch_index_t) * switch_record_cnt);
+	switch_index_cnt = switch_record_cnt;
+	leaf_of_node = xmalloc(sizeof(int) * node_record_count);
+	for (n = 0; n < node_record_count; n++)
+		leaf_of_node[n] = -1;
+	for (j = 0; j < switch_record_cnt; j++) {
+		switch_index[j].node_cnt = 0;
+		first = bit_ffs(switch_record_table[j].node_bitmap);
+		if (first < 0)
+			continue;
+		last = bit_fls(switch_record_table[j].node_bitmap);
+		switch_index[j].node_inx = xmalloc(sizeof(int) *
+			bit_set_count(switch_record_table[j].node_bitmap));
+		for (n = first; n <= last; n++) {
+			if (!bit_test(switch_record_table[j].node_bitmap, n))
+				continue;
+			switch_index[j].node_inx[switch_index[j].node_cnt++] =n;
+			if (switch_record_table[j].level != 0)
+				continue;
+			if (leaf_of_node[n] != -1) {
+				debug("cons_res: node %s on multiple leaf "
+				      "switches, not using switch index",
+				      node_record_table_ptr[n].name);
+				goto fini;
+			}
+			leaf_of_node[n] = j;
+		}
+	}
+
+	/* Collect the distinct leaves covering each switch's nodes */
+	leaf_stamp = xmalloc(sizeof(int) * switch_record_cnt);
+	for (j = 0; j < switch_record_cnt; j++)
+		leaf_stamp[j] = -1;
+	for (j = 0; j < switch_record_cnt; j++) {
+		switch_index[j].leaf_inx = xmalloc(sizeof(int) *
+					MAX(switch_index[j].node_cnt, 1));
+		sum = 0;
+		for (i = 0; i < switch_index[j].node_cnt; i++) {
+			l = leaf_of_node[switch_index[j].node_inx[i]];
+			if (l == -1)
+				goto fini;	/* node not on any leaf */
+			if (leaf_stamp[l] == j)
+				continue;
+			leaf_stamp[l] = j;
+			switch_index[j].leaf_inx[switch_index[j].leaf_cnt++] =l;
+			sum += switch_index[l].node_cnt;
+		}
+		/* Each leaf found has a node on this switch, so they all lie
+		 * entirely within it only if their sizes add up */
+		if (sum != switch_index[j].node_cnt)
+			goto fini;
+	}
+	switch_index_valid = true;
+
+fini:	xfree(leaf_of_node);
+	xfree(leaf_stamp);
+	return switch_index_valid;
+}
+
+/* Return the usable nodes of a switch (its nodes which are set in bitmap) */
+static bitstr_t *_switch_bitmap(int switch_inx, bitstr_t *bitmap)
+{
+	bitstr_t *switch_bitmap = bit_copy(switch_record_table[switch_inx].
+					   node_bitmap);
+	bit_and(switch_bitmap, bitmap);
+	return switch_bitmap;
+}
+
 /*
  * A network topology aware version of _eval_nodes().
  * NOTE: The logic here is almost identical to that of _job_test_topo()
@@ -1725,15 +1901,16 @@ static int _eval_nodes_topo(struct job_record *job_ptr, bitstr_t *bitmap,
 
 	bitstr_t  *avail_nodes_bitmap = NULL;	/* nodes on any switch */
 	bitstr_t  *req_nodes_bitmap   = NULL;
+	bitstr_t  *orig_bitmap = NULL;	/* usable nodes, with switch index */
 	int rem_cpus, rem_nodes;	/* remaining resources desired */
 	int min_rem_nodes;	/* remaining resources desired */
 	int avail_cpus;
 	int total_cpus = 0;	/* #CPUs allocated to job */
-	int i, j, rc = SLURM_SUCCESS;
+	int i, j, k, rc = SLURM_SUCCESS;
 	int best_fit_inx, first, last;
 	int best_fit_nodes, best_fit_cpus;
 	int best_fit_location = 0, best_fit_sufficient;
-	bool sufficient;
+	bool sufficient, use_index = false;
 	long time_waiting = 0;
 
 	if (job_ptr->req_switch) {
@@ -1766,16 +1943,47 @@ static int _eval_nodes_topo(struct job_record *job_ptr, bitstr_t *bitmap,
 	switches_cpu_cnt  = xmalloc(sizeof(int)        * switch_record_cnt);
 	switches_node_cnt = xmalloc(sizeof(int)        * switch_record_cnt);
 	switches_required = xmalloc(sizeof(int)        * switch_record_cnt);
-	avail_nodes_bitmap = bit_alloc(cr_node_cnt);
-	for (i=0; i<switch_record_cnt; i++) {
-		switches_bitmap[i] = bit_copy(switch_record_table[i].
-					      node_bitmap);
-		bit_and(switches_bitmap[i], bitmap);
-		bit_or(avail_nodes_bitmap, switches_bitmap[i]);
-		switches_node_cnt[i] = bit_set_count(switches_bitmap[i]);
-		if (req_nodes_bitmap &&
-		    bit_overlap(req_nodes_bitmap, switches_bitmap[i])) {
-			switches_required[i] = 1;
+	if (!req_nodes_bitmap &&
+	    !(select_debug_flags & DEBUG_FLAG_SELECT_TYPE))
+		use_index = _switch_index_build();
+	if (use_index) {
+		/* Count usable nodes and CPUs on each leaf, then sum the
+		 * leaves for higher level switches. Switch bitmaps are only
+		 * built for the switches finally used. */
+		orig_bitmap = bit_copy(bitmap);
+		for (j = 0; j < switch_record_cnt; j++) {
+			if (switch_record_table[j].level != 0)
+				continue;
+			for (k = 0; k < switch_index[j].node_cnt; k++) {
+				i = switch_index[j].node_inx[k];
+				if (!bit_test(bitmap, i))
+					continue;
+				switches_node_cnt[j]++;
+				switches_cpu_cnt[j] += _get_cpu_cnt(job_ptr, i,
+								    cpu_cnt);
+			}
+		}
+		for (j = 0; j < switch_record_cnt; j++) {
+			if (switch_record_table[j].level == 0)
+				continue;
+			for (k = 0; k < switch_index[j].leaf_cnt; k++) {
+				i = switch_index[j].leaf_inx[k];
+				switches_node_cnt[j] += switches_node_cnt[i];
+				switches_cpu_cnt[j]  += switches_cpu_cnt[i];
+			}
+		}
+	} else {
+		avail_nodes_bitmap = bit_alloc(cr_node_cnt);
+		for (i=0; i<switch_record_cnt; i++) {
+			switches_bitmap[i] = _switch_bitmap(i, bitmap);
+			bit_or(avail_nodes_bitmap, switches_bitmap[i]);
+			switches_node_cnt[i] =
+				bit_set_count(switches_bitmap[i]);
+			if (req_nodes_bitmap &&
+			    bit_overlap(req_nodes_bitmap,
+					switches_bitmap[i])) {
+				switches_required[i] = 1;
+			}
 		}
 	}
 	bit_nclear(bitmap, 0, cr_node_cnt - 1);
@@ -1891,7 +2099,7 @@ static int _eval_nodes_topo(struct job_record *job_ptr, bitstr_t *bitmap,
 				}
 			}
 		}
-	} else {
+	} else if (!use_index) {
 		/* No specific required nodes, calculate CPU counts */
 		for (j=0; j<switch_record_cnt; j++) {
 			first = bit_ffs(switches_bitmap[j]);
@@ -1969,14 +2177,36 @@ static int _eval_nodes_topo(struct job_record *job_ptr, bitstr_t *bitmap,
 		rc = SLURM_ERROR;
 		goto fini;
 	}
-	bit_and(avail_nodes_bitmap, switches_bitmap[best_fit_inx]);
+	if (use_index) {
+		/* Identify usable leafs from the switch index */
+		for (j=0; j<switch_record_cnt; j++) {
+			if (switch_record_table[j].level != 0)
+				switches_node_cnt[j] = 0;
+			else	/* re-enabled below if under best switch */
+				switches_node_cnt[j] = -switches_node_cnt[j];
+		}
+		for (k = 0; k < switch_index[best_fit_inx].leaf_cnt; k++) {
+			j = switch_index[best_fit_inx].leaf_inx[k];
+			switches_node_cnt[j] = -switches_node_cnt[j];
+			if (switches_node_cnt[j] == 0)
+				continue;
+			switches_bitmap[j] = _switch_bitmap(j, orig_bitmap);
+		}
+		for (j=0; j<switch_record_cnt; j++) {
+			if (switches_node_cnt[j] < 0)
+				switches_node_cnt[j] = 0;
+		}
+	} else {
+		bit_and(avail_nodes_bitmap, switches_bitmap[best_fit_inx]);
 
-	/* Identify usable leafs (within higher switch having best fit) */
-	for (j=0; j<switch_record_cnt; j++) {
-		if ((switch_record_table[j].level != 0) ||
-		    (!bit_super_set(switches_bitmap[j],
-				    switches_bitmap[best_fit_inx]))) {
-			switches_node_cnt[j] = 0;
+		/* Identify usable leafs (within higher switch having best
+		 * fit) */
+		for (j=0; j<switch_record_cnt; j++) {
+			if ((switch_record_table[j].level != 0) ||
+			    (!bit_super_set(switches_bitmap[j],
+					    switches_bitmap[best_fit_inx]))) {
+				switches_node_cnt[j] = 0;
+			}
 		}
 	}
 
@@ -2154,6 +2384,7 @@ static int _eval_nodes_topo(struct job_record *job_ptr, bitstr_t *bitmap,
 
  fini:	FREE_NULL_BITMAP(avail_nodes_bitmap);
 	FREE_NULL_BITMAP(req_nodes_bitmap);
+	FREE_NULL_BITMAP(orig_bitmap);
 	if (switches_bitmap) {
 		for (i = 0; i < switch_record_cnt; i++) {
 			FREE_NULL_BITMAP(switches_bitmap[i]);
@@ -2776,6 +3007,177 @@ static uint16_t *_select_nodes(struct job_record *job_ptr, uint32_t min_nodes,
 	return cpus;
 }
 
+/* Test if a job can be placed by _select_whole_nodes(): it allocates whole
+ * nodes without specialized cores, GRES or reserved cores to exclude */
+static bool _whole_node_test_ok(struct job_record *job_ptr, uint16_t cr_type,
+				bitstr_t *exc_core_bitmap, bool test_only)
+{
+	struct job_details *details_ptr = job_ptr->details;
+
+	if (test_only || (cr_type == CR_MEMORY) || exc_core_bitmap ||
+	    (details_ptr->whole_node != 1) ||
+	    (details_ptr->core_spec != (uint16_t) NO_VAL) ||
+	    job_ptr->gres_list)
+		return false;
+	return true;
+}
+
+/* Node geometry and the CPUs a whole-node job can use on an idle node of
+ * that geometry, see _select_whole_nodes() */
+typedef struct node_geo {
+	uint16_t boards;
+	uint16_t sockets;
+	uint16_t cores;
+	uint16_t threads;
+	uint16_t vpus;
+	uint16_t cpus;
+	uint16_t avail_cpus;
+} node_geo_t;
+
+/* Return the CPUs a whole-node job can use on idle node node_i before any
+ * memory limit. Nodes with identical geometry yield identical counts, so
+ * the core-level evaluation runs once per geometry rather than per node.
+ * IN/OUT geo, geo_cnt - geometries evaluated so far
+ * IN scratch - empty core bitmap, left empty on return */
+static uint16_t _whole_node_cpus(struct job_record *job_ptr,
+				 const uint32_t node_i, uint16_t cr_type,
+				 bitstr_t *scratch, node_geo_t **geo,
+				 int *geo_cnt)
+{
+	struct node_res_record *node_res = select_node_record + node_i;
+	bool cache = !node_res->node_ptr->cpu_spec_list;
+	uint16_t cpus;
+	int i;
+
+	for (i = 0; cache && (i < *geo_cnt); i++) {
+		if (((*geo)[i].boards  == node_res->boards)  &&
+		    ((*geo)[i].sockets == node_res->sockets) &&
+		    ((*geo)[i].cores   == node_res->cores)   &&
+		    ((*geo)[i].threads == node_res->threads) &&
+		    ((*geo)[i].vpus    == node_res->vpus)    &&
+		    ((*geo)[i].cpus    == node_res->cpus))
+			return (*geo)[i].avail_cpus;
+	}
+
+	if (!_make_node_cores(scratch, node_i, (uint16_t) NO_VAL))
+		return 0;
+	if (cr_type & CR_CORE)
+		cpus = _allocate_cores(job_ptr, scratch, NULL, node_i, false);
+	else if (cr_type & CR_SOCKET)
+		cpus = _allocate_sockets(job_ptr, scratch, NULL, node_i);
+	else
+		cpus = _allocate_cores(job_ptr, scratch, NULL, node_i, true);
+	bit_nclear(scratch, cr_get_coremap_offset(node_i),
+		   cr_get_coremap_offset(node_i + 1) - 1);
+
+	if (cache) {
+		xrealloc(*geo, sizeof(node_geo_t) * (*geo_cnt + 1));
+		(*geo)[*geo_cnt].boards  = node_res->boards;
+		(*geo)[*geo_cnt].sockets = node_res->sockets;
+		(*geo)[*geo_cnt].cores   = node_res->cores;
+		(*geo)[*geo_cnt].threads = node_res->threads;
+		(*geo)[*geo_cnt].vpus    = node_res->vpus;
+		(*geo)[*geo_cnt].cpus    = node_res->cpus;
+		(*geo)[*geo_cnt].avail_cpus = cpus;
+		(*geo_cnt)++;
+	}
+	return cpus;
+}
+
+/* Select idle whole nodes for a job accepted by _whole_node_test_ok().
+ * Works from the node summary and node bitmaps only, the caller builds the
+ * job's core bitmap from the selected nodes. This gives the same result as
+ * Step 1 of cr_job_test() for such jobs.
+ * IN/OUT node_map - bitmap of available nodes / bitmap of selected nodes
+ * RET - array with number of CPUs available per node or NULL if not runnable
+ */
+static uint16_t *_select_whole_nodes(struct job_record *job_ptr,
+				     uint32_t min_nodes, uint32_t max_nodes,
+				     uint32_t req_nodes, bitstr_t *node_map,
+				     uint32_t cr_node_cnt,
+				     struct node_use_record *node_usage,
+				     uint16_t cr_type, bool prefer_alloc_nodes)
+{
+	struct job_details *details_ptr = job_ptr->details;
+	bitstr_t *req_map = details_ptr->req_node_bitmap;
+	bitstr_t *scratch;
+	struct node_record *node_ptr;
+	struct node_res_record *node_res;
+	node_geo_t *geo = NULL;
+	uint16_t *cpu_cnt, *cpus = NULL;
+	int alloc_size, geo_cnt = 0, i, i_first, i_last, rc;
+	uint32_t n, a;
+
+	if (bit_set_count(node_map) < min_nodes)
+		return NULL;
+
+	cpu_cnt = xmalloc(cr_node_cnt * sizeof(uint16_t));
+	scratch = bit_alloc(cr_get_coremap_offset(cr_node_cnt));
+	i_first = bit_ffs(node_map);
+	if (i_first >= 0)
+		i_last = bit_fls(node_map);
+	else
+		i_last = i_first - 1;
+	for (i = i_first; i <= i_last; i++) {
+		if (!bit_test(node_map, i))
+			continue;
+		node_ptr = node_record_table_ptr + i;
+		if ((node_usage[i].alloc_cores == 0) &&
+		    ((job_ptr->bit_flags & BACKFILL_TEST) ||
+		     !IS_NODE_COMPLETING(node_ptr))) {
+			cpu_cnt[i] = _whole_node_cpus(job_ptr, i, cr_type,
+						      scratch, &geo, &geo_cnt);
+			if (cpu_cnt[i] && (cr_type & CR_MEMORY)) {
+				node_res = select_node_record + i;
+				if (cr_type & CR_CORE)
+					alloc_size = node_res->vpus;
+				else if (cr_type & CR_SOCKET)
+					alloc_size = node_res->cores *
+						     node_res->vpus;
+				else
+					alloc_size = 1;
+				cpu_cnt[i] = _mem_limit_cpus(job_ptr, i,
+							     node_usage,
+							     cpu_cnt[i],
+							     alloc_size, false);
+			}
+		}
+		if (cpu_cnt[i])
+			continue;
+		if (req_map && bit_test(req_map, i)) {
+			/* cannot clear a required node! */
+			rc = SLURM_ERROR;
+			goto fini;
+		}
+		bit_clear(node_map, i);
+	}
+	if (bit_set_count(node_map) < min_nodes) {
+		rc = SLURM_ERROR;
+		goto fini;
+	}
+
+	if (details_ptr->ntasks_per_node && details_ptr->num_tasks) {
+		i  = details_ptr->num_tasks;
+		i += (details_ptr->ntasks_per_node - 1);
+		i /= details_ptr->ntasks_per_node;
+		min_nodes = MAX(min_nodes, i);
+	}
+	rc = _choose_nodes(job_ptr, node_map, min_nodes, max_nodes, req_nodes,
+			   cr_node_cnt, cpu_cnt, cr_type, prefer_alloc_nodes);
+	if (rc == SLURM_SUCCESS) {
+		cpus = xmalloc(bit_set_count(node_map) * sizeof(uint16_t));
+		for (n = 0, a = 0; n < cr_node_cnt; n++) {
+			if (bit_test(node_map, n))
+				cpus[a++] = cpu_cnt[n];
+		}
+	}
+
+fini:	FREE_NULL_BITMAP(scratch);
+	xfree(geo);
+	xfree(cpu_cnt);
+	return cpus;
+}
+
 /* When any cores on a node are removed from being available for a job,
  * then remove the entire node from being available. */
 static void _block_whole_nodes(bitstr_t *node_bitmap,
@@ -2806,19 +3208,241 @@ static void _block_whole_nodes(bitstr_t *node_bitmap,
 	}
 }
 
-/* Marco D'Amico: */
+/* Remove from node_bitmap the nodes whose cores are all allocated, using the
+ * node summary rather than the row bitmaps. Required nodes are left for
+ * _select_nodes() to reject. */
+static void _block_busy_nodes(bitstr_t *node_bitmap,
+			      struct node_use_record *node_usage,
+			      bitstr_t *req_map)
+{
+	int i, i_first, i_last;
+	uint32_t core_cnt;
+
+	i_first = bit_ffs(node_bitmap);
+	if (i_first >= 0)
+		i_last = bit_fls(node_bitmap);
+	else
+		i_last = i_first - 1;
+
+	for (i = i_first; i <= i_last; i++) {
+		if (!bit_test(node_bitmap, i))
+			continue;
+		core_cnt = cr_get_coremap_offset(i + 1) -
+			   cr_get_coremap_offset(i);
+		if (node_usage[i].alloc_cores < core_cnt)
+			continue;
+		if (req_map && bit_test(req_map, i))
+			continue;
+		bit_clear(node_bitmap, i);
+	}
+}
+
+/* Return the number of CPUs a job needs on each allocated node */
+static uint16_t _job_node_min_cpus(struct job_record *job_ptr)
+{
+	struct job_details *details_ptr = job_ptr->details;
+	uint16_t cpus_per_task = MAX(details_ptr->cpus_per_task, 1);
+
+	if (details_ptr->ntasks_per_node)
+		return details_ptr->ntasks_per_node * cpus_per_task;
+	return MAX(details_ptr->pn_min_cpus, 1);
+}
+
+/* Remove from node_map the nodes on which neither idle CPUs nor CPUs lent by
+ * running malleable jobs cover the job's per-node CPU requirement. Required
+ * nodes are left for _select_nodes() to reject. */
+static void _filter_full_nodes(struct job_record *job_ptr, bitstr_t *node_map,
+			       struct node_use_record *node_usage)
+{
+	bitstr_t *req_map = job_ptr->details->req_node_bitmap;
+	uint16_t min_cpus = _job_node_min_cpus(job_ptr);
+	int i, i_first, i_last;
+
+	i_first = bit_ffs(node_map);
+	if (i_first >= 0)
+		i_last = bit_fls(node_map);
+	else
+		i_last = i_first - 1;
+
+	for (i = i_first; i <= i_last; i++) {
+		if (!bit_test(node_map, i))
+			continue;
+		if ((node_usage[i].free_cpus + node_usage[i].stealable_cpus) >=
+		    min_cpus)
+			continue;
+		if (req_map && bit_test(req_map, i))
+			continue;
+		bit_clear(node_map, i);
+	}
+}
+
+/* Order job mate candidates by CPUs lent (largest first), then by the number
+ * of times they have already lent CPUs (fewest first) */
+static int _cmp_job_mates(const void *a, const void *b)
+{
+	const job_mate_t *mate_a = (const job_mate_t *) a;
+	const job_mate_t *mate_b = (const job_mate_t *) b;
+
+	if (mate_a->lend_cpus != mate_b->lend_cpus)
+		return (mate_a->lend_cpus > mate_b->lend_cpus) ? -1 : 1;
+	if (mate_a->job_ptr->lent_for_malleability !=
+	    mate_b->job_ptr->lent_for_malleability) {
+		return (mate_a->job_ptr->lent_for_malleability <
+			mate_b->job_ptr->lent_for_malleability) ? -1 : 1;
+	}
+	if (mate_a->job_ptr->job_id < mate_b->job_ptr->job_id)
+		return -1;
+	return (mate_a->job_ptr->job_id > mate_b->job_ptr->job_id);
+}
 
-static void _filter_full_nodes() 
+/* Build the list of running malleable jobs which can lend CPUs on the nodes
+ * in node_map. RET number of candidates, in *mates_ptr (must be xfreed along
+ * with the node_map of each entry) */
+static int _build_mate_candidates(struct job_record *job_ptr,
+				  bitstr_t *node_map, job_mate_t **mates_ptr)
 {
+	ListIterator job_iterator;
+	struct job_record *mate_ptr;
+	struct job_resources *job_res;
+	job_mate_t *mates = NULL;
+	int i, i_first, i_last, n, mate_cnt = 0, mate_size = 0;
+
+	job_iterator = list_iterator_create(job_list);
+	while ((mate_ptr = (struct job_record *) list_next(job_iterator))) {
+		if ((mate_ptr == job_ptr) || !IS_JOB_RUNNING(mate_ptr) ||
+		    !mate_ptr->details ||
+		    (mate_ptr->details->share_res != DROM_MALLEABILITY))
+			continue;
+		job_res = mate_ptr->job_resrcs;
+		if (!job_res || !job_res->node_bitmap ||
+		    !bit_overlap(job_res->node_bitmap, node_map))
+			continue;
+
+		if (mate_cnt >= mate_size) {
+			mate_size += 16;
+			xrealloc(mates, sizeof(job_mate_t) * mate_size);
+		}
+		mates[mate_cnt].job_ptr   = mate_ptr;
+		mates[mate_cnt].node_map  = bit_copy(node_map);
+		mates[mate_cnt].node_cnt  = 0;
+		mates[mate_cnt].lend_cpus = 0;
+		bit_and(mates[mate_cnt].node_map, job_res->node_bitmap);
+
+		i_first = bit_ffs(job_res->node_bitmap);
+		i_last  = bit_fls(job_res->node_bitmap);
+		for (i = i_first, n = -1; i <= i_last; i++) {
+			if (!bit_test(job_res->node_bitmap, i))
+				continue;
+			n++;
+			if (!bit_test(node_map, i))
+				continue;
+			mates[mate_cnt].node_cnt++;
+			mates[mate_cnt].lend_cpus +=
+				cr_job_stealable_cpus(mate_ptr, n);
+		}
+		if (mates[mate_cnt].lend_cpus == 0) {
+			FREE_NULL_BITMAP(mates[mate_cnt].node_map);
+			continue;
+		}
+		mate_cnt++;
+	}
+	list_iterator_destroy(job_iterator);
 
+	*mates_ptr = mates;
+	return mate_cnt;
 }
 
-static int _find_job_mates(struct job_record *job_ptr, uint32_t min_nodes, 
-			  uint32_t max_nodes, uint32_t req_nodes,
-			  bitstr_t *bitmap)
+/*
+ * _find_job_mates - Pick the running malleable jobs with which a malleable
+ *	job will share nodes. Solutions with fewer mates are preferred, then
+ *	those which leave fewer unused nodes behind and finally those whose
+ *	mates lend the most CPUs.
+ * IN job_ptr - malleable job being scheduled
+ * IN min_nodes - minimum number of nodes required
+ * IN/OUT node_map - nodes usable by the job / nodes of the selected mates
+ * OUT mates - the selected mates, array of MAX_JOB_MATES entries
+ * OUT mate_cnt - number of entries set in mates
+ * RET SLURM_SUCCESS or EINVAL if no set of mates covers min_nodes
+ */
+static int _find_job_mates(struct job_record *job_ptr, uint32_t min_nodes,
+			   bitstr_t *node_map, struct job_record **mates,
+			   int *mate_cnt)
 {
-	int rc = EINVAL;
-	
+	bitstr_t *req_map = job_ptr->details->req_node_bitmap;
+	bitstr_t *cover_map, *best_map = NULL;
+	job_mate_t *cands = NULL;
+	int cand_cnt, i, j, j_first, j_last, best_i = -1, best_j = -1;
+	uint32_t cover_cnt, best_cnt = 0, lend, best_lend = 0;
+
+	*mate_cnt = 0;
+	cand_cnt = _build_mate_candidates(job_ptr, node_map, &cands);
+	if (cand_cnt == 0) {
+		xfree(cands);
+		return EINVAL;
+	}
+	qsort(cands, cand_cnt, sizeof(job_mate_t), _cmp_job_mates);
+
+	cand_cnt = MIN(cand_cnt, MAX_MATE_CANDIDATES);
+
+	/* Test single mates first (j == i), then pairs of mates */
+	cover_map = bit_alloc(bit_size(node_map));
+	for (j_first = 0; (j_first < MAX_JOB_MATES) && !best_map; j_first++) {
+		for (i = 0; i < cand_cnt; i++) {
+			j_last = j_first ? (cand_cnt - 1) : i;
+			for (j = i + j_first; j <= j_last; j++) {
+				bit_copybits(cover_map, cands[i].node_map);
+				lend = cands[i].lend_cpus;
+				if (j != i) {
+					bit_or(cover_map, cands[j].node_map);
+					lend += cands[j].lend_cpus;
+				}
+				if (req_map)
+					bit_or(cover_map, req_map);
+				cover_cnt = bit_set_count(cover_map);
+				if (cover_cnt < min_nodes)
+					continue;
+				if (best_map &&
+				    ((best_cnt < cover_cnt) ||
+				     ((best_cnt == cover_cnt) &&
+				      (best_lend >= lend))))
+					continue;
+				if (!best_map) {
+					best_map = bit_alloc(
+						bit_size(node_map));
+				}
+				bit_copybits(best_map, cover_map);
+				best_cnt  = cover_cnt;
+				best_lend = lend;
+				best_i = i;
+				best_j = j;
+			}
+		}
+	}
+
+	if (best_map) {
+		bit_copybits(node_map, best_map);
+		mates[(*mate_cnt)++] = cands[best_i].job_ptr;
+		if (best_j != best_i)
+			mates[(*mate_cnt)++] = cands[best_j].job_ptr;
+		if ((select_debug_flags & DEBUG_FLAG_SELECT_TYPE) &&
+		    (*mate_cnt > 1)) {
+			info("cons_res: job %u mates are jobs %u,%u "
+			     "(%u nodes, %u CPUs lent)", job_ptr->job_id,
+			     mates[0]->job_id, mates[1]->job_id, best_cnt,
+			     best_lend);
+		} else if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
+			info("cons_res: job %u mate is job %u "
+			     "(%u nodes, %u CPUs lent)", job_ptr->job_id,
+			     mates[0]->job_id, best_cnt, best_lend);
+		}
+	}
+
+	for (i = 0; i < cand_cnt; i++)
+		FREE_NULL_BITMAP(cands[i].node_map);
+	xfree(cands);
+	FREE_NULL_BITMAP(cover_map);
+	FREE_NULL_BITMAP(best_map);
+	return (*mate_cnt > 0) ? SLURM_SUCCESS : EINVAL;
 }
 
 /* cr_job_test - does most of the real work for select_p_job_test(), which
@@ -2858,7 +3482,8 @@ extern int cr_job_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 	struct job_details *details_ptr;
 	struct part_res_record *p_ptr, *jp_ptr;
 	uint16_t *cpu_count;
-	int i, first, last;
+	struct job_record *mates[MAX_JOB_MATES];
+	int i, first, last, mate_cnt = 0;
 
 	if (gang_mode == -1) {
 		if (slurm_get_preempt_mode() & PREEMPT_MODE_GANG)
@@ -2909,6 +3534,42 @@ extern int cr_job_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 		     job_ptr->job_id, bit_set_count(node_bitmap));
 	}
 
+	/* Whole-node jobs first try idle nodes without building any
+	 * core bitmaps, that being all Step 1 below would do for them */
+	if (_whole_node_test_ok(job_ptr, cr_type, exc_core_bitmap,
+				test_only)) {
+		bitstr_t *whole_map = bit_copy(node_bitmap);
+
+		cpu_count = _select_whole_nodes(job_ptr, min_nodes, max_nodes,
+						req_nodes, whole_map,
+						cr_node_cnt, node_usage,
+						cr_type, prefer_alloc_nodes);
+		if (cpu_count && job_ptr->best_switch) {
+			if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
+				info("cons_res: cr_job_test: whole node test "
+				     "pass - idle nodes found");
+			}
+			bit_copybits(node_bitmap, whole_map);
+			FREE_NULL_BITMAP(whole_map);
+			free_cores = _make_core_bitmap(node_bitmap,
+						       details_ptr->core_spec);
+			orig_map = NULL;
+			avail_cores = NULL;
+			goto alloc_job;
+		}
+		FREE_NULL_BITMAP(whole_map);
+		xfree(cpu_count);
+		if ((gang_mode == 0) && !preempt_by_qos &&
+		    (job_node_req != NODE_CR_AVAILABLE)) {
+			/* Steps 2 through 4 only help jobs sharing CPUs */
+			if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
+				info("cons_res: cr_job_test: whole node test "
+				     "fail - no idle nodes available");
+			}
+			return SLURM_ERROR;
+		}
+	}
+
 	orig_map = bit_copy(node_bitmap);
 	avail_cores = _make_core_bitmap(node_bitmap,
 					job_ptr->details->core_spec);
@@ -3050,6 +3711,8 @@ extern int cr_job_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 	}
 	if (job_ptr->details->whole_node == 1)
 		_block_whole_nodes(node_bitmap, avail_cores, free_cores);
+	else
+		_block_busy_nodes(node_bitmap, node_usage, reqmap);
 
 	cpu_count = _select_nodes(job_ptr, min_nodes, max_nodes, req_nodes,
 				  node_bitmap, cr_node_cnt, free_cores,
@@ -3291,11 +3954,54 @@ extern int cr_job_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 	 * and existing jobs in the other partitions with <= priority to
 	 * this partition */
 
-	/* Marco: at this point we have node_bitmap with the map of shared nodes */
-	_filter_full_nodes();//TODO: dopo dovrei chiamare _select_nodes??
-	if(_find_job_mates(job_ptr, min_nodes, max_nodes, req_nodes, 
-			   node_bitmap) != SLURM_SUCCESS)
-		debug("cons_res: cr_job_test: not able to find a mate for this job");
+	/* A malleable job placed in a row rather than on idle resources
+	 * must share nodes with running malleable jobs that can lend it
+	 * CPUs. Repeat the selection for the same row restricted to the
+	 * nodes of the best set of mates. If that fails, reject the row
+	 * placement so the job waits for idle resources rather than
+	 * oversubscribing CPUs nobody lends. */
+	if (details_ptr->share_res == DROM_MALLEABILITY) {
+		bitstr_t *mate_nodes, *mate_cores;
+		uint16_t *mate_cpu_count = NULL;
+
+		mate_nodes = bit_copy(orig_map);
+		_filter_full_nodes(job_ptr, mate_nodes, node_usage);
+		if (_find_job_mates(job_ptr, min_nodes, mate_nodes, mates,
+				    &mate_cnt) == SLURM_SUCCESS) {
+			mate_cores = bit_copy(avail_cores);
+			if ((i < c) && jp_ptr->row[i].row_bitmap) {
+				bit_copybits(tmpcore,
+					     jp_ptr->row[i].row_bitmap);
+				bit_not(tmpcore);
+				bit_and(mate_cores, tmpcore);
+			}
+			mate_cpu_count = _select_nodes(job_ptr, min_nodes,
+						max_nodes, req_nodes,
+						mate_nodes, cr_node_cnt,
+						mate_cores, node_usage,
+						cr_type, test_only,
+						part_core_map,
+						prefer_alloc_nodes);
+			if (mate_cpu_count) {
+				xfree(cpu_count);
+				cpu_count = mate_cpu_count;
+				bit_copybits(node_bitmap, mate_nodes);
+				bit_copybits(free_cores, mate_cores);
+			} else {
+				mate_cnt = 0;
+			}
+			FREE_NULL_BITMAP(mate_cores);
+		}
+		FREE_NULL_BITMAP(mate_nodes);
+		if (mate_cnt == 0) {
+			if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
+				info("cons_res: cr_job_test: test 4 fail - "
+				     "no mates found for malleable job %u",
+				     job_ptr->job_id);
+			}
+			xfree(cpu_count);
+		}
+	}
 
 
 alloc_job:
@@ -3449,6 +4155,12 @@ alloc_job:
 		return error_code;
 	}
 
+	/* record the running jobs lending CPUs to this one */
+	for (i = 0; (i < mate_cnt) && job_ptr->mates_list; i++) {
+		list_append(job_ptr->mates_list, &mates[i]->job_id);
+		mates[i]->lent_for_malleability++;
+	}
+
 	/* translate job_res->cpus array into format with rep count */
 	build_cnt = build_job_resources_cpu_array(job_res);
 	if (job_ptr->details->whole_node == 1) {
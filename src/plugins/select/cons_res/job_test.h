@@ -69,4 +69,8 @@ int cr_job_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 		struct node_use_record *node_usage, bitstr_t *exc_core_bitmap,
 		bool prefer_alloc_nodes, bool qos_preemptor, bool preempt_mode);
 
+/* Discard the switch index built from switch_record_table, call when the
+ * topology or node configuration changes */
+extern void cr_switch_index_fini(void);
+
 #endif /* !_CR_JOB_TEST_H */
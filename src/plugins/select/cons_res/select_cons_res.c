@@ -103,6 +103,7 @@
 
 #include "src/common/slurm_xlator.h"
 #include "src/common/slurm_selecttype_info.h"
+#include "src/common/timers.h"
 #include "select_cons_res.h"
 #include "dist_tasks.h"
 #include "job_test.h"
@@ -127,6 +128,7 @@ bitstr_t *avail_node_bitmap __attribute__((weak_import));
 bitstr_t *idle_node_bitmap __attribute__((weak_import));
 uint16_t *cr_node_num_cores __attribute__((weak_import));
 uint32_t *cr_node_cores_offset __attribute__((weak_import));
+diag_stats_t slurmctld_diag_stats __attribute__((weak_import));
 #else
 slurm_ctl_conf_t slurmctld_conf;
 struct node_record *node_record_table_ptr;
@@ -140,6 +142,7 @@ bitstr_t *avail_node_bitmap;
 bitstr_t *idle_node_bitmap;
 uint16_t *cr_node_num_cores;
 uint32_t *cr_node_cores_offset;
+diag_stats_t slurmctld_diag_stats;
 #endif
 
 /*
@@ -188,6 +191,9 @@ struct node_res_record *select_node_record = NULL;
 struct node_use_record *select_node_usage  = NULL;
 static bool select_state_initializing = true;
 static int select_node_cnt = 0;
+static uint32_t select_state_gen = 0;	/* changed on every update to
+					 * select_part_record or
+					 * select_node_usage */
 static int preempt_reorder_cnt = 1;
 static bool preempt_strict_order = false;
 
@@ -224,12 +230,7 @@ static int _will_run_test(struct job_record *job_ptr, bitstr_t *bitmap,
 			  uint32_t req_nodes, uint16_t job_node_req,
 			  List preemptee_candidates, List *preemptee_job_list,
 			  bitstr_t *exc_core_bitmap);
-
-struct sort_support {
-	int jstart;
-	struct job_resources *tmpjobs;
-};
-static int _compare_support(const void *, const void *);
+static void _wr_timeline_clear(void);
 
 static void _dump_job_res(struct job_resources *job) {
 	char str[64];
@@ -370,6 +371,10 @@ static struct node_use_record *_dup_node_usage(struct node_use_record *orig_ptr)
 	for (i = 0; i < select_node_cnt; i++) {
 		new_ptr[i].node_state   = orig_ptr[i].node_state;
 		new_ptr[i].alloc_memory = orig_ptr[i].alloc_memory;
+		new_ptr[i].alloc_cores  = orig_ptr[i].alloc_cores;
+		new_ptr[i].shared_cores = orig_ptr[i].shared_cores;
+		new_ptr[i].free_cpus    = orig_ptr[i].free_cpus;
+		new_ptr[i].stealable_cpus = orig_ptr[i].stealable_cpus;
 		if (orig_ptr[i].gres_list)
 			gres_list = orig_ptr[i].gres_list;
 		else
@@ -414,6 +419,7 @@ static void _create_part_data(void)
 	struct part_res_record *this_ptr;
 	int num_parts;
 
+	_wr_timeline_clear();
 	_destroy_part_data(select_part_record);
 	select_part_record = NULL;
 
@@ -558,219 +564,251 @@ extern void cr_sort_part_rows(struct part_res_record *p_ptr)
 }
 
 
-/*
- * _build_row_bitmaps: A job has been removed from the given partition,
- *                     so the row_bitmap(s) need to be reconstructed.
- *                     Optimize the jobs into the least number of rows,
- *                     and make the lower rows as dense as possible.
- *
- * IN/OUT: p_ptr   - the partition that has jobs to be optimized
- */
-static void _build_row_bitmaps(struct part_res_record *p_ptr,
-			       struct job_record *job_ptr)
+/* Recompute the per-node summary of allocated cores (alloc_cores,
+ * shared_cores and free_cpus) from the row bitmaps of every partition.
+ * Called for each node touched by a job being added or removed so that
+ * job tests need not scan the row bitmaps of every node. */
+extern void cr_update_node_summary(struct part_res_record *p_ptr,
+				   struct node_use_record *node_usage,
+				   uint32_t node_inx)
+{
+	struct part_res_record *part_ptr;
+	uint32_t c, r, core_begin, core_end;
+	uint16_t alloc_cores = 0, shared_cores = 0, cpus_per_core;
+	bool alloc, shared;
+
+	core_begin = cr_get_coremap_offset(node_inx);
+	core_end   = cr_get_coremap_offset(node_inx + 1);
+	for (c = core_begin; c < core_end; c++) {
+		alloc = false;
+		shared = false;
+		for (part_ptr = p_ptr; part_ptr && !shared;
+		     part_ptr = part_ptr->next) {
+			if (!part_ptr->row)
+				continue;
+			for (r = 0; r < part_ptr->num_rows; r++) {
+				if (!part_ptr->row[r].row_bitmap ||
+				    !bit_test(part_ptr->row[r].row_bitmap, c))
+					continue;
+				alloc = true;
+				if (part_ptr->num_rows > 1)
+					shared = true;
+				break;
+			}
+		}
+		if (alloc)
+			alloc_cores++;
+		if (shared)
+			shared_cores++;
+	}
+
+	node_usage[node_inx].alloc_cores  = alloc_cores;
+	node_usage[node_inx].shared_cores = shared_cores;
+	if (core_end > core_begin) {
+		cpus_per_core = select_node_record[node_inx].cpus /
+				(core_end - core_begin);
+		node_usage[node_inx].free_cpus = cpus_per_core *
+			(core_end - core_begin - alloc_cores);
+	} else
+		node_usage[node_inx].free_cpus = 0;
+}
+
+/* Return the number of CPUs which a running malleable job could lend to a
+ * co-scheduled job on the node_offset'th node of its allocation. Each task
+ * keeps at least one CPU and no more than SharingFactor of the job's CPUs
+ * on the node are lent. */
+extern uint16_t cr_job_stealable_cpus(struct job_record *job_ptr,
+				      int node_offset)
 {
-	uint32_t i, j, num_jobs, size;
-	int x;
-	struct part_row_data *this_row, *orig_row;
-	struct sort_support *ss;
+	struct job_resources *job = job_ptr->job_resrcs;
+	struct job_details *details_ptr = job_ptr->details;
+	uint32_t tasks, cpus, lend;
 
-	if (!p_ptr->row)
-		return;
+	if (!job || !details_ptr ||
+	    (details_ptr->share_res != DROM_MALLEABILITY) ||
+	    (slurmctld_conf.sharing_factor <= 0.0) ||
+	    (node_offset < 0) || (node_offset >= job->nhosts))
+		return 0;
 
-	if (p_ptr->num_rows == 1) {
-		this_row = &(p_ptr->row[0]);
-		if (this_row->num_jobs == 0) {
-			if (this_row->row_bitmap) {
-				size = bit_size(this_row->row_bitmap);
-				bit_nclear(this_row->row_bitmap, 0, size-1);
-			}
-		} else {
-			if (job_ptr) { /* just remove the job */
-				xassert(job_ptr->job_resrcs);
-				remove_job_from_cores(job_ptr->job_resrcs,
-						      &(this_row->row_bitmap),
-						      cr_node_num_cores);
-			} else { /* totally rebuild the bitmap */
-				size = bit_size(this_row->row_bitmap);
-				bit_nclear(this_row->row_bitmap, 0, size-1);
-				for (j = 0; j < this_row->num_jobs; j++) {
-					add_job_to_cores(this_row->job_list[j],
-							 &(this_row->row_bitmap),
-							 cr_node_num_cores);
-				}
-			}
-		}
+	cpus = job->cpus[node_offset];
+	if (details_ptr->ntasks_per_node)
+		tasks = details_ptr->ntasks_per_node;
+	else if (details_ptr->num_tasks && job->nhosts)
+		tasks = (details_ptr->num_tasks + job->nhosts - 1) /
+			job->nhosts;
+	else
+		tasks = 1;
+	if (cpus <= tasks)
+		return 0;
+
+	lend = (uint32_t) (cpus * slurmctld_conf.sharing_factor);
+	return (uint16_t) MIN(lend, cpus - tasks);
+}
+
+/* Add (or remove) the CPUs a malleable job can lend on each of its nodes
+ * to the per-node stealable CPU count */
+static void _update_stealable_cpus(struct node_use_record *node_usage,
+				   struct job_record *job_ptr, bool add)
+{
+	struct job_resources *job = job_ptr->job_resrcs;
+	int i, i_first, i_last, n;
+	uint16_t lend;
+
+	if (!job || !job->node_bitmap || !job_ptr->details ||
+	    (job_ptr->details->share_res != DROM_MALLEABILITY))
 		return;
-	}
 
-	/* gather data */
-	num_jobs = 0;
-	for (i = 0; i < p_ptr->num_rows; i++) {
-		if (p_ptr->row[i].num_jobs) {
-			num_jobs += p_ptr->row[i].num_jobs;
-		}
-	}
-	if (num_jobs == 0) {
-		size = bit_size(p_ptr->row[0].row_bitmap);
-		for (i = 0; i < p_ptr->num_rows; i++) {
-			if (p_ptr->row[i].row_bitmap) {
-				bit_nclear(p_ptr->row[i].row_bitmap, 0,
-					   size-1);
-			}
-		}
+	i_first = bit_ffs(job->node_bitmap);
+	if (i_first == -1)
 		return;
+	i_last = bit_fls(job->node_bitmap);
+	for (i = i_first, n = -1; i <= i_last; i++) {
+		if (!bit_test(job->node_bitmap, i))
+			continue;
+		n++;
+		if ((lend = cr_job_stealable_cpus(job_ptr, n)) == 0)
+			continue;
+		if (add)
+			node_usage[i].stealable_cpus += lend;
+		else if (node_usage[i].stealable_cpus >= lend)
+			node_usage[i].stealable_cpus -= lend;
+		else
+			node_usage[i].stealable_cpus = 0;
 	}
+}
 
-	if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
-		info("DEBUG: _build_row_bitmaps (before):");
-		_dump_part(p_ptr);
-	}
-	debug3("cons_res: build_row_bitmaps reshuffling %u jobs", num_jobs);
+/* Update the node summaries of every node in a job's allocation */
+static void _update_node_summaries(struct part_res_record *p_ptr,
+				   struct node_use_record *node_usage,
+				   bitstr_t *node_bitmap)
+{
+	int i, i_first, i_last;
 
-	/* make a copy, in case we cannot do better than this */
-	orig_row = _dup_row_data(p_ptr->row, p_ptr->num_rows);
-	if (orig_row == NULL)
+	i_first = bit_ffs(node_bitmap);
+	if (i_first == -1)
 		return;
+	i_last = bit_fls(node_bitmap);
+	for (i = i_first; i <= i_last; i++) {
+		if (bit_test(node_bitmap, i))
+			cr_update_node_summary(p_ptr, node_usage, i);
+	}
+}
 
-	/* get row_bitmap size from first row (we can safely assume that the
-	 * first row_bitmap exists because there exists at least one job. */
-	size = bit_size(p_ptr->row[0].row_bitmap);
 
-	/* create a master job list and clear out ALL row data */
-	ss = xmalloc(num_jobs * sizeof(struct sort_support));
-	x = 0;
-	for (i = 0; i < p_ptr->num_rows; i++) {
-		for (j = 0; j < p_ptr->row[i].num_jobs; j++) {
-			ss[x].tmpjobs = p_ptr->row[i].job_list[j];
-			p_ptr->row[i].job_list[j] = NULL;
-			ss[x].jstart = bit_ffs(ss[x].tmpjobs->node_bitmap);
-			ss[x].jstart = cr_get_coremap_offset(ss[x].jstart);
-			ss[x].jstart += bit_ffs(ss[x].tmpjobs->core_bitmap);
-			x++;
-		}
-		p_ptr->row[i].num_jobs = 0;
-		if (p_ptr->row[i].row_bitmap) {
-			bit_nclear(p_ptr->row[i].row_bitmap, 0, size-1);
-		}
-	}
+/*
+ * _build_row_bitmaps: A job has been removed from (or shrunk within) one row
+ *                     of the given partition, so the row_bitmap(s) need to
+ *                     be updated. The freed cores are cleared from that
+ *                     row, then jobs in higher rows which now fit into a
+ *                     lower row are moved down, keeping the lower rows as
+ *                     dense as possible. Rows which lose a job this way
+ *                     are refilled in turn. Jobs which can not move are
+ *                     not touched.
+ * IN p_ptr - partition to update
+ * IN row_inx - row which lost resources
+ * IN job - resources removed from the row, or NULL to rebuild the row's
+ *          bitmap from its remaining jobs
+ * IN record_stats - add the cost to the sdiag statistics, false when
+ *          updating a copy of the partition data for a simulation
+ */
+static void _build_row_bitmaps(struct part_res_record *p_ptr,
+			       uint32_t row_inx, struct job_resources *job,
+			       bool record_stats)
+{
+	struct part_row_data *this_row, *high_row;
+	struct job_resources *move_job;
+	uint32_t i, j, k, size, moved_cnt = 0;
+	bool *refill;
+	DEF_TIMERS;
 
-	/* VERY difficult: Optimal placement of jobs in the matrix
-	 * - how to order jobs to be added to the matrix?
-	 *   - "by size" does not guarantee optimal placement
-	 *
-	 *   - for now, try sorting jobs by first bit set
-	 *     - if job allocations stay "in blocks", then this should work OK
-	 *     - may still get scenarios where jobs should switch rows
-	 *     - fixme: JOB SHUFFLING BETWEEN ROWS NEEDS TESTING
-	 */
-	qsort(ss, num_jobs, sizeof(struct sort_support), _compare_support);
+	if (!p_ptr->row || (row_inx >= p_ptr->num_rows))
+		return;
+
+	START_TIMER;
 	if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
-		for (i = 0; i < num_jobs; i++) {
-			char cstr[64], nstr[64];
-			if (ss[i].tmpjobs->core_bitmap) {
-				bit_fmt(cstr, (sizeof(cstr)-1) ,
-					ss[i].tmpjobs->core_bitmap);
-			} else
-				sprintf(cstr, "[no core_bitmap]");
-			if (ss[i].tmpjobs->node_bitmap) {
-				bit_fmt(nstr, (sizeof(nstr)-1),
-					ss[i].tmpjobs->node_bitmap);
-			} else
-				sprintf(nstr, "[no node_bitmap]");
-			info("DEBUG:  jstart %d job nb %s cb %s",
-			     ss[i].jstart, nstr, cstr);
-		}
+		info("DEBUG: _build_row_bitmaps (before):");
+		_dump_part(p_ptr);
 	}
 
-	/* add jobs to the rows */
-	for (j = 0; j < num_jobs; j++) {
-		for (i = 0; i < p_ptr->num_rows; i++) {
-			if (_can_job_fit_in_row(ss[j].tmpjobs,
-						&(p_ptr->row[i]))) {
-				/* job fits in row, so add it */
-				_add_job_to_row(ss[j].tmpjobs,&(p_ptr->row[i]));
-				ss[j].tmpjobs = NULL;
-				break;
+	this_row = &(p_ptr->row[row_inx]);
+	if (this_row->row_bitmap) {
+		if (this_row->num_jobs == 0) {
+			size = bit_size(this_row->row_bitmap);
+			bit_nclear(this_row->row_bitmap, 0, size-1);
+		} else if (job) { /* just remove the job */
+			remove_job_from_cores(job, &(this_row->row_bitmap),
+					      cr_node_num_cores);
+		} else { /* rebuild this row's bitmap */
+			size = bit_size(this_row->row_bitmap);
+			bit_nclear(this_row->row_bitmap, 0, size-1);
+			for (j = 0; j < this_row->num_jobs; j++) {
+				add_job_to_cores(this_row->job_list[j],
+						 &(this_row->row_bitmap),
+						 cr_node_num_cores);
 			}
 		}
-		/* job should have been added, so shuffle the rows */
-		cr_sort_part_rows(p_ptr);
-	}
-
-	/* test for dangling jobs */
-	for (j = 0; j < num_jobs; j++) {
-		if (ss[j].tmpjobs)
-			break;
 	}
-	if (j < num_jobs) {
-		/* we found a dangling job, which means our packing
-		 * algorithm couldn't improve apon the existing layout.
-		 * Thus, we'll restore the original layout here */
-		debug3("cons_res: build_row_bitmap: dangling job found");
+	if (p_ptr->num_rows == 1)
+		goto fini;
 
-		if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
-			info("DEBUG: _build_row_bitmaps (post-algorithm):");
-			_dump_part(p_ptr);
+	/* Move jobs down into the rows with newly freed resources. Each move
+	 * is to a lower row, so this terminates. */
+	refill = xmalloc(sizeof(bool) * p_ptr->num_rows);
+	refill[row_inx] = true;
+	i = row_inx;
+	while (i < p_ptr->num_rows) {
+		if (!refill[i]) {
+			i++;
+			continue;
 		}
-
-		_destroy_row_data(p_ptr->row, p_ptr->num_rows);
-		p_ptr->row = orig_row;
-		orig_row = NULL;
-
-		/* still need to rebuild row_bitmaps */
-		for (i = 0; i < p_ptr->num_rows; i++) {
-			if (p_ptr->row[i].row_bitmap)
-				bit_nclear(p_ptr->row[i].row_bitmap, 0,
-					   size-1);
-			if (p_ptr->row[i].num_jobs == 0)
-				continue;
-			for (j = 0; j < p_ptr->row[i].num_jobs; j++) {
-				add_job_to_cores(p_ptr->row[i].job_list[j],
-						 &(p_ptr->row[i].row_bitmap),
-						 cr_node_num_cores);
+		refill[i] = false;
+		for (k = i + 1; k < p_ptr->num_rows; k++) {
+			high_row = &(p_ptr->row[k]);
+			for (j = 0; j < high_row->num_jobs; ) {
+				move_job = high_row->job_list[j];
+				if (!_can_job_fit_in_row(move_job,
+							 &(p_ptr->row[i]))) {
+					j++;
+					continue;
+				}
+				debug3("cons_res: build_row_bitmaps moving "
+				       "job from part %s row %u to row %u",
+				       p_ptr->part_ptr->name, k, i);
+				remove_job_from_cores(move_job,
+						      &(high_row->row_bitmap),
+						      cr_node_num_cores);
+				high_row->num_jobs--;
+				memmove(&high_row->job_list[j],
+					&high_row->job_list[j + 1],
+					sizeof(struct job_resources *) *
+					(high_row->num_jobs - j));
+				high_row->job_list[high_row->num_jobs] = NULL;
+				_add_job_to_row(move_job, &(p_ptr->row[i]));
+				refill[k] = true;
+				moved_cnt++;
 			}
 		}
+		/* restart from the lowest row needing a refill */
+		for (i = 0; (i < p_ptr->num_rows) && !refill[i]; i++)
+			;
 	}
+	xfree(refill);
+	cr_sort_part_rows(p_ptr);
 
+fini:
 	if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
 		info("DEBUG: _build_row_bitmaps (after):");
 		_dump_part(p_ptr);
 	}
-
-	if (orig_row)
-		_destroy_row_data(orig_row, p_ptr->num_rows);
-	xfree(ss);
-
-	return;
-
-	/* LEFTOVER DESIGN THOUGHTS, PRESERVED HERE */
-
-	/* 1. sort jobs by size
-	 * 2. only load core bitmaps with largest jobs that conflict
-	 * 3. sort rows by set count
-	 * 4. add remaining jobs, starting with fullest rows
-	 * 5. compute  set count: if disparity between rows got closer, then
-	 *    switch non-conflicting jobs that were added
-	 */
-
-	/*
-	 *  Step 1: remove empty rows between non-empty rows
-	 *  Step 2: try to collapse rows
-	 *  Step 3: sort rows by size
-	 *  Step 4: try to swap jobs from different rows to pack rows
-	 */
-
-	/* WORK IN PROGRESS - more optimization should go here, such as:
-	 *
-	 * - try collapsing jobs from higher rows to lower rows
-	 *
-	 * - produce a load array to identify cores with less load. Test
-	 * to see if those cores are in the lower row. If not, try to swap
-	 * those jobs with jobs in the lower row. If the job can be swapped
-	 * AND the lower row set_count increases, then SUCCESS! else swap
-	 * back. The goal is to pack the lower rows and "bubble up" clear
-	 * bits to the higher rows.
-	 */
+	END_TIMER;
+	if (!record_stats)
+		return;
+	slurmctld_diag_stats.cr_row_update_cnt++;
+	slurmctld_diag_stats.cr_row_update_time_sum += DELTA_TIMER;
+	if ((uint32_t) DELTA_TIMER >
+	    slurmctld_diag_stats.cr_row_update_time_max)
+		slurmctld_diag_stats.cr_row_update_time_max = DELTA_TIMER;
+	slurmctld_diag_stats.cr_row_jobs_moved += moved_cnt;
 }
 
 
@@ -796,6 +834,7 @@ static int _add_job_to_res(struct job_record *job_ptr, int action)
 		      __func__, job_ptr->job_id);
 		return SLURM_ERROR;
 	}
+	select_state_gen++;
 
 	debug3("cons_res: _add_job_to_res: job %u act %d ", job_ptr->job_id,
 	       action);
@@ -896,6 +935,9 @@ static int _add_job_to_res(struct job_record *job_ptr, int action)
 					job->node_req;
 			}
 		}
+		_update_stealable_cpus(select_node_usage, job_ptr, true);
+		_update_node_summaries(select_part_record, select_node_usage,
+				       job->node_bitmap);
 		if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE) {
 			info("DEBUG: _add_job_to_res (after):");
 			_dump_part(p_ptr);
@@ -939,6 +981,7 @@ static int _job_expand(struct job_record *from_job_ptr,
 		      from_job_ptr->job_id);
 		return SLURM_ERROR;
 	}
+	select_state_gen++;
 
 	from_job_resrcs_ptr = from_job_ptr->job_resrcs;
 	if ((from_job_resrcs_ptr == NULL) ||
@@ -1155,6 +1198,8 @@ static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 		      __func__, job_ptr->job_id);
 		return SLURM_ERROR;
 	}
+	if (part_record_ptr == select_part_record)
+		select_state_gen++;
 
 	debug3("cons_res: _rm_job_from_res: job %u action %d", job_ptr->job_id,
 	       action);
@@ -1210,6 +1255,7 @@ static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 	if (action != 1) {
 		/* reconstruct rows with remaining jobs */
 		struct part_res_record *p_ptr;
+		uint32_t row_inx;
 
 		if (!job_ptr->part_ptr) {
 			error("cons_res: removed job %u does not have a "
@@ -1233,6 +1279,7 @@ static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 
 		/* remove the job from the job_list */
 		n = 0;
+		row_inx = 0;
 		for (i = 0; i < p_ptr->num_rows; i++) {
 			uint32_t j;
 			for (j = 0; j < p_ptr->row[i].num_jobs; j++) {
@@ -1249,6 +1296,7 @@ static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 				p_ptr->row[i].job_list[j] = NULL;
 				p_ptr->row[i].num_jobs -= 1;
 				/* found job - we're done */
+				row_inx = i;
 				n = 1;
 				i = p_ptr->num_rows;
 				break;
@@ -1256,7 +1304,9 @@ static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 		}
 		if (n) {
 			/* job was found and removed, so refresh the bitmaps */
-			_build_row_bitmaps(p_ptr, job_ptr);
+			_build_row_bitmaps(p_ptr, row_inx, job,
+					   (part_record_ptr ==
+					    select_part_record));
 			/* Adjust the node_state of all nodes affected by
 			 * the removal of this job. If all cores are now
 			 * available, set node_state = NODE_CR_AVAILABLE
@@ -1278,6 +1328,9 @@ static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 						NODE_CR_AVAILABLE;
 				}
 			}
+			_update_stealable_cpus(node_usage, job_ptr, false);
+			_update_node_summaries(part_record_ptr, node_usage,
+					       job->node_bitmap);
 		}
 	}
 
@@ -1293,6 +1346,8 @@ static int _rm_job_from_one_node(struct job_record *job_ptr,
 	struct part_res_record *p_ptr;
 	int first_bit, last_bit;
 	int i, node_inx, n;
+	uint32_t row_inx;
+	uint16_t lend = 0;
 	List gres_list;
 
 	if (!job || !job->core_bitmap) {
@@ -1300,6 +1355,7 @@ static int _rm_job_from_one_node(struct job_record *job_ptr,
 		      __func__, job_ptr->job_id);
 		return SLURM_ERROR;
 	}
+	select_state_gen++;
 
 	debug3("cons_res: _rm_job_from_one_node: job %u node %s",
 	       job_ptr->job_id, node_ptr->name);
@@ -1342,6 +1398,7 @@ static int _rm_job_from_one_node(struct job_record *job_ptr,
 					job_ptr->job_id, node_ptr->name);
 		gres_plugin_node_state_log(gres_list, node_ptr->name);
 
+		lend = cr_job_stealable_cpus(job_ptr, n);
 		job->cpus[n] = 0;
 		job->ncpus = build_job_resources_cpu_array(job);
 		clear_job_resources_node(job, n);
@@ -1384,6 +1441,7 @@ static int _rm_job_from_one_node(struct job_record *job_ptr,
 
 	/* look for the job in the partition's job_list */
 	n = 0;
+	row_inx = 0;
 	for (i = 0; i < p_ptr->num_rows; i++) {
 		uint32_t j;
 		for (j = 0; j < p_ptr->row[i].num_jobs; j++) {
@@ -1392,6 +1450,7 @@ static int _rm_job_from_one_node(struct job_record *job_ptr,
 			debug3("cons_res: found job %u in part %s row %u",
 			       job_ptr->job_id, p_ptr->part_ptr->name, i);
 			/* found job - we're done, don't actually remove */
+			row_inx = i;
 			n = 1;
 			i = p_ptr->num_rows;
 			break;
@@ -1405,7 +1464,7 @@ static int _rm_job_from_one_node(struct job_record *job_ptr,
 
 
 	/* some node of job removed from core-bitmap, so refresh CR bitmaps */
-	_build_row_bitmaps(p_ptr, NULL);
+	_build_row_bitmaps(p_ptr, row_inx, NULL, true);
 
 	/* Adjust the node_state of the node removed from this job.
 	 * If all cores are now available, set node_state = NODE_CR_AVAILABLE */
@@ -1415,6 +1474,11 @@ static int _rm_job_from_one_node(struct job_record *job_ptr,
 		error("cons_res:_rm_job_from_one_node: node_state miscount");
 		node_usage[node_inx].node_state = NODE_CR_AVAILABLE;
 	}
+	if (node_usage[node_inx].stealable_cpus >= lend)
+		node_usage[node_inx].stealable_cpus -= lend;
+	else
+		node_usage[node_inx].stealable_cpus = 0;
+	cr_update_node_summary(part_record_ptr, node_usage, node_inx);
 
 	return SLURM_SUCCESS;
 }
@@ -1453,6 +1517,11 @@ static uint16_t _get_job_node_req(struct job_record *job_ptr)
 		/* part allows sharing, and the user has requested it */
 		return NODE_CR_AVAILABLE;
 
+	if ((max_share > 1) &&
+	    (job_ptr->details->share_res == DROM_MALLEABILITY))
+		/* part allows sharing, job can shrink to run with mates */
+		return NODE_CR_AVAILABLE;
+
 	return NODE_CR_ONE_ROW;
 }
 
@@ -1740,6 +1809,248 @@ static bool _job_cleaning(struct job_record *job_ptr)
 	return false;
 }
 
+/*
+ * Will-run timeline: the running and suspended jobs sorted by expected end
+ * time, plus snapshots of the partition and node usage data with the first
+ * 1, 2, 4, 8... of those jobs removed. It is shared by all _will_run_test()
+ * calls until the select state changes, so each call only needs a few
+ * cr_job_test() calls against existing snapshots to bracket its start time
+ * and copies the select state at most once.
+ */
+#define WR_MAX_SNAPS 32
+typedef struct {
+	bool valid;
+	uint32_t state_gen;		/* select_state_gen when built */
+	struct job_record **job_ptr;	/* jobs sorted by end time */
+	time_t *end_time;		/* end time of each job when sorted */
+	int job_cnt;
+	int snap_cnt;			/* number of snapshots built */
+	int snap_rm_cnt[WR_MAX_SNAPS];	/* jobs removed in each snapshot */
+	struct part_res_record *snap_part[WR_MAX_SNAPS];
+	struct node_use_record *snap_usage[WR_MAX_SNAPS];
+} will_run_timeline_t;
+static will_run_timeline_t wr_timeline;
+
+static void _wr_timeline_clear(void)
+{
+	int i;
+
+	for (i = 0; i < wr_timeline.snap_cnt; i++) {
+		_destroy_part_data(wr_timeline.snap_part[i]);
+		_destroy_node_data(wr_timeline.snap_usage[i], NULL);
+	}
+	xfree(wr_timeline.job_ptr);
+	xfree(wr_timeline.end_time);
+	memset(&wr_timeline, 0, sizeof(will_run_timeline_t));
+}
+
+static int _wr_job_sort(const void *x, const void *y)
+{
+	return _cr_job_list_sort((void *) x, (void *) y);
+}
+
+/* Return the shared will-run timeline, rebuilding it if the select state or
+ * the end time of any running job changed */
+static will_run_timeline_t *_wr_timeline_get(void)
+{
+	struct job_record *tmp_job_ptr;
+	ListIterator job_iterator;
+	int i;
+
+	if (wr_timeline.valid && (wr_timeline.state_gen == select_state_gen)) {
+		for (i = 0; i < wr_timeline.job_cnt; i++) {
+			if (wr_timeline.job_ptr[i]->end_time !=
+			    wr_timeline.end_time[i])
+				break;
+		}
+		if (i >= wr_timeline.job_cnt)
+			return &wr_timeline;
+	}
+
+	_wr_timeline_clear();
+	wr_timeline.job_ptr = xmalloc(sizeof(struct job_record *) *
+				      MAX(list_count(job_list), 1));
+	job_iterator = list_iterator_create(job_list);
+	while ((tmp_job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (!IS_JOB_RUNNING(tmp_job_ptr) &&
+		    !IS_JOB_SUSPENDED(tmp_job_ptr) &&
+		    !_job_cleaning(tmp_job_ptr))
+			continue;
+		if (tmp_job_ptr->end_time == 0) {
+			error("Job %u has zero end_time", tmp_job_ptr->job_id);
+			continue;
+		}
+		wr_timeline.job_ptr[wr_timeline.job_cnt++] = tmp_job_ptr;
+	}
+	list_iterator_destroy(job_iterator);
+	qsort(wr_timeline.job_ptr, wr_timeline.job_cnt,
+	      sizeof(struct job_record *), _wr_job_sort);
+	wr_timeline.end_time = xmalloc(sizeof(time_t) *
+				       MAX(wr_timeline.job_cnt, 1));
+	for (i = 0; i < wr_timeline.job_cnt; i++)
+		wr_timeline.end_time[i] = wr_timeline.job_ptr[i]->end_time;
+	wr_timeline.state_gen = select_state_gen;
+	wr_timeline.valid = true;
+
+	return &wr_timeline;
+}
+
+/* Return snapshot "inx" of the timeline, building it from the previous one
+ * if needed. RET false if no such snapshot can exist */
+static bool _wr_timeline_snap(will_run_timeline_t *tl, int inx)
+{
+	struct part_res_record *base_part;
+	struct node_use_record *base_usage;
+	int i, base_rm_cnt, rm_cnt;
+
+	while (tl->snap_cnt <= inx) {
+		if (tl->snap_cnt >= WR_MAX_SNAPS)
+			return false;
+		if (tl->snap_cnt == 0) {
+			base_part  = select_part_record;
+			base_usage = select_node_usage;
+			base_rm_cnt = 0;
+		} else {
+			base_part  = tl->snap_part[tl->snap_cnt - 1];
+			base_usage = tl->snap_usage[tl->snap_cnt - 1];
+			base_rm_cnt = tl->snap_rm_cnt[tl->snap_cnt - 1];
+		}
+		if (base_rm_cnt >= tl->job_cnt)
+			return false;	/* previous snapshot has no jobs */
+		rm_cnt = MIN(1 << tl->snap_cnt, tl->job_cnt);
+
+		tl->snap_part[tl->snap_cnt] = _dup_part_data(base_part);
+		tl->snap_usage[tl->snap_cnt] = _dup_node_usage(base_usage);
+		for (i = base_rm_cnt; i < rm_cnt; i++) {
+			_rm_job_from_res(tl->snap_part[tl->snap_cnt],
+					 tl->snap_usage[tl->snap_cnt],
+					 tl->job_ptr[i], 0);
+		}
+		tl->snap_rm_cnt[tl->snap_cnt] = rm_cnt;
+		tl->snap_cnt++;
+	}
+	return true;
+}
+
+/* Expected start time of a job able to run once job_ptr ends */
+static time_t _wr_start_time(struct job_record *job_ptr, time_t now)
+{
+	if (job_ptr->end_time <= now)
+		return _guess_job_end(job_ptr, now);
+	return job_ptr->end_time;
+}
+
+/* _will_run_timeline - _will_run_test() without preemption. Find the first
+ *	snapshot of the shared timeline in which the job can run, then walk the
+ *	jobs removed between it and the previous snapshot on a single copy of
+ *	the previous snapshot's data. */
+static int _will_run_timeline(struct job_record *job_ptr, bitstr_t *bitmap,
+			      uint32_t min_nodes, uint32_t max_nodes,
+			      uint32_t req_nodes, uint16_t job_node_req,
+			      bitstr_t *exc_core_bitmap, uint16_t tmp_cr_type,
+			      bitstr_t *orig_map, time_t now)
+{
+	will_run_timeline_t *tl = _wr_timeline_get();
+	struct part_res_record *future_part;
+	struct node_use_record *future_usage;
+	struct job_record *tmp_job_ptr, *first_job_ptr, *last_job_ptr;
+	int i, inx, rm_cnt, base_rm_cnt, overlap;
+	int time_window = 0, rc = SLURM_ERROR;
+
+	/* Find the first snapshot in which the job can run */
+	for (inx = 0; _wr_timeline_snap(tl, inx); inx++) {
+		bit_or(bitmap, orig_map);
+		rc = cr_job_test(job_ptr, bitmap, min_nodes, max_nodes,
+				 req_nodes, SELECT_MODE_WILL_RUN, tmp_cr_type,
+				 job_node_req, select_node_cnt,
+				 tl->snap_part[inx], tl->snap_usage[inx],
+				 exc_core_bitmap, backfill_busy_nodes,
+				 false, true);
+		if (rc == SLURM_SUCCESS)
+			break;
+	}
+	if (rc != SLURM_SUCCESS)
+		return rc;
+
+	rm_cnt = tl->snap_rm_cnt[inx];
+	if (inx == 0) {
+		base_rm_cnt = 0;
+	} else {
+		base_rm_cnt = tl->snap_rm_cnt[inx - 1];
+	}
+	if ((rm_cnt - base_rm_cnt) <= 1) {
+		/* Exactly one job ended before the job can start */
+		job_ptr->start_time = _wr_start_time(tl->job_ptr[rm_cnt - 1],
+						     now);
+		return SLURM_SUCCESS;
+	}
+
+	/* Remove the jobs between the two snapshots and try scheduling the
+	 * pending job after each one (or a few jobs that end close in time).
+	 * The job is known to run once all of them are gone. */
+	if (inx == 0) {
+		future_part  = _dup_part_data(select_part_record);
+		future_usage = _dup_node_usage(select_node_usage);
+	} else {
+		future_part  = _dup_part_data(tl->snap_part[inx - 1]);
+		future_usage = _dup_node_usage(tl->snap_usage[inx - 1]);
+	}
+	rc = SLURM_ERROR;
+	i = base_rm_cnt;
+	while ((i < rm_cnt) && (rc != SLURM_SUCCESS)) {
+		int rm_job_cnt = 0;
+		first_job_ptr = NULL;
+		last_job_ptr = NULL;
+		while (i < rm_cnt) {
+			tmp_job_ptr = tl->job_ptr[i++];
+			_rm_job_from_res(future_part, future_usage,
+					 tmp_job_ptr, 0);
+			bit_or(bitmap, orig_map);
+			overlap = bit_overlap(bitmap, tmp_job_ptr->node_bitmap);
+			if (overlap == 0)  /* job has no usable nodes */
+				continue;
+			if (!first_job_ptr)
+				first_job_ptr = tmp_job_ptr;
+			last_job_ptr = tmp_job_ptr;
+			if (rm_job_cnt++ > 20)
+				break;
+			if ((i < rm_cnt) &&
+			    (tl->job_ptr[i]->end_time >
+			     (first_job_ptr->end_time + time_window)))
+				break;
+		}
+		if (!last_job_ptr)
+			last_job_ptr = tl->job_ptr[i - 1];
+		time_window += 60;
+		if (i >= rm_cnt) {
+			/* Same state as the successful snapshot */
+			rc = SLURM_SUCCESS;
+			bit_or(bitmap, orig_map);
+			(void) cr_job_test(job_ptr, bitmap, min_nodes,
+					   max_nodes, req_nodes,
+					   SELECT_MODE_WILL_RUN, tmp_cr_type,
+					   job_node_req, select_node_cnt,
+					   future_part, future_usage,
+					   exc_core_bitmap,
+					   backfill_busy_nodes, false, true);
+		} else {
+			rc = cr_job_test(job_ptr, bitmap, min_nodes,
+					 max_nodes, req_nodes,
+					 SELECT_MODE_WILL_RUN, tmp_cr_type,
+					 job_node_req, select_node_cnt,
+					 future_part, future_usage,
+					 exc_core_bitmap, backfill_busy_nodes,
+					 false, true);
+		}
+		if (rc == SLURM_SUCCESS)
+			job_ptr->start_time = _wr_start_time(last_job_ptr, now);
+	}
+
+	_destroy_part_data(future_part);
+	_destroy_node_data(future_usage, NULL);
+	return rc;
+}
+
 /* _will_run_test - determine when and where a pending job can start, removes
  *	jobs from node table at termination time and run _test_job() after
  *	each job (or a few jobs that end close in time). Used by SLURM's
@@ -1785,6 +2096,17 @@ static int _will_run_test(struct job_record *job_ptr, bitstr_t *bitmap,
 		return SLURM_SUCCESS;
 	}
 
+	/* Without preemption every test sees the same sequence of job
+	 * terminations, so use the shared timeline */
+	if (!preemptee_candidates) {
+		rc = _will_run_timeline(job_ptr, bitmap, min_nodes, max_nodes,
+					req_nodes, job_node_req,
+					exc_core_bitmap, tmp_cr_type,
+					orig_map, now);
+		FREE_NULL_BITMAP(orig_map);
+		return rc;
+	}
+
 	/* Job is still pending. Simulate termination of jobs one at a time
 	 * to determine when and where the job can start. */
 	future_part = _dup_part_data(select_part_record);
@@ -1940,22 +2262,6 @@ static int _will_run_test(struct job_record *job_ptr, bitstr_t *bitmap,
 	return rc;
 }
 
-static int
-_compare_support(const void *v, const void *v1)
-{
-	struct sort_support *s;
-	struct sort_support *s1;
-
-	s = (struct sort_support *)v;
-	s1 = (struct sort_support *)v1;
-
-	if (s->jstart > s1->jstart
-		|| (s->jstart == s1->jstart
-			&& s->tmpjobs->ncpus > s1->tmpjobs->ncpus))
-		return 1;
-
-	return 0;
-}
 /*
  * init() is called when the plugin is loaded, before any other functions
  * are called.  Put global initialization here.
@@ -1979,6 +2285,8 @@ extern int init(void)
 
 extern int fini(void)
 {
+	_wr_timeline_clear();
+	cr_switch_index_fini();
 	_destroy_node_data(select_node_usage, select_node_record);
 	select_node_record = NULL;
 	select_node_usage = NULL;
@@ -2101,6 +2409,8 @@ extern int select_p_node_init(struct node_record *node_ptr, int node_cnt)
 	select_fast_schedule = slurm_get_fast_schedule();
 	cr_init_global_core_data(node_ptr, node_cnt, select_fast_schedule);
 
+	_wr_timeline_clear();
+	cr_switch_index_fini();
 	_destroy_node_data(select_node_usage, select_node_record);
 	select_node_cnt  = node_cnt;
 	select_node_record = xmalloc(node_cnt *
@@ -2139,6 +2449,7 @@ extern int select_p_node_init(struct node_record *node_ptr, int node_cnt)
 		if (tot_core >= select_node_record[i].cpus)
 			select_node_record[i].vpus = 1;
 		select_node_usage[i].node_state = NODE_CR_AVAILABLE;
+		select_node_usage[i].free_cpus  = select_node_record[i].cpus;
 		gres_plugin_node_state_dealloc_all(select_node_record[i].
 						   node_ptr->gres_list);
 	}
@@ -2711,6 +3022,7 @@ extern int select_p_update_node_config (int index)
 		node_ptr->real_memory;
 	select_node_record[index].mem_spec_limit = select_node_record[index].
 		node_ptr->mem_spec_limit;
+	select_state_gen++;
 	return SLURM_SUCCESS;
 }
 
@@ -104,9 +104,13 @@ struct node_use_record {
 	List gres_list;			/* list of gres state info managed by 
 					 * plugins */
 	uint16_t node_state;		/* see node_cr_state comments */
-	/*TODO: correct values */
-        uint16_t free_cpus;             /* not allocated cpus in the node */
-        uint16_t stealable_cpus;        /* number of cpus that can be stolen */
+	uint16_t alloc_cores;		/* cores set in any partition's row
+					 * bitmaps, see cr_update_node_summary */
+	uint16_t shared_cores;		/* cores set in row bitmaps of sharing
+					 * (multi-row) partitions */
+	uint16_t free_cpus;		/* not allocated cpus in the node */
+	uint16_t stealable_cpus;	/* cpus which running malleable jobs
+					 * can lend to a malleable job */
 };
 
 extern bool     backfill_busy_nodes;
@@ -122,6 +126,11 @@ extern struct node_res_record *select_node_record;
 extern struct node_use_record *select_node_usage;
 
 extern void cr_sort_part_rows(struct part_res_record *p_ptr);
+extern void cr_update_node_summary(struct part_res_record *p_ptr,
+				   struct node_use_record *node_usage,
+				   uint32_t node_inx);
 extern uint32_t cr_get_coremap_offset(uint32_t node_index);
+extern uint16_t cr_job_stealable_cpus(struct job_record *job_ptr,
+				      int node_offset);
 
 #endif /* !_CONS_RES_H */
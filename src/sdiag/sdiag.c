@@ -140,6 +140,30 @@ static int _print_stats(void)
 		       ((buf->req_time - buf->req_time_start) / 60)));
 	}
 	printf("\tLast queue length: %u\n", buf->schedule_queue_len);
+	printf("\tShape cache hits:   %u\n", buf->schedule_shape_hits);
+	printf("\tShape cache misses: %u\n", buf->schedule_shape_misses);
+	if ((buf->schedule_shape_hits + buf->schedule_shape_misses) > 0) {
+		printf("\tShape cache hit rate: %u%%\n",
+		       (uint32_t) ((uint64_t) buf->schedule_shape_hits * 100 /
+		       (buf->schedule_shape_hits + buf->schedule_shape_misses)));
+	}
+	if (buf->cr_row_update_cnt > 0) {
+		printf("\tRow updates:   %u\n", buf->cr_row_update_cnt);
+		printf("\tRow update time max: %u microseconds\n",
+		       buf->cr_row_update_time_max);
+		printf("\tRow update time mean: %"PRIu64" microseconds\n",
+		       buf->cr_row_update_time_sum / buf->cr_row_update_cnt);
+		printf("\tRow jobs moved: %u\n", buf->cr_row_jobs_moved);
+	}
+	if (buf->node_reg_lock_cnt > 0) {
+		printf("\tNode registrations: %u\n", buf->node_reg_cnt);
+		printf("\tNode registration locks: %u\n",
+		       buf->node_reg_lock_cnt);
+		printf("\tNode registrations per lock max: %u\n",
+		       buf->node_reg_batch_max);
+		printf("\tNode registrations per lock mean: %u\n",
+		       buf->node_reg_cnt / buf->node_reg_lock_cnt);
+	}
 
 	if (buf->bf_active) {
 		printf("\nBackfilling stats (WARNING: data obtained"
@@ -172,6 +196,13 @@ static int _print_stats(void)
 		printf("\tQueue length mean: %u\n",
 		       buf->bf_queue_len_sum / buf->bf_cycle_counter);
 	}
+	printf("\tShape cache hits:   %u\n", buf->bf_shape_hits);
+	printf("\tShape cache misses: %u\n", buf->bf_shape_misses);
+	if ((buf->bf_shape_hits + buf->bf_shape_misses) > 0) {
+		printf("\tShape cache hit rate: %u%%\n",
+		       (uint32_t) ((uint64_t) buf->bf_shape_hits * 100 /
+		       (buf->bf_shape_hits + buf->bf_shape_misses)));
+	}
 
 	printf("\nRemote Procedure Call statistics by message type\n");
 	for (i = 0; i < buf->rpc_type_size; i++) {
@@ -44,6 +44,7 @@
 
 #include "src/common/assoc_mgr.h"
 #include "src/common/slurm_accounting_storage.h"
+#include "src/common/xhash.h"
 
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/acct_policy.h"
@@ -59,6 +60,17 @@ enum {
 	ACCT_POLICY_JOB_FINI
 };
 
+/* Entry of a QOS's user_limit_hash, indexing its user_limit_list by uid */
+typedef struct {
+	char key[11];			/* uid as a string */
+	slurmdb_used_limits_t *used_limits;
+} user_limit_idx_t;
+
+/* Incremented whenever a running job count may have dropped or limits
+ * changed, protected by job write lock. A pending job held by a job count
+ * limit can not become runnable until this changes, see limit_block_gen. */
+static uint32_t release_gen = 1;
+
 static int _get_tres_state_reason(int tres_pos, int unk_reason)
 {
 	switch (tres_pos) {
@@ -333,35 +345,90 @@ static void _set_qos_order(struct job_record *job_ptr,
 	return;
 }
 
-static int _find_used_limits_for_user(void *x, void *key)
+static const char *_user_limit_idx_id(void *item)
+{
+	user_limit_idx_t *idx = (user_limit_idx_t *) item;
+	return idx->key;
+}
+
+static void _user_limit_idx_free(void *item)
 {
-	slurmdb_used_limits_t *used_limits = (slurmdb_used_limits_t *)x;
-	uint32_t user_id = *(uint32_t *)key;
+	xfree(item);
+}
 
-	if (used_limits->uid == user_id)
-		return 1;
+static void _user_limit_idx_add(xhash_t *hash,
+				slurmdb_used_limits_t *used_limits)
+{
+	user_limit_idx_t *idx = xmalloc(sizeof(user_limit_idx_t));
 
-	return 0;
+	snprintf(idx->key, sizeof(idx->key), "%u", used_limits->uid);
+	idx->used_limits = used_limits;
+	if (!xhash_add(hash, idx))
+		xfree(idx);
+}
+
+/* Return the qos usage's uid index of user_limit_list, building it if the
+ * list was filled in elsewhere (e.g. unpacked) */
+static xhash_t *_get_user_limit_hash(slurmdb_qos_usage_t *usage)
+{
+	slurmdb_used_limits_t *used_limits;
+	ListIterator itr;
+
+	if (usage->user_limit_hash &&
+	    (xhash_count(usage->user_limit_hash) ==
+	     list_count(usage->user_limit_list)))
+		return usage->user_limit_hash;
+
+	if (!usage->user_limit_hash)
+		usage->user_limit_hash = xhash_init(_user_limit_idx_id,
+						    _user_limit_idx_free,
+						    NULL, 0);
+	else
+		xhash_clear(usage->user_limit_hash);
+
+	itr = list_iterator_create(usage->user_limit_list);
+	while ((used_limits = list_next(itr)))
+		_user_limit_idx_add(usage->user_limit_hash, used_limits);
+	list_iterator_destroy(itr);
+
+	return usage->user_limit_hash;
+}
+
+/* Return the record in the qos usage's user_limit_list for user_id, or NULL
+ * if the user has no record */
+static slurmdb_used_limits_t *_find_user_used_limits(
+	slurmdb_qos_usage_t *usage, uint32_t user_id)
+{
+	user_limit_idx_t *idx;
+	char key[11];
+
+	if (!usage->user_limit_list)
+		return NULL;
+
+	snprintf(key, sizeof(key), "%u", user_id);
+	if (!(idx = xhash_get(_get_user_limit_hash(usage), key)))
+		return NULL;
+
+	return idx->used_limits;
 }
 
-/* Checks for record in *user_limit_list of user_id if
- * *user_limit_list doesn't exist it will create it, if the user_id
+/* Checks for record in usage->user_limit_list of user_id if
+ * user_limit_list doesn't exist it will create it, if the user_id
  * record doesn't exist it will add it to the list.
  * In all cases the user record is returned.
  */
 static slurmdb_used_limits_t *_get_user_used_limits(
-	List *user_limit_list, uint32_t user_id)
+	slurmdb_qos_usage_t *usage, uint32_t user_id)
 {
 	slurmdb_used_limits_t *used_limits;
 
-	xassert(user_limit_list);
+	xassert(usage);
 
-	if (!*user_limit_list)
-		*user_limit_list = list_create(slurmdb_destroy_used_limits);
+	if (!usage->user_limit_list)
+		usage->user_limit_list =
+			list_create(slurmdb_destroy_used_limits);
 
-	if (!(used_limits = list_find_first(*user_limit_list,
-					    _find_used_limits_for_user,
-					    &user_id))) {
+	if (!(used_limits = _find_user_used_limits(usage, user_id))) {
 		int i = sizeof(uint64_t) * slurmctld_tres_cnt;
 
 		used_limits = xmalloc(sizeof(slurmdb_used_limits_t));
@@ -370,12 +437,26 @@ static slurmdb_used_limits_t *_get_user_used_limits(
 		used_limits->tres = xmalloc(i);
 		used_limits->tres_run_mins = xmalloc(i);
 
-		list_append(*user_limit_list, used_limits);
+		list_append(usage->user_limit_list, used_limits);
+		_user_limit_idx_add(_get_user_limit_hash(usage), used_limits);
 	}
 
 	return used_limits;
 }
 
+/* Return true if state_reason is a limit on the count of running jobs, which
+ * can only be cleared by a job ending or a change of limits */
+static bool _job_count_reason(uint16_t state_reason)
+{
+	if ((state_reason == WAIT_QOS_GRP_JOB) ||
+	    (state_reason == WAIT_QOS_MAX_JOB_PER_USER) ||
+	    (state_reason == WAIT_ASSOC_GRP_JOB) ||
+	    (state_reason == WAIT_ASSOC_MAX_JOBS))
+		return true;
+
+	return false;
+}
+
 static bool _valid_job_assoc(struct job_record *job_ptr)
 {
 	slurmdb_assoc_rec_t assoc_rec, *assoc_ptr;
@@ -417,21 +498,7 @@ static void _qos_adjust_limit_usage(int type, struct job_record *job_ptr,
 	if (!qos_ptr)
 		return;
 
-	if (!qos_ptr->usage->user_limit_list)
-		qos_ptr->usage->user_limit_list =
-			list_create(slurmdb_destroy_used_limits);
-	if (!(used_limits = list_find_first(qos_ptr->usage->user_limit_list,
-					    _find_used_limits_for_user,
-					    &job_ptr->user_id))) {
-		used_limits = xmalloc(sizeof(slurmdb_used_limits_t));
-		used_limits->uid = job_ptr->user_id;
-
-		i = sizeof(uint64_t) * slurmctld_tres_cnt;
-		used_limits->tres = xmalloc(i);
-		used_limits->tres_run_mins = xmalloc(i);
-
-		list_append(qos_ptr->usage->user_limit_list, used_limits);
-	}
+	used_limits = _get_user_used_limits(qos_ptr->usage, job_ptr->user_id);
 
 	switch(type) {
 	case ACCT_POLICY_ADD_SUBMIT:
@@ -552,6 +619,9 @@ static void _adjust_limit_usage(int type, struct job_record *job_ptr)
 		   job_ptr->array_recs && job_ptr->array_recs->task_cnt)
 		job_cnt = job_ptr->array_recs->task_cnt;
 
+	if ((type == ACCT_POLICY_JOB_FINI) || (type == ACCT_POLICY_REM_SUBMIT))
+		acct_policy_limits_changed();
+
 	assoc_mgr_lock(&locks);
 
 	_set_qos_order(job_ptr, &qos_ptr_1, &qos_ptr_2);
@@ -1228,9 +1298,8 @@ static int _qos_policy_validate(job_desc_msg_t *job_desc,
 	if ((qos_out_ptr->max_submit_jobs_pu == INFINITE) &&
 	    (qos_ptr->max_submit_jobs_pu != INFINITE)) {
 		slurmdb_used_limits_t *used_limits =
-			_get_user_used_limits(
-				&qos_ptr->usage->user_limit_list,
-				job_desc->user_id);
+			_get_user_used_limits(qos_ptr->usage,
+					      job_desc->user_id);
 
 		qos_out_ptr->max_submit_jobs_pu = qos_ptr->max_submit_jobs_pu;
 
@@ -1303,10 +1372,8 @@ static int _qos_job_runnable_pre_select(struct job_record *job_ptr,
 	 * Try to get the used limits for the user or initialise a local
 	 * nullified one if not available.
 	 */
-	if (!qos_ptr->usage->user_limit_list ||
-	    !(used_limits = list_find_first(qos_ptr->usage->user_limit_list,
-					    _find_used_limits_for_user,
-					    &job_ptr->user_id))) {
+	if (!(used_limits = _find_user_used_limits(qos_ptr->usage,
+						   job_ptr->user_id))) {
 		used_limits = xmalloc(sizeof(slurmdb_used_limits_t));
 		used_limits->uid = job_ptr->user_id;
 		free_used_limits = true;
@@ -1492,10 +1559,8 @@ static int _qos_job_runnable_post_select(struct job_record *job_ptr,
 	 * Try to get the used limits for the user or initialize a local
 	 * nullified one if not available.
 	 */
-	if (!qos_ptr->usage->user_limit_list ||
-	    !(used_limits = list_find_first(qos_ptr->usage->user_limit_list,
-					    _find_used_limits_for_user,
-					    &job_ptr->user_id))) {
+	if (!(used_limits = _find_user_used_limits(qos_ptr->usage,
+						   job_ptr->user_id))) {
 		used_limits = xmalloc(sizeof(slurmdb_used_limits_t));
 		used_limits->uid = job_ptr->user_id;
 		free_used_limits = true;
@@ -2359,6 +2424,12 @@ extern bool acct_policy_job_runnable_pre_select(struct job_record *job_ptr)
 	if (!(accounting_enforce & ACCOUNTING_ENFORCE_LIMITS))
 		return true;
 
+	/* No job has ended and no limit changed since this job was held by
+	 * a running job count limit, so it is still held */
+	if ((job_ptr->limit_block_gen == release_gen) &&
+	    _job_count_reason(job_ptr->state_reason))
+		return false;
+
 	/* clear old state reason */
 	if (!acct_policy_job_runnable_state(job_ptr)) {
 		xfree(job_ptr->state_desc);
@@ -2537,6 +2608,11 @@ end_it:
 	assoc_mgr_unlock(&locks);
 	slurmdb_free_qos_rec_members(&qos_rec);
 
+	if (!rc && _job_count_reason(job_ptr->state_reason))
+		job_ptr->limit_block_gen = release_gen;
+	else
+		job_ptr->limit_block_gen = 0;
+
 	return rc;
 }
 
@@ -3278,3 +3354,10 @@ job_failed:
 
 	return false;
 }
+
+extern void acct_policy_limits_changed(void)
+{
+	/* 0 is never a held generation */
+	if (++release_gen == 0)
+		release_gen = 1;
+}
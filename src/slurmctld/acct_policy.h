@@ -127,4 +127,11 @@ extern int acct_policy_update_pending_job(struct job_record *job_ptr);
  */
 extern bool acct_policy_job_time_out(struct job_record *job_ptr);
 
+/*
+ * acct_policy_limits_changed - Note that association or QOS limits or usage
+ *	were changed outside of this module, so jobs held by a job count limit
+ *	must be fully re-evaluated.
+ */
+extern void acct_policy_limits_changed(void);
+
 #endif /* !_HAVE_ACCT_POLICY_H */
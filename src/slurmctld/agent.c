@@ -90,6 +90,7 @@
 #include "src/common/slurm_protocol_api.h"
 #include "src/common/slurm_protocol_interface.h"
 #include "src/common/uid.h"
+#include "src/common/xhash.h"
 #include "src/common/xsignal.h"
 #include "src/common/xassert.h"
 #include "src/common/xmalloc.h"
@@ -114,6 +115,13 @@ typedef enum {
 	DSH_DUP_JOBID	/* Request resulted in duplicate job ID error */
 } state_t;
 
+typedef enum {
+	AGENT_LOCK_NONE,	/* No slurmctld locks held */
+	AGENT_LOCK_NODE_READ,	/* Read node */
+	AGENT_LOCK_NODE_WRITE,	/* Write node */
+	AGENT_LOCK_JOB_WRITE	/* Write job, write node */
+} agent_lock_t;
+
 typedef struct thd_complete {
 	bool work_done; 	/* assume all threads complete */
 	int fail_cnt;		/* assume no threads failures */
@@ -121,6 +129,7 @@ typedef struct thd_complete {
 	int retry_cnt;		/* assume no required retries */
 	int max_delay;
 	time_t now;
+	time_t next_check;	/* time of next active thread timeout */
 } thd_complete_t;
 
 typedef struct thd {
@@ -133,6 +142,8 @@ typedef struct thd {
 	slurm_addr_t *addr;		/* specific addr to send to
 					 * will not do nodelist if set */
 	char *nodelist;			/* list of nodes to send to */
+	void *msg_args;			/* RPC data for this thread only,
+					 * NULL to use the agent's */
 	List ret_list;
 } thd_t;
 
@@ -147,6 +158,9 @@ typedef struct agent_info {
 	slurm_msg_type_t msg_type;	/* RPC to be issued */
 	void **msg_args_pptr;		/* RPC data to be used */
 	uint16_t protocol_version;	/* if set, use this version */
+	bool share_msg_buf;		/* pack RPC once for all nodes */
+	Buf msg_buf;			/* RPC packed for all nodes */
+	time_t msg_buf_time;		/* time msg_buf was packed */
 } agent_info_t;
 
 typedef struct task_info {
@@ -160,6 +174,8 @@ typedef struct task_info {
 	slurm_msg_type_t msg_type;	/* RPC to be issued */
 	void *msg_args_ptr;		/* ptr to RPC data to be used */
 	uint16_t protocol_version;	/* if set, use this version */
+	Buf *msg_buf_ptr;		/* RPC packed for all nodes or NULL */
+	time_t *msg_buf_time_ptr;	/* time msg_buf was packed */
 } task_info_t;
 
 typedef struct queued_request {
@@ -167,8 +183,17 @@ typedef struct queued_request {
 	time_t       first_attempt;	/* Time of first check for batch
 					 * launch RPC *only* */
 	time_t       last_attempt;	/* Time of last xmit attempt */
+	struct kill_batch *kill_batch;	/* Batch this request collects
+					 * job terminations for, or NULL */
 } queued_request_t;
 
+typedef struct kill_batch {
+	char *key;			/* node name, RPC type and retry */
+	time_t last_queue;		/* time a request was last queued */
+	queued_request_t *queued_req_ptr; /* queued request which later
+					 * terminations can join, or NULL */
+} kill_batch_t;
+
 typedef struct mail_info {
 	char *user_name;
 	char *message;
@@ -177,13 +202,22 @@ typedef struct mail_info {
 static void _sig_handler(int dummy);
 static int  _batch_launch_defer(queued_request_t *queued_req_ptr);
 static inline int _comm_err(char *node_name, slurm_msg_type_t msg_type);
+static void _hold_lock(agent_lock_t *held, agent_lock_t need);
+static int  _load_batch_launch(batch_job_launch_msg_t *launch_msg_ptr,
+			       agent_lock_t *lock_held);
+static void _kill_batch_dequeue(queued_request_t *queued_req_ptr);
+static bool _kill_batch_queue(queued_request_t *queued_req_ptr,
+			      bool *send_now);
 static void _list_delete_retry(void *retry_entry);
 static agent_info_t *_make_agent_info(agent_arg_t *agent_arg_ptr);
 static task_info_t *_make_task_data(agent_info_t *agent_info_ptr, int inx);
 static void _notify_slurmctld_jobs(agent_info_t *agent_ptr);
 static void _notify_slurmctld_nodes(agent_info_t *agent_ptr,
 		int no_resp_cnt, int retry_cnt);
+static Buf  _get_msg_buf(task_info_t *task_ptr, slurm_msg_t *msg);
+static void _node_did_resp_list(char *node_names);
 static void _purge_agent_args(agent_arg_t *agent_arg_ptr);
+static void _purge_msg_args(slurm_msg_type_t msg_type, void *msg_args);
 static void _queue_agent_retry(agent_info_t * agent_info_ptr, int count);
 static int _setup_requeue(agent_arg_t *agent_arg_ptr, thd_t *thread_ptr,
 			  int *count, int *spot);
@@ -201,6 +235,8 @@ static pthread_mutex_t retry_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t mail_mutex  = PTHREAD_MUTEX_INITIALIZER;
 static List retry_list = NULL;		/* agent_arg_t list for retry */
 static List mail_list = NULL;		/* pending e-mail requests */
+static xhash_t *kill_batch_hash = NULL;	/* kill_batch_t by key,
+					 * protected by retry_mutex */
 
 static pthread_mutex_t agent_cnt_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  agent_cnt_cond  = PTHREAD_COND_INITIALIZER;
@@ -353,6 +389,8 @@ void *agent(void *args)
 	_purge_agent_args(agent_arg_ptr);
 
 	if (agent_info_ptr) {
+		if (agent_info_ptr->msg_buf)
+			free_buf(agent_info_ptr->msg_buf);
 		xfree(agent_info_ptr->thread_struct);
 		xfree(agent_info_ptr);
 	}
@@ -438,15 +476,23 @@ static agent_info_t *_make_agent_info(agent_arg_t *agent_arg_ptr)
 	    (agent_arg_ptr->msg_type != SRUN_STEP_MISSING)	&&
 	    (agent_arg_ptr->msg_type != SRUN_STEP_SIGNAL)	&&
 	    (agent_arg_ptr->msg_type != SRUN_JOB_COMPLETE)) {
+		if (agent_arg_ptr->msg_args_list) {
+			/* Per-host addresses and messages (e.g. batched
+			 * SRUN_PING) can never be forwarded */
+			span = set_span(agent_arg_ptr->node_count,
+					agent_arg_ptr->node_count);
+		} else {
 #ifdef HAVE_FRONT_END
-		span = set_span(agent_arg_ptr->node_count,
-				agent_arg_ptr->node_count);
+			span = set_span(agent_arg_ptr->node_count,
+					agent_arg_ptr->node_count);
 #else
-		/* Sending message to a possibly large number of slurmd.
-		 * Push all message forwarding to slurmd in order to
-		 * offload as much work from slurmctld as possible. */
-		span = set_span(agent_arg_ptr->node_count, 1);
+			/* Sending message to a possibly large number of
+			 * slurmd. Push all message forwarding to slurmd in
+			 * order to offload as much work from slurmctld as
+			 * possible. */
+			span = set_span(agent_arg_ptr->node_count, 1);
 #endif
+		}
 		agent_info_ptr->get_reply = true;
 	} else {
 		/* Message is going to one node (for srun) or we want
@@ -454,11 +500,26 @@ static agent_info_t *_make_agent_info(agent_arg_t *agent_arg_ptr)
 		 * Send the message directly to each node. */
 		span = set_span(agent_arg_ptr->node_count,
 				agent_arg_ptr->node_count);
+#if !defined(HAVE_FRONT_END) && !defined(MULTIPLE_SLURMD)
+		/* Each slurmd is on a different host, so one credential
+		 * can be used for all of them, as done for forwarding */
+		if (!agent_arg_ptr->addr &&
+		    ((agent_arg_ptr->msg_type == REQUEST_REBOOT_NODES) ||
+		     (agent_arg_ptr->msg_type == REQUEST_RECONFIGURE)  ||
+		     (agent_arg_ptr->msg_type == REQUEST_SHUTDOWN)))
+			agent_info_ptr->share_msg_buf = true;
+#endif
 	}
 	i = 0;
 	while (i < agent_info_ptr->thread_count) {
 		thread_ptr[thr_count].state      = DSH_NEW;
-		thread_ptr[thr_count].addr = agent_arg_ptr->addr;
+		if (agent_arg_ptr->msg_args_list) {
+			/* Distinct message and address per host */
+			thread_ptr[thr_count].addr = &agent_arg_ptr->addr[i];
+			thread_ptr[thr_count].msg_args =
+				agent_arg_ptr->msg_args_list[i];
+		} else
+			thread_ptr[thr_count].addr = agent_arg_ptr->addr;
 		name = hostlist_shift(agent_arg_ptr->hostlist);
 		if (!name) {
 			debug3("no more nodes to send to");
@@ -506,8 +567,16 @@ static task_info_t *_make_task_data(agent_info_t *agent_info_ptr, int inx)
 	task_info_ptr->thread_struct_ptr = &agent_info_ptr->thread_struct[inx];
 	task_info_ptr->get_reply         = agent_info_ptr->get_reply;
 	task_info_ptr->msg_type          = agent_info_ptr->msg_type;
-	task_info_ptr->msg_args_ptr      = *agent_info_ptr->msg_args_pptr;
+	if (agent_info_ptr->thread_struct[inx].msg_args)
+		task_info_ptr->msg_args_ptr =
+			agent_info_ptr->thread_struct[inx].msg_args;
+	else
+		task_info_ptr->msg_args_ptr = *agent_info_ptr->msg_args_pptr;
 	task_info_ptr->protocol_version  = agent_info_ptr->protocol_version;
+	if (agent_info_ptr->share_msg_buf) {
+		task_info_ptr->msg_buf_ptr      = &agent_info_ptr->msg_buf;
+		task_info_ptr->msg_buf_time_ptr = &agent_info_ptr->msg_buf_time;
+	}
 
 	return task_info_ptr;
 }
@@ -527,6 +596,9 @@ static void _update_wdog_state(thd_t *thread_ptr,
 			else
 				thread_ptr->end_time += message_timeout;
 		}
+		if ((*state == DSH_ACTIVE) &&
+		    (thd_comp->next_check > thread_ptr->end_time))
+			thd_comp->next_check = thread_ptr->end_time;
 		break;
 	case DSH_NEW:
 		thd_comp->work_done = false;
@@ -550,7 +622,8 @@ static void _update_wdog_state(thd_t *thread_ptr,
  * _wdog - Watchdog thread. Send SIGUSR1 to threads which have been active
  *	for too long.
  * IN args - pointer to agent_info_t with info on threads to watch
- * Sleep between polls with exponential times (from 0.125 to 1.0 second)
+ * Wakes when an RPC thread completes or the next thread times out, checking
+ * at least once per second for newly started threads
  */
 static void *_wdog(void *args)
 {
@@ -558,10 +631,10 @@ static void *_wdog(void *args)
 	int i;
 	agent_info_t *agent_ptr = (agent_info_t *) args;
 	thd_t *thread_ptr = agent_ptr->thread_struct;
-	unsigned long usec = 5000;
 	ListIterator itr;
 	thd_complete_t thd_comp;
 	ret_data_info_t *ret_data_info = NULL;
+	struct timespec ts = {0, 0};
 
 	if ( (agent_ptr->msg_type == SRUN_JOB_COMPLETE)			||
 	     (agent_ptr->msg_type == SRUN_REQUEST_SUSPEND)		||
@@ -577,17 +650,15 @@ static void *_wdog(void *args)
 
 	thd_comp.max_delay = 0;
 
+	slurm_mutex_lock(&agent_ptr->thread_mutex);
 	while (1) {
 		thd_comp.work_done   = true;/* assume all threads complete */
 		thd_comp.fail_cnt    = 0;   /* assume no threads failures */
 		thd_comp.no_resp_cnt = 0;   /* assume all threads respond */
 		thd_comp.retry_cnt   = 0;   /* assume no required retries */
 		thd_comp.now         = time(NULL);
+		thd_comp.next_check  = thd_comp.now + 1;
 
-		usleep(usec);
-		usec = MIN((usec * 2), 1000000);
-
-		slurm_mutex_lock(&agent_ptr->thread_mutex);
 		for (i = 0; i < agent_ptr->thread_count; i++) {
 			//info("thread name %s",thread_ptr[i].node_name);
 			if (!thread_ptr[i].ret_list) {
@@ -608,7 +679,10 @@ static void *_wdog(void *args)
 		if (thd_comp.work_done)
 			break;
 
-		slurm_mutex_unlock(&agent_ptr->thread_mutex);
+		/* RPC threads broadcast thread_cond on completion */
+		ts.tv_sec = thd_comp.next_check;
+		pthread_cond_timedwait(&agent_ptr->thread_cond,
+				       &agent_ptr->thread_mutex, &ts);
 	}
 
 	if (srun_agent) {
@@ -638,20 +712,13 @@ static void _notify_slurmctld_jobs(agent_info_t *agent_ptr)
 	    { NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };
 	uint32_t job_id = 0, step_id = 0;
 	thd_t *thread_ptr = agent_ptr->thread_struct;
+	void *msg_args;
+	int i;
 
-	if        (agent_ptr->msg_type == SRUN_PING) {
-		srun_ping_msg_t *msg = *agent_ptr->msg_args_pptr;
-		job_id  = msg->job_id;
-		step_id = msg->step_id;
-	} else if (agent_ptr->msg_type == SRUN_TIMEOUT) {
-		srun_timeout_msg_t *msg = *agent_ptr->msg_args_pptr;
-		job_id  = msg->job_id;
-		step_id = msg->step_id;
-	} else if (agent_ptr->msg_type == RESPONSE_RESOURCE_ALLOCATION) {
-		resource_allocation_response_msg_t *msg =
-			*agent_ptr->msg_args_pptr;
-		job_id  = msg->job_id;
-		step_id = NO_VAL;
+	if        ((agent_ptr->msg_type == SRUN_PING)	||
+		   (agent_ptr->msg_type == SRUN_TIMEOUT)	||
+		   (agent_ptr->msg_type == RESPONSE_RESOURCE_ALLOCATION)) {
+		;		/* note srun response below */
 	} else if ((agent_ptr->msg_type == SRUN_JOB_COMPLETE)		||
 		   (agent_ptr->msg_type == SRUN_REQUEST_SUSPEND)	||
 		   (agent_ptr->msg_type == SRUN_STEP_MISSING)		||
@@ -667,7 +734,26 @@ static void _notify_slurmctld_jobs(agent_info_t *agent_ptr)
 		return;
 	}
 	lock_slurmctld(job_write_lock);
-	if  (thread_ptr[0].state == DSH_DONE) {
+	for (i = 0; i < agent_ptr->thread_count; i++) {
+		if (thread_ptr[i].state != DSH_DONE)
+			continue;
+		if (thread_ptr[i].msg_args)
+			msg_args = thread_ptr[i].msg_args;
+		else
+			msg_args = *agent_ptr->msg_args_pptr;
+		if (agent_ptr->msg_type == SRUN_PING) {
+			srun_ping_msg_t *msg = msg_args;
+			job_id  = msg->job_id;
+			step_id = msg->step_id;
+		} else if (agent_ptr->msg_type == SRUN_TIMEOUT) {
+			srun_timeout_msg_t *msg = msg_args;
+			job_id  = msg->job_id;
+			step_id = msg->step_id;
+		} else {
+			resource_allocation_response_msg_t *msg = msg_args;
+			job_id  = msg->job_id;
+			step_id = NO_VAL;
+		}
 		srun_response(job_id, step_id);
 	}
 
@@ -687,24 +773,23 @@ static void _notify_slurmctld_nodes(agent_info_t *agent_ptr,
 	thd_t *thread_ptr = agent_ptr->thread_struct;
 	int i;
 
+	/* Handle the results of all nodes under a single lock, the retry
+	 * queue also needs to read node states */
+	lock_slurmctld(node_write_lock);
+
 	/* Notify slurmctld of non-responding nodes */
-	if (no_resp_cnt) {
-		/* Update node table data for non-responding nodes */
-		lock_slurmctld(node_write_lock);
-		if (agent_ptr->msg_type == REQUEST_BATCH_JOB_LAUNCH) {
-			/* Requeue the request */
-			batch_job_launch_msg_t *launch_msg_ptr =
-					*agent_ptr->msg_args_pptr;
-			uint32_t job_id = launch_msg_ptr->job_id;
-			job_complete(job_id, 0, true, false, 0);
-		}
-		unlock_slurmctld(node_write_lock);
+	if (no_resp_cnt &&
+	    (agent_ptr->msg_type == REQUEST_BATCH_JOB_LAUNCH)) {
+		/* Requeue the request */
+		batch_job_launch_msg_t *launch_msg_ptr =
+				*agent_ptr->msg_args_pptr;
+		uint32_t job_id = launch_msg_ptr->job_id;
+		job_complete(job_id, 0, true, false, 0);
 	}
 	if (retry_cnt && agent_ptr->retry)
 		_queue_agent_retry(agent_ptr, retry_cnt);
 
 	/* Update last_response on responding nodes */
-	lock_slurmctld(node_write_lock);
 	for (i = 0; i < agent_ptr->thread_count; i++) {
 		char *down_msg, *node_names;
 		slurm_msg_type_t resp_type = RESPONSE_SLURM_RC;
@@ -755,7 +840,10 @@ static void _notify_slurmctld_nodes(agent_info_t *agent_ptr,
 				      node_names, down_msg);
 				break;
 			case DSH_DONE:
-				node_did_resp(node_names);
+				if (is_ret_list && strpbrk(node_names, "[,"))
+					_node_did_resp_list(node_names);
+				else
+					node_did_resp(node_names);
 				break;
 			default:
 				error("unknown state returned for %s",
@@ -784,6 +872,20 @@ finished:	;
 		ping_end();
 }
 
+/* Record that every node in a hostlist expression is responding, used for
+ * ret_list records merged by forward_reduce_ret_list() */
+static void _node_did_resp_list(char *node_names)
+{
+	hostlist_t hl = hostlist_create(node_names);
+	char *name;
+
+	while ((name = hostlist_shift(hl))) {
+		node_did_resp(name);
+		free(name);
+	}
+	hostlist_destroy(hl);
+}
+
 /* Report a communications error for specified node
  * This also gets logged as a non-responsive node */
 static inline int _comm_err(char *node_name, slurm_msg_type_t msg_type)
@@ -796,6 +898,55 @@ static inline int _comm_err(char *node_name, slurm_msg_type_t msg_type)
 	return rc;
 }
 
+/* Make sure that at least the "need" slurmctld locks are held, replacing
+ * the currently held ones if they are weaker. Locks are released by passing
+ * AGENT_LOCK_NONE. Used to process all responses of a thread's ret_list
+ * with a single lock. */
+static void _hold_lock(agent_lock_t *held, agent_lock_t need)
+{
+	slurmctld_lock_t agent_locks[] = {
+		{ NO_LOCK, NO_LOCK, NO_LOCK, NO_LOCK },
+		{ NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK },
+		{ NO_LOCK, NO_LOCK, WRITE_LOCK, NO_LOCK },
+		{ NO_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK } };
+
+	if ((need != AGENT_LOCK_NONE) && (*held >= need))
+		return;
+	if (*held != AGENT_LOCK_NONE)
+		unlock_slurmctld(agent_locks[*held]);
+	if (need != AGENT_LOCK_NONE)
+		lock_slurmctld(agent_locks[need]);
+	*held = need;
+}
+
+/* Read the script and environment of a batch job launch message which
+ * launch_job() built without them. If they can not be read, abort the job
+ * as build_launch_job_msg() would have done. */
+static int _load_batch_launch(batch_job_launch_msg_t *launch_msg_ptr,
+			      agent_lock_t *lock_held)
+{
+	uint32_t job_id = launch_msg_ptr->job_id;
+	int rc;
+
+	if (launch_msg_ptr->script)
+		return SLURM_SUCCESS;
+	if ((rc = load_job_launch_data(launch_msg_ptr)) == SLURM_SUCCESS)
+		return rc;
+
+	_hold_lock(lock_held, AGENT_LOCK_JOB_WRITE);
+	if (rc == ESLURM_JOB_SCRIPT_MISSING) {
+		error("Can not find batch script, Aborting batch job %u",
+		      job_id);
+		(void) job_complete(job_id, getuid(), true, false, 0);
+	} else {
+		error("%s: environment missing or corrupted aborting job %u",
+		      __func__, job_id);
+		(void) job_complete(job_id, getuid(), false, true, 0);
+	}
+	_hold_lock(lock_held, AGENT_LOCK_NONE);
+	return rc;
+}
+
 /* return a value for which WEXITSTATUS() returns 1 */
 static int _wif_status(void)
 {
@@ -816,6 +967,32 @@ static int _wif_status(void)
 	return rc;
 }
 
+/*
+ * _get_msg_buf - Get the agent's RPC packed for all of its nodes. The first
+ *	thread packs it and later threads reuse it while its credential is
+ *	fresh. A buffer is never replaced, other threads may be sending it.
+ * IN task_ptr - thread's task data
+ * IN msg - RPC to pack
+ * RET packed RPC or NULL if it must be packed by the caller
+ */
+static Buf _get_msg_buf(task_info_t *task_ptr, slurm_msg_t *msg)
+{
+	Buf msg_buf = NULL;
+	time_t now = time(NULL);
+
+	slurm_mutex_lock(task_ptr->thread_mutex_ptr);
+	if (*task_ptr->msg_buf_ptr == NULL) {
+		*task_ptr->msg_buf_ptr = slurm_pack_only_node_msg(msg);
+		*task_ptr->msg_buf_time_ptr = now;
+	}
+	if (*task_ptr->msg_buf_ptr &&
+	    (difftime(now, *task_ptr->msg_buf_time_ptr) < 60))
+		msg_buf = *task_ptr->msg_buf_ptr;
+	slurm_mutex_unlock(task_ptr->thread_mutex_ptr);
+
+	return msg_buf;
+}
+
 /*
  * _thread_per_group_rpc - thread to issue an RPC for a group of nodes
  *                         sending message out to one and forwarding it to
@@ -843,15 +1020,11 @@ static void *_thread_per_group_rpc(void *args)
 	ListIterator itr;
 	ret_data_info_t *ret_data_info = NULL;
 	int sig_array[2] = {SIGUSR1, 0};
-	/* Locks: Write job, write node */
-	slurmctld_lock_t job_write_lock = {
-		NO_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK };
+	agent_lock_t lock_held = AGENT_LOCK_NONE;
+	Buf msg_buf = NULL;
 	/* Lock: Read node */
 	slurmctld_lock_t node_read_lock = {
 		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK };
-	/* Lock: Write node */
-	slurmctld_lock_t node_write_lock = {
-		NO_LOCK, NO_LOCK, WRITE_LOCK, NO_LOCK };
 
 	xassert(args != NULL);
 	xsignal(SIGUSR1, _sig_handler);
@@ -884,9 +1057,19 @@ static void *_thread_per_group_rpc(void *args)
 
 	msg.msg_type = msg_type;
 	msg.data     = task_ptr->msg_args_ptr;
+	/* Nodes passing a health check only need to be marked as responding,
+	 * so the slurmd replying to us can merge their return codes */
+	if (msg_type == REQUEST_HEALTH_CHECK)
+		msg.flags |= SLURM_REDUCE_RET_LIST;
 #if 0
  	info("sending message type %u to %s", msg_type, thread_ptr->nodelist);
 #endif
+	if ((msg_type == REQUEST_BATCH_JOB_LAUNCH) &&
+	    (_load_batch_launch(task_ptr->msg_args_ptr, &lock_held) !=
+	     SLURM_SUCCESS)) {
+		thread_state = DSH_DONE;	/* Job already aborted */
+		goto cleanup;
+	}
 	if (task_ptr->get_reply) {
 		if (thread_ptr->addr) {
 			msg.address = *thread_ptr->addr;
@@ -924,7 +1107,13 @@ static void *_thread_per_group_rpc(void *args)
 			}
 		}
 		//info("sending %u to %s", msg_type, thread_ptr->nodelist);
-		if (slurm_send_only_node_msg(&msg) == SLURM_SUCCESS) {
+		if (task_ptr->msg_buf_ptr)
+			msg_buf = _get_msg_buf(task_ptr, &msg);
+		if (msg_buf)
+			rc = slurm_send_only_node_buf(&msg.address, msg_buf);
+		else
+			rc = slurm_send_only_node_msg(&msg);
+		if (rc == SLURM_SUCCESS) {
 			thread_state = DSH_DONE;
 		} else {
 			if (!srun_agent) {
@@ -946,12 +1135,11 @@ static void *_thread_per_group_rpc(void *args)
 			ping_slurmd_resp_msg_t *ping_resp;
 			ping_resp = (ping_slurmd_resp_msg_t *)
 				    ret_data_info->data;
-			lock_slurmctld(node_write_lock);
+			_hold_lock(&lock_held, AGENT_LOCK_NODE_WRITE);
 			reset_node_load(ret_data_info->node_name,
 					ping_resp->cpu_load);
 			reset_node_free_mem(ret_data_info->node_name,
 					    ping_resp->free_mem);
-			unlock_slurmctld(node_write_lock);
 		}
 		/* SPECIAL CASE: Mark node as IDLE if job already complete */
 		if (is_kill_msg &&
@@ -960,21 +1148,19 @@ static void *_thread_per_group_rpc(void *args)
 			kill_job = (kill_job_msg_t *)
 				task_ptr->msg_args_ptr;
 			rc = SLURM_SUCCESS;
-			lock_slurmctld(job_write_lock);
+			_hold_lock(&lock_held, AGENT_LOCK_JOB_WRITE);
 			if (job_epilog_complete(kill_job->job_id,
 						ret_data_info->
 						node_name,
 						rc))
 				run_scheduler = true;
-			unlock_slurmctld(job_write_lock);
 		}
 
 		/* SPECIAL CASE: Record node's CPU load */
 		if (ret_data_info->type == RESPONSE_ACCT_GATHER_UPDATE) {
-			lock_slurmctld(node_write_lock);
+			_hold_lock(&lock_held, AGENT_LOCK_NODE_WRITE);
 			update_node_record_acct_gather_data(
 				ret_data_info->data);
-			unlock_slurmctld(node_write_lock);
 		}
 
 		/* SPECIAL CASE: Requeue/hold non-startable batch job,
@@ -990,10 +1176,9 @@ static void *_thread_per_group_rpc(void *args)
 			     job_id, slurm_strerror(rc));
 			thread_state = DSH_DONE;
 			ret_data_info->err = thread_state;
-			lock_slurmctld(job_write_lock);
+			_hold_lock(&lock_held, AGENT_LOCK_JOB_WRITE);
 			job_complete(job_id, getuid(), false, false,
 				     _wif_status());
-			unlock_slurmctld(job_write_lock);
 			continue;
 		}
 
@@ -1044,10 +1229,9 @@ static void *_thread_per_group_rpc(void *args)
 					errno = ret_data_info->err;
 				else
 					errno = rc;
-				lock_slurmctld(node_read_lock);
+				_hold_lock(&lock_held, AGENT_LOCK_NODE_READ);
 				rc = _comm_err(ret_data_info->node_name,
 					       msg_type);
-				unlock_slurmctld(node_read_lock);
 			}
 
 			if (srun_agent)
@@ -1066,6 +1250,7 @@ static void *_thread_per_group_rpc(void *args)
 		ret_data_info->err = thread_state;
 	}
 	list_iterator_destroy(itr);
+	_hold_lock(&lock_held, AGENT_LOCK_NONE);
 
 cleanup:
 	xfree(args);
@@ -1077,9 +1262,10 @@ cleanup:
 	thread_ptr->state = thread_state;
 	thread_ptr->end_time = (time_t) difftime(time(NULL),
 						 thread_ptr->start_time);
-	/* Signal completion so another thread can replace us */
+	/* Signal completion so another thread can replace us and the
+	 * watchdog can notice */
 	(*threads_active_ptr)--;
-	pthread_cond_signal(thread_cond_ptr);
+	pthread_cond_broadcast(thread_cond_ptr);
 	slurm_mutex_unlock(thread_mutex_ptr);
 	return (void *) NULL;
 }
@@ -1355,6 +1541,8 @@ extern int agent_retry (int min_wait, bool mail_too)
 		}
 		list_iterator_destroy(retry_iter);
 	}
+	if (queued_req_ptr)
+		_kill_batch_dequeue(queued_req_ptr);
 	slurm_mutex_unlock(&retry_mutex);
 
 	if (queued_req_ptr) {
@@ -1402,6 +1590,7 @@ extern int agent_retry (int min_wait, bool mail_too)
 void agent_queue_request(agent_arg_t *agent_arg_ptr)
 {
 	queued_request_t *queued_req_ptr = NULL;
+	bool send_now = true;
 
 	if ((AGENT_THREAD_COUNT + 2) >= MAX_SERVER_THREADS)
 		fatal("AGENT_THREAD_COUNT value is too low relative to MAX_SERVER_THREADS");
@@ -1439,12 +1628,122 @@ void agent_queue_request(agent_arg_t *agent_arg_ptr)
 		if (retry_list == NULL)
 			fatal("list_create failed");
 	}
-	list_append(retry_list, (void *)queued_req_ptr);
+	if (!_kill_batch_queue(queued_req_ptr, &send_now))
+		list_append(retry_list, (void *)queued_req_ptr);
 	slurm_mutex_unlock(&retry_mutex);
 
 	/* now process the request in a separate pthread
 	 * (if we can create another pthread to do so) */
-	agent_retry(999, false);
+	if (send_now)
+		agent_retry(999, false);
+}
+
+static const char *_kill_batch_id(void *item)
+{
+	kill_batch_t *kill_batch = (kill_batch_t *) item;
+	return kill_batch->key;
+}
+
+static void _kill_batch_free(void *item)
+{
+	kill_batch_t *kill_batch = (kill_batch_t *) item;
+
+	if (kill_batch) {
+		xfree(kill_batch->key);
+		xfree(kill_batch);
+	}
+}
+
+/* Note that a request left retry_list or is full, so that later job
+ * terminations for its node are not added to it.
+ * Caller must hold retry_mutex. */
+static void _kill_batch_dequeue(queued_request_t *queued_req_ptr)
+{
+	kill_batch_t *kill_batch = queued_req_ptr->kill_batch;
+
+	if (kill_batch && (kill_batch->queued_req_ptr == queued_req_ptr))
+		kill_batch->queued_req_ptr = NULL;
+	queued_req_ptr->kill_batch = NULL;
+}
+
+/*
+ * _kill_batch_queue - Queue a request to terminate a job on a single node,
+ *	adding the job to a request for the same node still in retry_list if
+ *	there is one, so that one REQUEST_TERMINATE_JOBS RPC is sent
+ * IN queued_req_ptr - request to queue, freed if added to another one
+ * OUT send_now - set false if the request need not be started at once:
+ *	it was added to another one or, being the second request for this
+ *	node within one second, it waits for the next agent_retry() call to
+ *	collect more jobs
+ * RET false if the request can not be batched and was not queued, as when
+ *	the node's slurmd predates REQUEST_TERMINATE_JOBS
+ * Caller must hold retry_mutex.
+ */
+static bool _kill_batch_queue(queued_request_t *queued_req_ptr,
+			      bool *send_now)
+{
+	agent_arg_t *agent_arg_ptr = queued_req_ptr->agent_arg_ptr;
+	agent_arg_t *batch_arg_ptr;
+	kill_batch_t *kill_batch;
+	kill_jobs_msg_t *kill_jobs;
+	time_t now = time(NULL);
+	char *host, *key = NULL;
+
+	if (((agent_arg_ptr->msg_type != REQUEST_TERMINATE_JOB)  &&
+	     (agent_arg_ptr->msg_type != REQUEST_KILL_PREEMPTED) &&
+	     (agent_arg_ptr->msg_type != REQUEST_KILL_TIMELIMIT)) ||
+	    (agent_arg_ptr->node_count != 1) || agent_arg_ptr->addr ||
+	    (agent_arg_ptr->protocol_version < SLURM_16_05_PROTOCOL_VERSION))
+		return false;
+
+	host = hostlist_nth(agent_arg_ptr->hostlist, 0);
+	xstrfmtcat(key, "%s:%u:%u", host, agent_arg_ptr->msg_type,
+		   agent_arg_ptr->retry);
+	free(host);
+	if (!kill_batch_hash) {
+		kill_batch_hash = xhash_init(_kill_batch_id, _kill_batch_free,
+					     NULL, 0);
+	}
+	if ((kill_batch = xhash_get(kill_batch_hash, key))) {
+		xfree(key);
+	} else {
+		kill_batch = xmalloc(sizeof(kill_batch_t));
+		kill_batch->key = key;
+		xhash_add(kill_batch_hash, kill_batch);
+	}
+
+	if (kill_batch->queued_req_ptr) {
+		batch_arg_ptr = kill_batch->queued_req_ptr->agent_arg_ptr;
+		if (batch_arg_ptr->msg_type == REQUEST_TERMINATE_JOBS) {
+			kill_jobs = batch_arg_ptr->msg_args;
+		} else {
+			kill_jobs = xmalloc(sizeof(kill_jobs_msg_t));
+			kill_jobs->msg_type = batch_arg_ptr->msg_type;
+			kill_jobs->kill_job = xmalloc(sizeof(kill_job_msg_t *) *
+						      KILL_JOB_BATCH_MAX);
+			kill_jobs->kill_job[kill_jobs->job_cnt++] =
+				batch_arg_ptr->msg_args;
+			batch_arg_ptr->msg_type = REQUEST_TERMINATE_JOBS;
+			batch_arg_ptr->msg_args = kill_jobs;
+		}
+		kill_jobs->kill_job[kill_jobs->job_cnt++] =
+			agent_arg_ptr->msg_args;
+		agent_arg_ptr->msg_args = NULL;
+		if (kill_jobs->job_cnt >= KILL_JOB_BATCH_MAX)
+			_kill_batch_dequeue(kill_batch->queued_req_ptr);
+		_purge_agent_args(agent_arg_ptr);
+		xfree(queued_req_ptr);
+		*send_now = false;
+	} else {
+		if (kill_batch->last_queue == now)
+			*send_now = false;
+		kill_batch->queued_req_ptr = queued_req_ptr;
+		queued_req_ptr->kill_batch = kill_batch;
+		list_append(retry_list, (void *)queued_req_ptr);
+	}
+	kill_batch->last_queue = now;
+
+	return true;
 }
 
 /* _spawn_retry_agent - pthread_create an agent for the given task */
@@ -1495,6 +1794,8 @@ void agent_purge(void)
 	if (retry_list) {
 		slurm_mutex_lock(&retry_mutex);
 		FREE_NULL_LIST(retry_list);
+		if (kill_batch_hash)
+			xhash_free(kill_batch_hash);
 		slurm_mutex_unlock(&retry_mutex);
 	}
 	if (mail_list) {
@@ -1516,48 +1817,62 @@ extern int get_agent_count(void)
 
 static void _purge_agent_args(agent_arg_t *agent_arg_ptr)
 {
+	int i;
+
 	if (agent_arg_ptr == NULL)
 		return;
 
 	hostlist_destroy(agent_arg_ptr->hostlist);
 	xfree(agent_arg_ptr->addr);
-	if (agent_arg_ptr->msg_args) {
-		if (agent_arg_ptr->msg_type == REQUEST_BATCH_JOB_LAUNCH)
-			slurmctld_free_batch_job_launch_msg(agent_arg_ptr->
-							    msg_args);
-		else if (agent_arg_ptr->msg_type ==
-				RESPONSE_RESOURCE_ALLOCATION)
-			slurm_free_resource_allocation_response_msg(
-					agent_arg_ptr->msg_args);
-		else if ((agent_arg_ptr->msg_type == REQUEST_ABORT_JOB)      ||
-			 (agent_arg_ptr->msg_type == REQUEST_TERMINATE_JOB)  ||
-			 (agent_arg_ptr->msg_type == REQUEST_KILL_PREEMPTED) ||
-			 (agent_arg_ptr->msg_type == REQUEST_KILL_TIMELIMIT))
-			slurm_free_kill_job_msg(agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == SRUN_USER_MSG)
-			slurm_free_srun_user_msg(agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == SRUN_EXEC)
-			slurm_free_srun_exec_msg(agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == SRUN_NODE_FAIL)
-			slurm_free_srun_node_fail_msg(agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == SRUN_STEP_MISSING)
-			slurm_free_srun_step_missing_msg(
+	if (agent_arg_ptr->msg_args)
+		_purge_msg_args(agent_arg_ptr->msg_type,
 				agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == SRUN_STEP_SIGNAL)
-			slurm_free_job_step_kill_msg(
-				agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == REQUEST_JOB_NOTIFY)
-			slurm_free_job_notify_msg(agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == REQUEST_SUSPEND_INT)
-			slurm_free_suspend_int_msg(agent_arg_ptr->msg_args);
-		else if (agent_arg_ptr->msg_type == REQUEST_LAUNCH_PROLOG)
-			slurm_free_prolog_launch_msg(agent_arg_ptr->msg_args);
-		else
-			xfree(agent_arg_ptr->msg_args);
+	if (agent_arg_ptr->msg_args_list) {
+		for (i = 0; i < agent_arg_ptr->node_count; i++) {
+			_purge_msg_args(agent_arg_ptr->msg_type,
+					agent_arg_ptr->msg_args_list[i]);
+		}
+		xfree(agent_arg_ptr->msg_args_list);
 	}
 	xfree(agent_arg_ptr);
 }
 
+static void _purge_msg_args(slurm_msg_type_t msg_type, void *msg_args)
+{
+	if (msg_args == NULL)
+		return;
+
+	if (msg_type == REQUEST_BATCH_JOB_LAUNCH)
+		slurmctld_free_batch_job_launch_msg(msg_args);
+	else if (msg_type == RESPONSE_RESOURCE_ALLOCATION)
+		slurm_free_resource_allocation_response_msg(msg_args);
+	else if ((msg_type == REQUEST_ABORT_JOB)      ||
+		 (msg_type == REQUEST_TERMINATE_JOB)  ||
+		 (msg_type == REQUEST_KILL_PREEMPTED) ||
+		 (msg_type == REQUEST_KILL_TIMELIMIT))
+		slurm_free_kill_job_msg(msg_args);
+	else if (msg_type == SRUN_USER_MSG)
+		slurm_free_srun_user_msg(msg_args);
+	else if (msg_type == SRUN_EXEC)
+		slurm_free_srun_exec_msg(msg_args);
+	else if (msg_type == SRUN_NODE_FAIL)
+		slurm_free_srun_node_fail_msg(msg_args);
+	else if (msg_type == SRUN_STEP_MISSING)
+		slurm_free_srun_step_missing_msg(msg_args);
+	else if (msg_type == SRUN_STEP_SIGNAL)
+		slurm_free_job_step_kill_msg(msg_args);
+	else if (msg_type == REQUEST_JOB_NOTIFY)
+		slurm_free_job_notify_msg(msg_args);
+	else if (msg_type == REQUEST_SUSPEND_INT)
+		slurm_free_suspend_int_msg(msg_args);
+	else if (msg_type == REQUEST_TERMINATE_JOBS)
+		slurm_free_kill_jobs_msg(msg_args);
+	else if (msg_type == REQUEST_LAUNCH_PROLOG)
+		slurm_free_prolog_launch_msg(msg_args);
+	else
+		xfree(msg_args);
+}
+
 static mail_info_t *_mail_alloc(void)
 {
 	return xmalloc(sizeof(mail_info_t));
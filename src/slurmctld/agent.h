@@ -55,12 +55,18 @@ typedef struct agent_arg {
 					 * with */
 	uint16_t	retry;		/* if set, keep trying */
 	slurm_addr_t    *addr;          /* if set will send to this
-					   addr not hostlist */
+					   addr not hostlist, with
+					   msg_args_list one addr per
+					   host in hostlist order */
 	hostlist_t	hostlist;	/* hostlist containing the
 					 * nodes we are sending to */
 	uint16_t        protocol_version; /* protocol version to use */
 	slurm_msg_type_t msg_type;	/* RPC to be issued */
 	void		*msg_args;	/* RPC data to be transmitted */
+	void		**msg_args_list;/* if set, RPC data for each host
+					 * in hostlist order rather than
+					 * msg_args (srun notifications,
+					 * retry is not supported) */
 } agent_arg_t;
 
 /*
@@ -97,7 +97,9 @@
 #include "src/slurmctld/agent.h"
 #include "src/slurmctld/burst_buffer.h"
 #include "src/slurmctld/front_end.h"
+#include "src/slurmctld/job_file_cache.h"
 #include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/job_store.h"
 #include "src/slurmctld/job_submit.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
@@ -673,9 +675,12 @@ int main(int argc, char *argv[])
 		error("Left %d agent threads active", cnt);
 
 	slurm_sched_fini();	/* Stop all scheduling */
+	schedule_fini();
 
 	/* Purge our local data structures */
 	job_fini();
+	job_store_fini();
+	job_file_cache_fini();
 	part_fini();	/* part_fini() must precede node_fini() */
 	node_fini();
 	purge_front_end_state();
@@ -1325,6 +1330,8 @@ static void _update_assoc(slurmdb_assoc_rec_t *rec)
 		return;
 
 	lock_slurmctld(job_write_lock);
+	/* Limits of parent associations also apply to the jobs of children */
+	acct_policy_limits_changed();
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr = list_next(job_iterator))) {
 		if ((rec != job_ptr->assoc_ptr) || (!IS_JOB_PENDING(job_ptr)))
@@ -1349,6 +1356,7 @@ static void _update_qos(slurmdb_qos_rec_t *rec)
 		return;
 
 	lock_slurmctld(job_write_lock);
+	acct_policy_limits_changed();
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr = list_next(job_iterator))) {
 		if ((rec != job_ptr->qos_ptr) || (!IS_JOB_PENDING(job_ptr)))
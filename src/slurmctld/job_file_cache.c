@@ -0,0 +1,207 @@
+/*****************************************************************************\
+ *  job_file_cache.c - In memory cache of job script and environment files,
+ *	shared by jobs with identical contents
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmctld/job_file_cache.h"
+
+#define JOB_FILE_CACHE_MAX (64 * 1024 * 1024)	/* bytes of file contents */
+
+typedef struct job_file_data {
+	char *key;		/* hash and size of data */
+	char *data;		/* file contents */
+	int size;		/* bytes in data */
+	int ref_cnt;		/* count of job_file_t records using this */
+} job_file_data_t;
+
+typedef struct job_file {
+	char *file_name;	/* full path name of the file */
+	job_file_data_t *file_data;
+} job_file_t;
+
+static pthread_mutex_t job_file_mutex = PTHREAD_MUTEX_INITIALIZER;
+static xhash_t *job_file_hash = NULL;		/* job_file_t by file name */
+static xhash_t *job_file_data_hash = NULL;	/* job_file_data_t by key */
+static int job_file_cache_size = 0;		/* bytes of cached contents */
+
+static const char *_job_file_id(void *item)
+{
+	job_file_t *file_ptr = (job_file_t *) item;
+	return file_ptr->file_name;
+}
+
+static const char *_job_file_data_id(void *item)
+{
+	job_file_data_t *data_ptr = (job_file_data_t *) item;
+	return data_ptr->key;
+}
+
+static void _job_file_data_free(void *item)
+{
+	job_file_data_t *data_ptr = (job_file_data_t *) item;
+
+	if (data_ptr) {
+		job_file_cache_size -= data_ptr->size;
+		xfree(data_ptr->key);
+		xfree(data_ptr->data);
+		xfree(data_ptr);
+	}
+}
+
+/* Release a file's reference to its contents, freeing them when unused */
+static void _job_file_free(void *item)
+{
+	job_file_t *file_ptr = (job_file_t *) item;
+
+	if (file_ptr) {
+		if (file_ptr->file_data &&
+		    (--file_ptr->file_data->ref_cnt == 0)) {
+			xhash_delete(job_file_data_hash,
+				     file_ptr->file_data->key);
+		}
+		xfree(file_ptr->file_name);
+		xfree(file_ptr);
+	}
+}
+
+extern char *job_file_cache_key(const char *data, int size)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	char *key = NULL;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+	xstrfmtcat(key, "%016llx.%d", (unsigned long long) hash, size);
+	return key;
+}
+
+extern void job_file_cache_add(const char *file_name, const char *data,
+			       int size)
+{
+	job_file_data_t *data_ptr;
+	job_file_t *file_ptr;
+	char *key;
+
+	if (!file_name || !data || (size < 0))
+		return;
+
+	key = job_file_cache_key(data, size);
+	slurm_mutex_lock(&job_file_mutex);
+	if (!job_file_hash) {
+		job_file_hash = xhash_init(_job_file_id, _job_file_free,
+					   NULL, 0);
+		job_file_data_hash = xhash_init(_job_file_data_id,
+						_job_file_data_free, NULL, 0);
+	}
+
+	/* Drop any contents previously recorded for this file name */
+	xhash_delete(job_file_hash, file_name);
+
+	if ((data_ptr = xhash_get(job_file_data_hash, key))) {
+		if (memcmp(data_ptr->data, data, size)) {
+			/* Hash collision, leave this file on disk only */
+			debug("%s: hash collision for %s", __func__,
+			      file_name);
+			goto fini;
+		}
+	} else if ((job_file_cache_size + size) > JOB_FILE_CACHE_MAX) {
+		goto fini;
+	} else {
+		data_ptr = xmalloc(sizeof(job_file_data_t));
+		data_ptr->key = key;
+		key = NULL;
+		data_ptr->data = xmalloc(size);
+		memcpy(data_ptr->data, data, size);
+		data_ptr->size = size;
+		job_file_cache_size += size;
+		if (!xhash_add(job_file_data_hash, data_ptr)) {
+			_job_file_data_free(data_ptr);
+			goto fini;
+		}
+	}
+
+	file_ptr = xmalloc(sizeof(job_file_t));
+	file_ptr->file_name = xstrdup(file_name);
+	file_ptr->file_data = data_ptr;
+	data_ptr->ref_cnt++;
+	if (!xhash_add(job_file_hash, file_ptr))
+		_job_file_free(file_ptr);
+
+fini:
+	slurm_mutex_unlock(&job_file_mutex);
+	xfree(key);
+}
+
+extern bool job_file_cache_get(const char *file_name, char **data,
+			       int *size)
+{
+	job_file_t *file_ptr = NULL;
+
+	*data = NULL;
+	*size = 0;
+	slurm_mutex_lock(&job_file_mutex);
+	if (job_file_hash && (file_ptr = xhash_get(job_file_hash, file_name))) {
+		*size = file_ptr->file_data->size;
+		*data = xmalloc(*size + 1);
+		memcpy(*data, file_ptr->file_data->data, *size);
+	}
+	slurm_mutex_unlock(&job_file_mutex);
+
+	return (file_ptr != NULL);
+}
+
+extern void job_file_cache_remove(const char *file_name)
+{
+	slurm_mutex_lock(&job_file_mutex);
+	if (job_file_hash)
+		xhash_delete(job_file_hash, file_name);
+	slurm_mutex_unlock(&job_file_mutex);
+}
+
+extern void job_file_cache_fini(void)
+{
+	slurm_mutex_lock(&job_file_mutex);
+	xhash_free(job_file_hash);
+	xhash_free(job_file_data_hash);
+	slurm_mutex_unlock(&job_file_mutex);
+}
@@ -0,0 +1,81 @@
+/*****************************************************************************\
+ *  job_file_cache.h - In memory cache of job script and environment files,
+ *	shared by jobs with identical contents
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _JOB_FILE_CACHE_H
+#define _JOB_FILE_CACHE_H
+
+#include <stdbool.h>
+
+/*
+ * The job file cache holds the contents of batch job script and environment
+ * files, keyed by the file's path name, so that launching a batch job does
+ * not need to read them back from the StateSaveLocation. Contents are
+ * stored once per distinct value, identified by a hash of the data, so job
+ * array tasks and repeated submissions of one script share their memory.
+ *
+ * The cache has its own lock and may be used without any slurmctld locks.
+ * Files whose contents would grow the cache beyond its size limit are not
+ * cached and must be read from disk.
+ */
+
+/*
+ * job_file_cache_add - Record the contents of a job file
+ * IN file_name - full path name of the file
+ * IN data - file contents
+ * IN size - bytes in data
+ */
+extern void job_file_cache_add(const char *file_name, const char *data,
+			       int size);
+
+/*
+ * job_file_cache_get - Return a copy of a cached job file's contents
+ * IN file_name - full path name of the file
+ * OUT data - file contents, NUL terminated, must be xfreed
+ * OUT size - bytes in data, excluding the added NUL
+ * RET true if the file was found in the cache
+ */
+extern bool job_file_cache_get(const char *file_name, char **data,
+			       int *size);
+
+/* Remove a job file from the cache, call when the file is deleted */
+extern void job_file_cache_remove(const char *file_name);
+
+/* Return a key identifying data, a 64-bit FNV-1a hash of the data and its
+ * size, must be xfreed */
+extern char *job_file_cache_key(const char *data, int size);
+
+/* Free all memory associated with the job file cache */
+extern void job_file_cache_fini(void);
+
+#endif /* !_JOB_FILE_CACHE_H */
@@ -88,7 +88,9 @@
 #include "src/slurmctld/burst_buffer.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/gang.h"
+#include "src/slurmctld/job_file_cache.h"
 #include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/job_store.h"
 #include "src/slurmctld/job_submit.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
@@ -97,6 +99,7 @@
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/sched_plugin.h"
+#include "src/slurmctld/shape_cache.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/slurmctld_plugstack.h"
 #include "src/slurmctld/srun_comm.h"
@@ -169,13 +172,15 @@ static struct job_record *_create_job_record(int *error_code,
 					     uint32_t num_jobs);
 static void _del_batch_list_rec(void *x);
 static void _delete_job_desc_files(uint32_t job_id);
+static void _delete_job_dir(uint32_t job_id);
 static void _destroy_uint32_ptr(void *object);
 static slurmdb_qos_rec_t *_determine_and_validate_qos(
 	char *resv_name, slurmdb_assoc_rec_t *assoc_ptr,
 	bool admin, slurmdb_qos_rec_t *qos_rec,	int *error_code, bool locked);
 static void _dump_job_details(struct job_details *detail_ptr, Buf buffer);
 static void _dump_job_state(struct job_record *dump_job_ptr, Buf buffer);
-static void _get_batch_job_dir_ids(List batch_dirs);
+static bool _get_batch_job_dir_ids(List batch_dirs);
+static void _import_batch_dirs(List batch_dirs);
 static time_t _get_last_state_write_time(void);
 static void _job_array_comp(struct job_record *job_ptr, bool was_running);
 static int  _job_create(job_desc_msg_t * job_specs, int allocate, int will_run,
@@ -203,11 +208,15 @@ static void _pack_pending_job_details(struct job_details *detail_ptr,
 				      uint16_t protocol_version);
 static bool _parse_array_tok(char *tok, bitstr_t *array_bitmap, uint32_t max);
 static int  _purge_job_record(uint32_t job_id);
-static void _purge_missing_jobs(int node_inx, time_t now);
-static int  _read_data_array_from_file(int fd, char *file_name, char ***data,
-				       uint32_t * size,
-				       struct job_record *job_ptr);
-static int   _read_data_from_file(int fd, char *file_name, char **data);
+static void _purge_missing_jobs(int *node_inx, int node_cnt, time_t now);
+static int  _validate_jobs_on_node(slurm_node_registration_status_msg_t
+				   *reg_msg, time_t now);
+static int  _read_data_array(char *file_name, char *file_data,
+			     int file_size, char ***data, uint32_t *size,
+			     char **env_sup, uint32_t env_cnt);
+static int  _read_job_file(uint32_t job_id, uint32_t array_job_id,
+			   uint32_t array_task_id, char *name,
+			   char **file_name, char **data, int *size);
 static char *_read_job_ckpt_file(char *ckpt_file, int *size_ptr);
 static void _remove_defunct_batch_dirs(List batch_dirs);
 static void _remove_job_hash(struct job_record *job_ptr);
@@ -245,9 +254,6 @@ static void _validate_job_files(List batch_dirs);
 static bool _validate_min_mem_partition(job_desc_msg_t *job_desc_msg,
 					struct part_record *part_ptr,
 					List part_list);
-static int  _write_data_to_file(char *file_name, char *data);
-static int  _write_data_array_to_file(char *file_name, char **data,
-				      uint32_t size);
 static void _xmit_new_end_time(struct job_record *job_ptr);
 
 /*
@@ -531,6 +537,14 @@ static void _destroy_uint32_ptr(void *object)
 
 /* _delete_job_desc_files - delete job descriptor related files */
 static void _delete_job_desc_files(uint32_t job_id)
+{
+	if (!job_store_delete(job_id))
+		_delete_job_dir(job_id);
+}
+
+/* _delete_job_dir - delete a job's directory, as written by version 15.08
+ *	and earlier */
+static void _delete_job_dir(uint32_t job_id)
 {
 	char *dir_name = NULL, *file_name = NULL;
 	struct stat sbuf;
@@ -561,6 +575,7 @@ static void _delete_job_desc_files(uint32_t job_id)
 				continue;
 			xstrfmtcat(file_name, "%s/%s", dir_name,
 				   dir_ent->d_name);
+			job_file_cache_remove(file_name);
 			(void) unlink(file_name);
 			xfree(file_name);
 		}
@@ -3403,6 +3418,7 @@ extern void excise_node_from_job(struct job_record *job_ptr,
 
 	FREE_NULL_BITMAP(orig_bitmap);
 	(void) select_g_job_resized(job_ptr, node_ptr);
+	shape_cache_invalidate();
 }
 
 /*
@@ -6208,79 +6224,44 @@ extern int validate_job_create_req(job_desc_msg_t * job_desc, uid_t submit_uid,
 }
 
 /* _copy_job_desc_to_file - copy the job script and environment from the RPC
- *	structure into a file */
+ *	structure into the job store */
 static int
 _copy_job_desc_to_file(job_desc_msg_t * job_desc, uint32_t job_id)
 {
-	int error_code = 0, hash;
-	char *dir_name, job_dir[32], *file_name;
+	int error_code, i, len, pos, env_size;
+	char *env;
 	DEF_TIMERS;
 
 	START_TIMER;
-	/* Create state_save_location directory */
-	dir_name = slurm_get_state_save_location();
-
-	/* Create directory based upon job ID due to limitations on the number
-	 * of files possible in a directory on some file system types (e.g.
-	 * up to 64k files on a FAT32 file system). */
-	hash = job_id % 10;
-	sprintf(job_dir, "/hash.%d", hash);
-	xstrcat(dir_name, job_dir);
-	(void) mkdir(dir_name, 0700);
-
-	/* Create job_id specific directory */
-	sprintf(job_dir, "/job.%u", job_id);
-	xstrcat(dir_name, job_dir);
-	if (mkdir(dir_name, 0700)) {
-		if (!slurmctld_primary && (errno == EEXIST)) {
-			error("Apparent duplicate job ID %u. Two primary "
-			      "slurmctld daemons might currently be active",
-			      job_id);
-		}
-		error("mkdir(%s) error %m", dir_name);
-		xfree(dir_name);
-		return ESLURM_WRITING_TO_FILE;
-	}
-
-	/* Create environment file, and write data to it */
-	file_name = xstrdup(dir_name);
-	xstrcat(file_name, "/environment");
-	error_code = _write_data_array_to_file(file_name,
-					       job_desc->environment,
-					       job_desc->env_size);
-	xfree(file_name);
-
-	if (error_code == 0) {
-		/* Create script file */
-		file_name = xstrdup(dir_name);
-		xstrcat(file_name, "/script");
-		error_code = _write_data_to_file(file_name, job_desc->script);
-		xfree(file_name);
-	}
+	/* Build the environment file contents, a record count followed by
+	 * NUL terminated strings */
+	env_size = sizeof(uint32_t);
+	for (i = 0; job_desc->environment && (i < job_desc->env_size); i++)
+		env_size += strlen(job_desc->environment[i]) + 1;
+	env = xmalloc(env_size);
+	memcpy(env, &job_desc->env_size, sizeof(uint32_t));
+	pos = sizeof(uint32_t);
+	for (i = 0; job_desc->environment && (i < job_desc->env_size); i++) {
+		len = strlen(job_desc->environment[i]) + 1;
+		memcpy(&env[pos], job_desc->environment[i], len);
+		pos += len;
+	}
+
+	error_code = job_store_add(job_id, env, env_size, job_desc->script,
+				   job_desc->script ?
+				   (strlen(job_desc->script) + 1) : 0);
+	xfree(env);
 
-	xfree(dir_name);
 	END_TIMER2("_copy_job_desc_to_file");
 	return error_code;
 }
 
-/* Return true of the specified job ID already has a batch directory so
+/* Return true of the specified job ID already has files in the job store so
  * that a different job ID can be created. This is to help limit damage from
  * split-brain, where two slurmctld daemons are running as primary. */
 static bool _dup_job_file_test(uint32_t job_id)
 {
-	char *dir_name_src, job_dir[40];
-	struct stat buf;
-	int rc, hash;
-
-	dir_name_src  = slurm_get_state_save_location();
-	hash = job_id % 10;
-	sprintf(job_dir, "/hash.%d", hash);
-	xstrcat(dir_name_src, job_dir);
-	sprintf(job_dir, "/job.%u", job_id);
-	xstrcat(dir_name_src, job_dir);
-	rc = stat(dir_name_src, &buf);
-	xfree(dir_name_src);
-	if (rc == 0) {
+	if (job_store_test(job_id)) {
 		error("Vestigial state files for job %u, but no job record. "
 		      "this may be the result of two slurmctld running in "
 		      "primary mode", job_id);
@@ -6289,228 +6270,146 @@ static bool _dup_job_file_test(uint32_t job_id)
 	return false;
 }
 
-/* _copy_job_desc_files - Create work directory for job array task.
- * No longer copies environment/script files. */
+/* _copy_job_desc_files - Record the files of a job array task, shared with
+ *	the job it was split from. */
 static int
 _copy_job_desc_files(uint32_t job_id_src, uint32_t job_id_dest)
 {
-	int error_code = SLURM_SUCCESS, hash;
-	char *dir_name_src, *dir_name_dest, job_dir[40];
-
-	/* Create state_save_location directory */
-	dir_name_src  = slurm_get_state_save_location();
-	dir_name_dest = xstrdup(dir_name_src);
-
-	/* Create directory based upon job ID due to limitations on the number
-	 * of files possible in a directory on some file system types (e.g.
-	 * up to 64k files on a FAT32 file system). */
-	hash = job_id_dest % 10;
-	sprintf(job_dir, "/hash.%d", hash);
-	xstrcat(dir_name_dest, job_dir);
-	(void) mkdir(dir_name_dest, 0700);
-
-	/* Create job_id_dest specific directory */
-	sprintf(job_dir, "/job.%u", job_id_dest);
-	xstrcat(dir_name_dest, job_dir);
-	if (mkdir(dir_name_dest, 0700)) {
-		if (!slurmctld_primary && (errno == EEXIST)) {
-			error("Apparent duplicate job ID %u. Two primary "
-			      "slurmctld daemons might currently be active",
-			      job_id_dest);
-		}
-		error("mkdir(%s) error %m", dir_name_dest);
-		error_code = ESLURM_WRITING_TO_FILE;
-	}
-	xfree(dir_name_src);
-	xfree(dir_name_dest);
-
-	return error_code;
+	return job_store_copy(job_id_src, job_id_dest);
 }
 
 /*
- * Create file with specified name and write the supplied data array to it
- * IN file_name - file to create and write to
- * IN data - array of pointers to strings (e.g. env)
- * IN size - number of elements in data
+ * get_job_env - return the environment variables and their count for a
+ *	given job
+ * IN job_ptr - pointer to job for which data is required
+ * OUT env_size - number of elements to read
+ * RET point to array of string pointers containing environment variables
  */
-static int
-_write_data_array_to_file(char *file_name, char **data, uint32_t size)
+char **get_job_env(struct job_record *job_ptr, uint32_t * env_size)
 {
-	int fd, i, pos, nwrite, amount;
+	char *file_name = NULL, *file_data = NULL, **environment = NULL;
+	int file_size = 0;
 
-	fd = creat(file_name, 0600);
-	if (fd < 0) {
-		error("Error creating file %s, %m", file_name);
-		return ESLURM_WRITING_TO_FILE;
-	}
-
-	amount = write(fd, &size, sizeof(uint32_t));
-	if (amount < sizeof(uint32_t)) {
-		error("Error writing file %s, %m", file_name);
-		close(fd);
-		return ESLURM_WRITING_TO_FILE;
-	}
-
-	if (data == NULL) {
-		close(fd);
-		return SLURM_SUCCESS;
-	}
-
-	for (i = 0; i < size; i++) {
-		nwrite = strlen(data[i]) + 1;
-		pos = 0;
-		while (nwrite > 0) {
-			amount = write(fd, &data[i][pos], nwrite);
-			if ((amount < 0) && (errno != EINTR)) {
-				error("Error writing file %s, %m",
-				      file_name);
-				close(fd);
-				return ESLURM_WRITING_TO_FILE;
-			}
-			nwrite -= amount;
-			pos    += amount;
-		}
+	*env_size = 0;
+	if (_read_job_file(job_ptr->job_id, job_ptr->array_job_id,
+			   job_ptr->array_task_id, "environment",
+			   &file_name, &file_data, &file_size) < 0) {
+		error("Could not open environment file for job %u",
+		      job_ptr->job_id);
+		return NULL;
 	}
 
-	close(fd);
-	return SLURM_SUCCESS;
+	if (_read_data_array(file_name, file_data, file_size, &environment,
+			     env_size, job_ptr->details->env_sup,
+			     job_ptr->details->env_cnt) < 0)
+		environment = NULL;
+	xfree(file_data);
+	xfree(file_name);
+	return environment;
 }
 
 /*
- * Create file with specified name and write the supplied data array to it
- * IN file_name - file to create and write to
- * IN data - pointer to string
+ * get_job_script - return the script for a given job
+ * IN job_ptr - pointer to job for which data is required
+ * RET point to string containing job script
  */
-static int _write_data_to_file(char *file_name, char *data)
+char *get_job_script(struct job_record *job_ptr)
 {
-	int fd, pos, nwrite, amount;
+	char *file_name = NULL, *script = NULL;
+	int file_size = 0;
 
-	if (data == NULL) {
-		(void) unlink(file_name);
-		return SLURM_SUCCESS;
-	}
+	if (!job_ptr->batch_flag)
+		return NULL;
 
-	fd = creat(file_name, 0700);
-	if (fd < 0) {
-		error("Error creating file %s, %m", file_name);
-		return ESLURM_WRITING_TO_FILE;
+	if (_read_job_file(job_ptr->job_id, job_ptr->array_job_id,
+			   job_ptr->array_task_id, "script",
+			   &file_name, &script, &file_size) < 0) {
+		error("Could not open script file for job %u", job_ptr->job_id);
+		return NULL;
 	}
 
-	nwrite = strlen(data) + 1;
-	pos = 0;
-	while (nwrite > 0) {
-		amount = write(fd, &data[pos], nwrite);
-		if ((amount < 0) && (errno != EINTR)) {
-			error("Error writing file %s, %m", file_name);
-			close(fd);
-			return ESLURM_WRITING_TO_FILE;
-		}
-		nwrite -= amount;
-		pos    += amount;
-	}
-	close(fd);
-	return SLURM_SUCCESS;
+	xfree(file_name);
+	return script;
 }
 
 /*
- * get_job_env - return the environment variables and their count for a
- *	given job
- * IN job_ptr - pointer to job for which data is required
- * OUT env_size - number of elements to read
- * RET point to array of string pointers containing environment variables
+ * load_job_launch_data - read a batch job's script and environment into its
+ *	launch message. No slurmctld locks are needed, so the files of jobs
+ *	without supplemental environment variables can be read after the job
+ *	lock was released (see get_job_env() for the other jobs).
+ * IN/OUT launch_msg_ptr - message with job and array IDs set
+ * RET SLURM_SUCCESS, ESLURM_JOB_SCRIPT_MISSING if the script can not be
+ *	read or SLURM_ERROR if the environment can not be read
  */
-char **get_job_env(struct job_record *job_ptr, uint32_t * env_size)
-{
-	char *file_name = NULL, job_dir[40], **environment = NULL;
-	int cc, fd = -1, hash;
-
-	/* Standard file location for job arrays, version 16.05+ */
-	if (job_ptr->array_task_id != NO_VAL) {
-		hash = job_ptr->array_job_id % 10;
-		sprintf(job_dir, "/hash.%d/job.%u/environment",
-			hash, job_ptr->array_job_id);
-		xfree(file_name);
-		file_name = slurm_get_state_save_location();
-		xstrcat(file_name, job_dir);
-		fd = open(file_name, 0);
-	}
-
-	/* Standard file location, versions 15.08 and 14.11 */
-	if (fd < 0) {
-		hash = job_ptr->job_id % 10;
-		sprintf(job_dir, "/hash.%d/job.%u/environment",
-			hash, job_ptr->job_id);
-		xfree(file_name);
-		file_name = slurm_get_state_save_location();
-		xstrcat(file_name, job_dir);
-		fd = open(file_name, 0);
+extern int load_job_launch_data(batch_job_launch_msg_t *launch_msg_ptr)
+{
+	char *file_name = NULL, *file_data = NULL;
+	int file_size = 0, rc;
+
+	if (_read_job_file(launch_msg_ptr->job_id,
+			   launch_msg_ptr->array_job_id,
+			   launch_msg_ptr->array_task_id, "script",
+			   &file_name, &launch_msg_ptr->script,
+			   &file_size) < 0) {
+		error("Could not open script file for job %u",
+		      launch_msg_ptr->job_id);
+		return ESLURM_JOB_SCRIPT_MISSING;
 	}
+	xfree(file_name);
 
-	/* Standard file location, version 14.3 and earlier
-	 * NOTE: Cannot remove this backwards compatibility as there is no
-	 * process to migrate jobs to the newer directory structure, and
-	 * sites may be jumping through multiple version to bring their
-	 * installation to current. E.g., going from v2.6 -> 14.03 -> 16.05
-	 * would update state files correctly, but leave pending jobs in
-	 * the old directory format.
-	 */
-	if (fd < 0) {
-		xfree(file_name);
-		file_name = slurm_get_state_save_location();
-		sprintf(job_dir, "/job.%u/environment", job_ptr->job_id);
-		xstrcat(file_name, job_dir);
-		fd = open(file_name, 0);
-	}
-
-	if (fd >= 0) {
-		cc = _read_data_array_from_file(fd, file_name, &environment,
-						env_size, job_ptr);
-		if (cc < 0)
-			environment = NULL;
-		close(fd);
-	} else {
+	if (_read_job_file(launch_msg_ptr->job_id,
+			   launch_msg_ptr->array_job_id,
+			   launch_msg_ptr->array_task_id, "environment",
+			   &file_name, &file_data, &file_size) < 0) {
 		error("Could not open environment file for job %u",
-		      job_ptr->job_id);
+		      launch_msg_ptr->job_id);
+		return SLURM_ERROR;
 	}
-
+	rc = _read_data_array(file_name, file_data, file_size,
+			      &launch_msg_ptr->environment,
+			      &launch_msg_ptr->envc, NULL, 0);
+	xfree(file_data);
 	xfree(file_name);
-	return environment;
+	if ((rc < 0) || (launch_msg_ptr->environment == NULL))
+		return SLURM_ERROR;
+
+	return SLURM_SUCCESS;
 }
 
 /*
- * get_job_script - return the script for a given job
- * IN job_ptr - pointer to job for which data is required
- * RET point to string containing job script
+ * Read one of a job's script or environment files, from the job store or
+ *	the job directories of version 15.08 and earlier
+ * IN job_id, array_job_id, array_task_id - job whose file is needed
+ * IN name - name of the file in the job's directory
+ * OUT file_name - path name of the file read, must be xfreed
+ * OUT data - NUL terminated file contents, must be xfreed
+ * OUT size - bytes in data, excluding the added NUL
+ * RET 0 on success, -1 on error
  */
-char *get_job_script(struct job_record *job_ptr)
+static int _read_job_file(uint32_t job_id, uint32_t array_job_id,
+			  uint32_t array_task_id, char *name,
+			  char **file_name, char **data, int *size)
 {
-	char *file_name = NULL, job_dir[40], *script = NULL;
-	int fd = -1, hash;
+	char *path[3] = { NULL, NULL, NULL };
+	int i, rc = -1;
 
-	if (!job_ptr->batch_flag)
-		return NULL;
+	/* Job store, job array tasks use the files of the array's job ID */
+	if ((array_task_id != NO_VAL) &&
+	    (job_store_read(array_job_id, name, file_name, data, size) == 0))
+		return 0;
+	if (job_store_read(job_id, name, file_name, data, size) == 0)
+		return 0;
 
 	/* Standard file location for job arrays, version 16.05+ */
-	if (job_ptr->array_task_id != NO_VAL) {
-		hash = job_ptr->array_job_id % 10;
-		sprintf(job_dir, "/hash.%d/job.%u/script",
-			hash, job_ptr->array_job_id);
-		xfree(file_name);
-		file_name = slurm_get_state_save_location();
-		xstrcat(file_name, job_dir);
-		fd = open(file_name, 0);
+	if (array_task_id != NO_VAL) {
+		path[0] = slurm_get_state_save_location();
+		xstrfmtcat(path[0], "/hash.%d/job.%u/%s",
+			   array_job_id % 10, array_job_id, name);
 	}
 
 	/* Standard file location, versions 15.08 and 14.11 */
-	if (fd < 0) {
-		hash = job_ptr->job_id % 10;
-		sprintf(job_dir, "/hash.%d/job.%u/script",
-			hash, job_ptr->job_id);
-		xfree(file_name);
-		file_name = slurm_get_state_save_location();
-		xstrcat(file_name, job_dir);
-		fd = open(file_name, 0);
-	}
+	path[1] = slurm_get_state_save_location();
+	xstrfmtcat(path[1], "/hash.%d/job.%u/%s", job_id % 10, job_id, name);
 
 	/* Standard file location, version 14.3 and earlier
 	 * NOTE: Cannot remove this backwards compatibility as there is no
@@ -6520,41 +6419,42 @@ char *get_job_script(struct job_record *job_ptr)
 	 * would update state files correctly, but leave pending jobs in
 	 * the old directory format.
 	 */
-	if (fd < 0) {
-		xfree(file_name);
-		file_name = slurm_get_state_save_location();
-		sprintf(job_dir, "/job.%u/script", job_ptr->job_id);
-		xstrcat(file_name, job_dir);
-		fd = open(file_name, 0);
-	}
+	path[2] = slurm_get_state_save_location();
+	xstrfmtcat(path[2], "/job.%u/%s", job_id, name);
 
-	if (fd >= 0) {
-		_read_data_from_file(fd, file_name, &script);
-		close(fd);
-	} else {
-		error("Could not open script file for job %u", job_ptr->job_id);
+	for (i = 0; i < 3; i++) {
+		if (path[i] &&
+		    ((rc = job_store_read_file(path[i], data, size)) == 0))
+			break;
 	}
 
-	xfree(file_name);
-	return script;
+	if (rc == 0) {
+		*file_name = path[i];
+		path[i] = NULL;
+	}
+	for (i = 0; i < 3; i++)
+		xfree(path[i]);
+	return rc;
 }
 
 /*
- * Read a collection of strings from a file
- * IN fd - file descriptor
- * IN file_name - file to read from
+ * Build a collection of strings from the contents of a file
+ * IN file_name - file the data was read from
+ * IN file_data - file contents, NUL terminated
+ * IN file_size - bytes in file_data
  * OUT data - pointer to array of pointers to strings (e.g. env),
  *	must be xfreed when no longer needed
  * OUT size - number of elements in data
- * IN job_ptr - job
+ * IN env_sup - supplemental environment variables to add
+ * IN env_cnt - number of elements in env_sup
  * RET 0 on success, -1 on error
  * NOTE: The output format of this must be identical with _xduparray2()
  */
 static int
-_read_data_array_from_file(int fd, char *file_name, char ***data,
-			    uint32_t * size, struct job_record *job_ptr)
+_read_data_array(char *file_name, char *file_data, int file_size,
+		 char ***data, uint32_t *size, char **env_sup, uint32_t env_cnt)
 {
-	int pos, buf_size, amount, i, j;
+	int pos, buf_size, i, j;
 	char *buffer, **array_ptr;
 	uint32_t rec_cnt;
 
@@ -6564,14 +6464,14 @@ _read_data_array_from_file(int fd, char *file_name, char ***data,
 	*data = NULL;
 	*size = 0;
 
-	amount = read(fd, &rec_cnt, sizeof(uint32_t));
-	if (amount < sizeof(uint32_t)) {
-		if (amount != 0)	/* incomplete write */
-			error("Error reading file %s, %m", file_name);
+	if (file_size < sizeof(uint32_t)) {
+		if (file_size != 0)	/* incomplete write */
+			error("Error reading file %s, truncated", file_name);
 		else
 			verbose("File %s has zero size", file_name);
 		return -1;
 	}
+	memcpy(&rec_cnt, file_data, sizeof(uint32_t));
 
 	if (rec_cnt >= INT_MAX) {
 		error("%s: unreasonable record counter %d in file %s",
@@ -6585,34 +6485,17 @@ _read_data_array_from_file(int fd, char *file_name, char ***data,
 		return 0;
 	}
 
-	pos = 0;
-	buf_size = BUF_SIZE;
-	buffer = xmalloc(buf_size);
-	while (1) {
-		amount = read(fd, &buffer[pos], BUF_SIZE);
-		if (amount < 0) {
-			error("Error reading file %s, %m", file_name);
-			xfree(buffer);
-			return -1;
-		}
-		pos += amount;
-		if (amount < BUF_SIZE)	/* end of file */
-			break;
-		buf_size += amount;
-		xrealloc(buffer, buf_size);
-	}
-
-	/* Allocate extra space for supplemental environment variables
-	 * as set by Moab */
-	if (job_ptr->details->env_cnt) {
-		for (j = 0; j < job_ptr->details->env_cnt; j++)
-			pos += (strlen(job_ptr->details->env_sup[j]) + 1);
-		xrealloc(buffer, pos);
-	}
+	/* Allocate extra space for a terminating NUL and the supplemental
+	 * environment variables as set by Moab */
+	buf_size = file_size - sizeof(uint32_t);
+	pos = buf_size + 1;
+	for (j = 0; j < env_cnt; j++)
+		pos += (strlen(env_sup[j]) + 1);
+	buffer = xmalloc(pos);
+	memcpy(buffer, file_data + sizeof(uint32_t), buf_size);
 
 	/* We have all the data, now let's compute the pointers */
-	array_ptr = xmalloc(sizeof(char *) *
-			    (rec_cnt + job_ptr->details->env_cnt));
+	array_ptr = xmalloc(sizeof(char *) * (rec_cnt + env_cnt));
 	for (i = 0, pos = 0; i < rec_cnt; i++) {
 		array_ptr[i] = &buffer[pos];
 		pos += strlen(&buffer[pos]) + 1;
@@ -6624,36 +6507,32 @@ _read_data_array_from_file(int fd, char *file_name, char ***data,
 	}
 
 	/* Add supplemental environment variables for Moab */
-	if (job_ptr->details->env_cnt) {
+	if (env_cnt) {
 		char *tmp_chr;
 		int env_len, name_len;
-		for (j = 0; j < job_ptr->details->env_cnt; j++) {
-			tmp_chr = strchr(job_ptr->details->env_sup[j], '=');
+		for (j = 0; j < env_cnt; j++) {
+			tmp_chr = strchr(env_sup[j], '=');
 			if (tmp_chr == NULL) {
 				error("Invalid supplemental environment "
-				      "variable: %s",
-				      job_ptr->details->env_sup[j]);
+				      "variable: %s", env_sup[j]);
 				continue;
 			}
-			env_len  = strlen(job_ptr->details->env_sup[j]) + 1;
-			name_len = tmp_chr - job_ptr->details->env_sup[j] + 1;
+			env_len  = strlen(env_sup[j]) + 1;
+			name_len = tmp_chr - env_sup[j] + 1;
 			/* search for duplicate */
 			for (i = 0; i < rec_cnt; i++) {
-				if (strncmp(array_ptr[i],
-					    job_ptr->details->env_sup[j],
+				if (strncmp(array_ptr[i], env_sup[j],
 					    name_len)) {
 					continue;
 				}
 				/* over-write duplicate */
-				memcpy(&buffer[pos],
-				       job_ptr->details->env_sup[j], env_len);
+				memcpy(&buffer[pos], env_sup[j], env_len);
 				array_ptr[i] = &buffer[pos];
 				pos += env_len;
 				break;
 			}
 			if (i >= rec_cnt) {	/* add env to array end */
-				memcpy(&buffer[pos],
-				       job_ptr->details->env_sup[j], env_len);
+				memcpy(&buffer[pos], env_sup[j], env_len);
 				array_ptr[rec_cnt++] = &buffer[pos];
 				pos += env_len;
 			}
@@ -6665,45 +6544,6 @@ _read_data_array_from_file(int fd, char *file_name, char ***data,
 	return 0;
 }
 
-/*
- * Read a string from a file
- * IN fd - file descriptor to read from
- * IN file_name - file to read from
- * OUT data - pointer to  string
- *	must be xfreed when no longer needed
- * RET - 0 on success, -1 on error
- */
-static int _read_data_from_file(int fd, char *file_name, char **data)
-{
-	int pos, buf_size, amount;
-	char *buffer;
-
-	xassert(file_name);
-	xassert(data);
-	*data = NULL;
-
-	pos = 0;
-	buf_size = BUF_SIZE;
-	buffer = xmalloc(buf_size);
-	while (1) {
-		amount = read(fd, &buffer[pos], BUF_SIZE);
-		if (amount < 0) {
-			error("Error reading file %s, %m", file_name);
-			xfree(buffer);
-			close(fd);
-			return -1;
-		}
-		if (amount < BUF_SIZE)	/* end of file */
-			break;
-		pos += amount;
-		buf_size += amount;
-		xrealloc(buffer, buf_size);
-	}
-
-	*data = buffer;
-	return 0;
-}
-
 /* Given a job request, return a multi_core_data struct.
  * Returns NULL if no values set in the job/step request */
 static multi_core_data_t *
@@ -7154,6 +6994,8 @@ void job_time_limit(void)
 		over_run = now - (slurmctld_conf.over_time_limit  * 60);
 
 	begin_job_resv_check();
+	/* Send timeout warnings to all sruns with one agent request */
+	srun_batch_begin();
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr =(struct job_record *) list_next(job_iterator))) {
 		xassert (job_ptr->magic == JOB_MAGIC);
@@ -7323,6 +7165,7 @@ void job_time_limit(void)
 			srun_timeout (job_ptr);
 	}
 	list_iterator_destroy(job_iterator);
+	srun_batch_end();
 	fini_job_resv_check();
 }
 
@@ -7678,6 +7521,7 @@ static void _list_delete_job(void *job_entry)
 	xassert(job_entry);
 	xassert (job_ptr->magic == JOB_MAGIC);
 	job_ptr->magic = 0;	/* make sure we don't delete record twice */
+	depend_purge_job(job_ptr);
 
 	/* Remove the record from job hash table */
 	job_pptr = &job_hash[JOB_HASH_INX(job_ptr->job_id)];
@@ -9700,6 +9544,10 @@ static int _update_job(struct job_record *job_ptr, job_desc_msg_t * job_specs,
 		goto fini;
 	}
 
+	/* The job's QOS, association or partition may change, so re-evaluate
+	 * any job count limit holding it */
+	job_ptr->limit_block_gen = 0;
+
 	if (job_specs->user_id == NO_VAL) {
 		/* Used by job_submit/lua to find default partition and
 		 * access control logic below to validate partition change */
@@ -11894,18 +11742,52 @@ extern void job_post_resize_acctg(struct job_record *job_ptr)
  */
 extern void
 validate_jobs_on_node(slurm_node_registration_status_msg_t *reg_msg)
+{
+	validate_jobs_on_nodes(&reg_msg, 1);
+}
+
+/*
+ * validate_jobs_on_nodes - validate the jobs reported by a batch of node
+ *	registrations, see validate_jobs_on_node(). Jobs which should be on
+ *	any of the nodes, but are missing, are found with a single pass over
+ *	the job list.
+ * IN reg_msg - node registration messages
+ * IN reg_cnt - number of node registration messages
+ */
+extern void
+validate_jobs_on_nodes(slurm_node_registration_status_msg_t **reg_msg,
+		       int reg_cnt)
+{
+	int i, node_inx, *purge_inx, purge_cnt = 0;
+	time_t now = time(NULL);
+
+	purge_inx = xmalloc(sizeof(int) * reg_cnt);
+	for (i = 0; i < reg_cnt; i++) {
+		node_inx = _validate_jobs_on_node(reg_msg[i], now);
+		if (node_inx >= 0)
+			purge_inx[purge_cnt++] = node_inx;
+	}
+	if (purge_cnt)
+		_purge_missing_jobs(purge_inx, purge_cnt, now);
+	xfree(purge_inx);
+}
+
+/* Validate the jobs reported by one node registration.
+ * RET index of the node if jobs should be running on it, in which case any
+ *	that are missing must be purged with _purge_missing_jobs(), else -1 */
+static int _validate_jobs_on_node(slurm_node_registration_status_msg_t
+				  *reg_msg, time_t now)
 {
 	int i, node_inx, jobs_on_node;
 	struct node_record *node_ptr;
 	struct job_record *job_ptr;
 	struct step_record *step_ptr;
-	time_t now = time(NULL);
 
 	node_ptr = find_node_record(reg_msg->node_name);
 	if (node_ptr == NULL) {
 		error("slurmd registered on unknown node %s",
 			reg_msg->node_name);
-		return;
+		return -1;
 	}
 
 	if (reg_msg->energy)
@@ -12020,8 +11902,6 @@ validate_jobs_on_node(slurm_node_registration_status_msg_t *reg_msg)
 	}
 
 	jobs_on_node = node_ptr->run_job_cnt + node_ptr->comp_job_cnt;
-	if (jobs_on_node)
-		_purge_missing_jobs(node_inx, now);
 
 	if (jobs_on_node != reg_msg->job_count) {
 		/* slurmd will not know of a job unless the job has
@@ -12033,74 +11913,88 @@ validate_jobs_on_node(slurm_node_registration_status_msg_t *reg_msg)
 		reg_msg->job_count = jobs_on_node;
 	}
 
-	return;
+	if (jobs_on_node)
+		return node_inx;
+	return -1;
 }
 
-/* Purge any batch job that should have its script running on node
- * node_inx, but is not. Allow BatchStartTimeout + ResumeTimeout seconds
- * for startup.
+/* Purge any batch job that should have its script running on one of the
+ * nodes in node_inx, but is not. Allow BatchStartTimeout + ResumeTimeout
+ * seconds for startup.
  *
  * Purge all job steps that were started before the node was last booted.
  *
- * Also notify srun if any job steps should be active on this node
+ * Also notify srun if any job steps should be active on these nodes
  * but are not found. */
-static void _purge_missing_jobs(int node_inx, time_t now)
+static void _purge_missing_jobs(int *node_inx, int node_cnt, time_t now)
 {
 	ListIterator job_iterator;
 	struct job_record *job_ptr;
-	struct node_record *node_ptr = node_record_table_ptr + node_inx;
+	struct node_record *node_ptr;
 	uint16_t batch_start_timeout	= slurm_get_batch_start_timeout();
 	uint16_t msg_timeout		= slurm_get_msg_timeout();
 	uint16_t resume_timeout		= slurm_get_resume_timeout();
 	uint32_t suspend_time		= slurm_get_suspend_time();
-	time_t batch_startup_time, node_boot_time = (time_t) 0, startup_time;
+	time_t batch_startup_time, *node_boot_time, startup_time;
+	int i;
 
-	if (node_ptr->boot_time > (msg_timeout + 5)) {
-		/* allow for message timeout and other delays */
-		node_boot_time = node_ptr->boot_time - (msg_timeout + 5);
+	node_boot_time = xmalloc(sizeof(time_t) * node_cnt);
+	for (i = 0; i < node_cnt; i++) {
+		node_ptr = node_record_table_ptr + node_inx[i];
+		if (node_ptr->boot_time > (msg_timeout + 5)) {
+			/* allow for message timeout and other delays */
+			node_boot_time[i] = node_ptr->boot_time -
+					    (msg_timeout + 5);
+		}
 	}
 	batch_startup_time  = now - batch_start_timeout;
 	batch_startup_time -= MIN(DEFAULT_MSG_TIMEOUT, msg_timeout);
 
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
-		bool job_active = IS_JOB_RUNNING(job_ptr) ||
-				  IS_JOB_SUSPENDED(job_ptr);
-
 		if (job_ptr->details && job_ptr->details->prolog_running)
 			continue;
 
-		if ((!job_active) ||
-		    (!bit_test(job_ptr->node_bitmap, node_inx)))
-			continue;
-		if ((job_ptr->batch_flag != 0)			&&
-		    (suspend_time != 0) /* power mgmt on */	&&
-		    (job_ptr->start_time < node_boot_time)) {
-			startup_time = batch_startup_time - resume_timeout;
-		} else
-			startup_time = batch_startup_time;
-
-		if ((job_ptr->batch_flag != 0)			&&
-		    (job_ptr->time_last_active < startup_time)	&&
-		    (job_ptr->start_time       < startup_time)	&&
-		    (node_inx == bit_ffs(job_ptr->node_bitmap))) {
-			bool requeue = false;
-			char *requeue_msg = "";
-			if (job_ptr->details && job_ptr->details->requeue) {
-				requeue = true;
-				requeue_msg = ", Requeuing job";
+		for (i = 0; i < node_cnt; i++) {
+			/* job may have been completed for an earlier node */
+			if ((!IS_JOB_RUNNING(job_ptr) &&
+			     !IS_JOB_SUSPENDED(job_ptr)) ||
+			    (!bit_test(job_ptr->node_bitmap, node_inx[i])))
+				continue;
+			if ((job_ptr->batch_flag != 0)			&&
+			    (suspend_time != 0) /* power mgmt on */	&&
+			    (job_ptr->start_time < node_boot_time[i])) {
+				startup_time = batch_startup_time -
+					       resume_timeout;
+			} else
+				startup_time = batch_startup_time;
+
+			if ((job_ptr->batch_flag != 0)			&&
+			    (job_ptr->time_last_active < startup_time)	&&
+			    (job_ptr->start_time       < startup_time)	&&
+			    (node_inx[i] == bit_ffs(job_ptr->node_bitmap))) {
+				bool requeue = false;
+				char *requeue_msg = "";
+				if (job_ptr->details &&
+				    job_ptr->details->requeue) {
+					requeue = true;
+					requeue_msg = ", Requeuing job";
+				}
+				info("Batch JobId=%u missing from node 0 (not "
+				     "found BatchStartTime after startup)%s",
+				     job_ptr->job_id, requeue_msg);
+				job_ptr->exit_code = 1;
+				job_complete(job_ptr->job_id, 0, requeue, true,
+					     NO_VAL);
+			} else {
+				_notify_srun_missing_step(job_ptr, node_inx[i],
+							  now,
+							  node_boot_time[i]);
 			}
-			info("Batch JobId=%u missing from node 0 (not found "
-			     "BatchStartTime after startup)%s",
-			     job_ptr->job_id, requeue_msg);
-			job_ptr->exit_code = 1;
-			job_complete(job_ptr->job_id, 0, requeue, true, NO_VAL);
-		} else {
-			_notify_srun_missing_step(job_ptr, node_inx,
-						  now, node_boot_time);
 		}
 	}
 	list_iterator_destroy(job_iterator);
+	xfree(node_boot_time);
 }
 
 static void _notify_srun_missing_step(struct job_record *job_ptr, int node_inx,
@@ -12296,12 +12190,33 @@ job_alloc_info(uint32_t uid, uint32_t job_id, struct job_record **job_pptr)
 int sync_job_files(void)
 {
 	List batch_dirs;
+	uint32_t *job_id_ptr;
 
-	if (!slurmctld_primary)	/* Don't purge files from backup slurmctld */
+	/* Import the job directories of prior versions into the store.
+	 * Whichever slurmctld writes the index first must have imported
+	 * them, so the backup imports too, but only the primary removes the
+	 * directories. They are only removed once the index is written, so
+	 * an interrupted import is repeated on the next start. Once all are
+	 * removed, the files are validated from the index alone. */
+	batch_dirs = list_create(_del_batch_list_rec);
+	if (!job_store_load(true) || _get_batch_job_dir_ids(NULL)) {
+		(void) _get_batch_job_dir_ids(batch_dirs);
+		_import_batch_dirs(batch_dirs);
+		if ((job_store_save() == SLURM_SUCCESS) && slurmctld_primary) {
+			while ((job_id_ptr = list_pop(batch_dirs))) {
+				_delete_job_dir(*job_id_ptr);
+				xfree(job_id_ptr);
+			}
+		}
+		list_flush(batch_dirs);
+	}
+	if (!slurmctld_primary) {
+		/* Don't purge files from backup slurmctld */
+		FREE_NULL_LIST(batch_dirs);
 		return SLURM_SUCCESS;
+	}
 
-	batch_dirs = list_create(_del_batch_list_rec);
-	_get_batch_job_dir_ids(batch_dirs);
+	job_store_get_ids(batch_dirs);
 	_validate_job_files(batch_dirs);
 	_remove_defunct_batch_dirs(batch_dirs);
 	FREE_NULL_LIST(batch_dirs);
@@ -12309,23 +12224,26 @@ int sync_job_files(void)
 }
 
 /* Append to the batch_dirs list the job_id's associated with
- *	every batch job directory in existence
+ *	every batch job directory in existence, as written by version 15.08
+ *	and earlier. If batch_dirs is NULL, only test for such directories.
+ * RET true if any batch job directory exists
  * NOTE: READ lock_slurmctld config before entry
  */
-static void _get_batch_job_dir_ids(List batch_dirs)
+static bool _get_batch_job_dir_ids(List batch_dirs)
 {
 	DIR *f_dir, *h_dir;
 	struct dirent *dir_ent, *hash_ent;
 	long long_job_id;
 	uint32_t *job_id_ptr;
 	char *endptr;
+	bool found = false;
 
 	xassert(slurmctld_conf.state_save_location);
 	f_dir = opendir(slurmctld_conf.state_save_location);
 	if (!f_dir) {
 		error("opendir(%s): %m",
 		      slurmctld_conf.state_save_location);
-		return;
+		return false;
 	}
 
 	while ((dir_ent = readdir(f_dir))) {
@@ -12334,6 +12252,9 @@ static void _get_batch_job_dir_ids(List batch_dirs)
 			long_job_id = strtol(&dir_ent->d_name[4], &endptr, 10);
 			if ((long_job_id == 0) || (endptr[0] != '\0'))
 				continue;
+			found = true;
+			if (!batch_dirs)
+				break;
 			debug3("found batch directory for job_id %ld",
 			      long_job_id);
 			job_id_ptr = xmalloc(sizeof(uint32_t));
@@ -12355,6 +12276,9 @@ static void _get_batch_job_dir_ids(List batch_dirs)
 						     &endptr, 10);
 				if ((long_job_id == 0) || (endptr[0] != '\0'))
 					continue;
+				found = true;
+				if (!batch_dirs)
+					break;
 				debug3("Found batch directory for job_id %ld",
 				      long_job_id);
 				job_id_ptr = xmalloc(sizeof(uint32_t));
@@ -12362,10 +12286,52 @@ static void _get_batch_job_dir_ids(List batch_dirs)
 				list_append(batch_dirs, job_id_ptr);
 			}
 			closedir(h_dir);
+			if (found && !batch_dirs)
+				break;
 		}
 	}
 
 	closedir(f_dir);
+	return found;
+}
+
+/* Add the files of every batch job directory in the list to the job store,
+ *	unless already imported by another slurmctld. Directories which can
+ *	not be imported are removed from the list. */
+static void _import_batch_dirs(List batch_dirs)
+{
+	ListIterator batch_dir_iter;
+	uint32_t *job_id_ptr;
+	char *file_name, *env, *script;
+	int env_size, script_size, import_cnt = 0;
+
+	batch_dir_iter = list_iterator_create(batch_dirs);
+	while ((job_id_ptr = list_next(batch_dir_iter))) {
+		if (job_store_test(*job_id_ptr))
+			continue;
+		/* Directories of job array tasks may contain no files */
+		(void) _read_job_file(*job_id_ptr, 0, NO_VAL, "environment",
+				      &file_name, &env, &env_size);
+		xfree(file_name);
+		(void) _read_job_file(*job_id_ptr, 0, NO_VAL, "script",
+				      &file_name, &script, &script_size);
+		xfree(file_name);
+		if (job_store_add(*job_id_ptr, env, env_size,
+				  script, script_size)) {
+			error("Unable to import files of batch job %u",
+			      *job_id_ptr);
+			list_delete_item(batch_dir_iter);
+		} else
+			import_cnt++;
+		xfree(env);
+		xfree(script);
+	}
+	list_iterator_destroy(batch_dir_iter);
+
+	if (import_cnt) {
+		info("Imported files of %d batch jobs into the job store",
+		     import_cnt);
+	}
 }
 
 static int _clear_state_dir_flag(void *x, void *arg)
@@ -12817,6 +12783,7 @@ extern void job_completion_logger(struct job_record *job_ptr, bool requeue)
 
 	xassert(job_ptr);
 
+	depend_notify_job(job_ptr);
 	acct_policy_remove_job_submit(job_ptr);
 	if (job_ptr->nodes) {
 		(void) bb_g_job_start_stage_out(job_ptr);
@@ -13197,6 +13164,7 @@ static int _suspend_job_nodes(struct job_record *job_ptr, bool indf_susp)
 
 	if ((rc = select_g_job_suspend(job_ptr, indf_susp)) != SLURM_SUCCESS)
 		return rc;
+	shape_cache_invalidate();
 
 	for (i=0; i<node_record_count; i++, node_ptr++) {
 		if (bit_test(job_ptr->node_bitmap, i) == 0)
@@ -13789,6 +13757,7 @@ reply:
 
 	if (state & JOB_SPECIAL_EXIT) {
 		job_ptr->job_state |= JOB_SPECIAL_EXIT;
+		depend_notify_job(job_ptr);
 		job_ptr->state_reason = WAIT_HELD_USER;
 		xfree(job_ptr->state_desc);
 		job_ptr->state_desc =
@@ -15016,6 +14985,7 @@ extern void job_hold_requeue(struct job_record *job_ptr)
 		 * it as JOB_SPECIAL_EXIT.
 		 */
 		job_ptr->job_state |= JOB_SPECIAL_EXIT;
+		depend_notify_job(job_ptr);
 		job_ptr->state_reason = WAIT_HELD_USER;
 		job_ptr->priority = 0;
 	}
@@ -15247,6 +15217,7 @@ extern void job_array_post_sched(struct job_record *job_ptr)
 	if (!job_ptr->array_recs || !job_ptr->array_recs->task_id_bitmap)
 		return;
 
+	depend_notify_job(job_ptr);
 	if (job_ptr->array_recs->task_cnt <= 1) {
 		/* Preserve array_recs for min/max exit codes for job array */
 		if (job_ptr->array_recs->task_cnt) {
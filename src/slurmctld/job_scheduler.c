@@ -83,6 +83,7 @@
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/sched_plugin.h"
+#include "src/slurmctld/shape_cache.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/srun_comm.h"
 #include "src/slurmctld/state_save.h"
@@ -129,6 +130,7 @@ static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int sched_pend_thread = 0;
 static bool sched_running = false;
 static struct timeval sched_last = {0, 0};
+static shape_cache_t *sched_shape_cache = NULL;
 #ifdef HAVE_ALPS_CRAY
 static int sched_min_interval = 1000000;
 #else
@@ -775,7 +777,8 @@ next_part:		part_ptr = (struct part_record *)
 			     job_ptr->nodes, job_ptr->total_cpus);
 			if (job_ptr->details->prolog_running == 0) {
 				launch_msg = build_launch_job_msg(job_ptr,
-							msg->protocol_version);
+							msg->protocol_version,
+							true);
 			}
 		}
 		break;
@@ -935,6 +938,13 @@ extern int schedule(uint32_t job_limit)
 	return job_count;
 }
 
+/* Free memory used by the job scheduler, call once it no longer runs */
+extern void schedule_fini(void)
+{
+	shape_cache_destroy(sched_shape_cache);
+	sched_shape_cache = NULL;
+}
+
 /* Thread used to possibly start job scheduler later, if nothing else does */
 static void *_sched_agent(void *args)
 {
@@ -1237,6 +1247,10 @@ static int _schedule(uint32_t job_limit)
 
 	part_cnt = list_count(part_list);
 	failed_parts = xmalloc(sizeof(struct part_record *) * part_cnt);
+	if (!sched_shape_cache)
+		sched_shape_cache = shape_cache_create();
+	else
+		shape_cache_clear(sched_shape_cache);
 	failed_resv = xmalloc(sizeof(struct slurmctld_resv*) * MAX_FAILED_RESV);
 	save_avail_node_bitmap = bit_copy(avail_node_bitmap);
 	bit_not(avail_node_bitmap);
@@ -1569,8 +1583,24 @@ next_task:
 			continue;
 		}
 
-		error_code = select_nodes(job_ptr, false, NULL,
-					  unavail_node_str, NULL);
+		if (shape_cache_test(sched_shape_cache, job_ptr, NULL)) {
+			/* Identical job already failed to get resources */
+			slurmctld_diag_stats.schedule_shape_hits++;
+			job_ptr->state_reason = WAIT_RESOURCES;
+			xfree(job_ptr->state_desc);
+			slurm_sched_g_job_is_pending();
+			error_code = ESLURM_NODES_BUSY;
+		} else {
+			slurmctld_diag_stats.schedule_shape_misses++;
+			error_code = select_nodes(job_ptr, false, NULL,
+						  unavail_node_str, NULL);
+			if ((error_code == ESLURM_NODES_BUSY) &&
+			    (job_ptr->state_reason == WAIT_RESOURCES) &&
+			    !job_ptr->preempt_in_progress) {
+				shape_cache_add(sched_shape_cache, job_ptr,
+						(time_t) 0);
+			}
+		}
 		fail_by_part = false;
 		if ((error_code == ESLURM_NODES_BUSY) ||
 		    (error_code == ESLURM_POWER_NOT_AVAIL) ||
@@ -1878,9 +1908,12 @@ extern int sort_job_queue2(void *x, void *y)
 	return -1;
 }
 
-/* Given a scheduled job, return a pointer to it batch_job_launch_msg_t data */
+/* Given a scheduled job, return a pointer to it batch_job_launch_msg_t data.
+ * If load_files is false the script and environment are not read, the caller
+ * must use load_job_launch_data() without holding the job lock. */
 extern batch_job_launch_msg_t *build_launch_job_msg(struct job_record *job_ptr,
-						    uint16_t protocol_version)
+						    uint16_t protocol_version,
+						    bool load_files)
 {
 	batch_job_launch_msg_t *launch_msg_ptr;
 	struct passwd pwd, *result;
@@ -1895,7 +1928,8 @@ extern batch_job_launch_msg_t *build_launch_job_msg(struct job_record *job_ptr,
 	launch_msg_ptr->array_task_id = job_ptr->array_task_id;
 	launch_msg_ptr->uid = job_ptr->user_id;
 
-	if ((launch_msg_ptr->script = get_job_script(job_ptr)) == NULL) {
+	if (load_files &&
+	    ((launch_msg_ptr->script = get_job_script(job_ptr)) == NULL)) {
 		error("Can not find batch script, Aborting batch job %u",
 		      job_ptr->job_id);
 		/* FIXME: This is a kludge, but this event indicates a missing
@@ -1967,9 +2001,11 @@ extern batch_job_launch_msg_t *build_launch_job_msg(struct job_record *job_ptr,
 	launch_msg_ptr->spank_job_env_size = job_ptr->spank_job_env_size;
 	launch_msg_ptr->spank_job_env = xduparray(job_ptr->spank_job_env_size,
 						  job_ptr->spank_job_env);
-	launch_msg_ptr->environment = get_job_env(job_ptr,
-						  &launch_msg_ptr->envc);
-	if (launch_msg_ptr->environment == NULL) {
+	if (load_files) {
+		launch_msg_ptr->environment = get_job_env(job_ptr,
+						&launch_msg_ptr->envc);
+	}
+	if (load_files && (launch_msg_ptr->environment == NULL)) {
 		error("%s: environment missing or corrupted aborting job %u",
 		      __func__, job_ptr->job_id);
 		slurm_free_job_launch_msg(launch_msg_ptr);
@@ -2033,7 +2069,10 @@ extern void launch_job(struct job_record *job_ptr)
 		protocol_version = node_ptr->protocol_version;
 #endif
 
-	launch_msg_ptr = build_launch_job_msg(job_ptr, protocol_version);
+	/* Leave reading the script and environment to the agent thread, out
+	 * of the job lock, unless supplemental variables must be added */
+	launch_msg_ptr = build_launch_job_msg(job_ptr, protocol_version,
+					      (job_ptr->details->env_cnt != 0));
 	if (launch_msg_ptr == NULL)
 		return;
 
@@ -2126,6 +2165,125 @@ static void _depend_list_del(void *dep_ptr)
 	xfree(dep_ptr);
 }
 
+/*
+ * Reverse dependency index. For every job ID which other jobs have been found
+ * to depend upon, keep a sequence number which changes whenever that job (or
+ * any task of that job array) changes state in a way which can satisfy or
+ * fail a dependency. A dependency found unsatisfied records the sequence
+ * number and is not evaluated again until it changes, so pending dependent
+ * jobs are only re-examined after an event on one of their dependees.
+ * Records are removed when any job record with that ID is purged.
+ * Protected by the job write lock.
+ */
+#define DEPEND_HASH_SIZE	4096
+#define DEPEND_HASH_INX(_id)	((_id) % DEPEND_HASH_SIZE)
+
+typedef struct depend_event {
+	uint32_t job_id;		/* dependee job ID or array job ID */
+	uint32_t seq;			/* changes on each event, never 0 */
+	struct depend_event *next;	/* next record in hash bucket */
+} depend_event_t;
+
+static depend_event_t *depend_hash[DEPEND_HASH_SIZE];
+static uint32_t depend_last_seq = 0;
+
+static uint32_t _depend_next_seq(void)
+{
+	if (++depend_last_seq == 0)
+		depend_last_seq = 1;
+	return depend_last_seq;
+}
+
+static depend_event_t *_depend_event_find(uint32_t job_id)
+{
+	depend_event_t *ev_ptr;
+
+	for (ev_ptr = depend_hash[DEPEND_HASH_INX(job_id)]; ev_ptr;
+	     ev_ptr = ev_ptr->next) {
+		if (ev_ptr->job_id == job_id)
+			return ev_ptr;
+	}
+	return NULL;
+}
+
+/* Return the current event sequence number of a dependee, creating its
+ * record if needed */
+static uint32_t _depend_event_seq(uint32_t job_id)
+{
+	depend_event_t *ev_ptr;
+	int inx;
+
+	if ((ev_ptr = _depend_event_find(job_id)))
+		return ev_ptr->seq;
+
+	inx = DEPEND_HASH_INX(job_id);
+	ev_ptr = xmalloc(sizeof(depend_event_t));
+	ev_ptr->job_id = job_id;
+	ev_ptr->seq = _depend_next_seq();
+	ev_ptr->next = depend_hash[inx];
+	depend_hash[inx] = ev_ptr;
+	return ev_ptr->seq;
+}
+
+static void _depend_event_delete(uint32_t job_id)
+{
+	depend_event_t **ev_pptr, *ev_ptr;
+
+	ev_pptr = &depend_hash[DEPEND_HASH_INX(job_id)];
+	while ((ev_ptr = *ev_pptr)) {
+		if (ev_ptr->job_id == job_id) {
+			*ev_pptr = ev_ptr->next;
+			xfree(ev_ptr);
+			return;
+		}
+		ev_pptr = &ev_ptr->next;
+	}
+}
+
+extern void depend_notify_job(struct job_record *job_ptr)
+{
+	depend_event_t *ev_ptr;
+
+	if ((ev_ptr = _depend_event_find(job_ptr->job_id)))
+		ev_ptr->seq = _depend_next_seq();
+	if (job_ptr->array_task_id != NO_VAL) {
+		if ((job_ptr->array_job_id != job_ptr->job_id) &&
+		    (ev_ptr = _depend_event_find(job_ptr->array_job_id)))
+			ev_ptr->seq = _depend_next_seq();
+	}
+}
+
+extern void depend_purge_job(struct job_record *job_ptr)
+{
+	_depend_event_delete(job_ptr->job_id);
+	if ((job_ptr->array_task_id != NO_VAL) &&
+	    (job_ptr->array_job_id != job_ptr->job_id))
+		_depend_event_delete(job_ptr->array_job_id);
+}
+
+/* Return true if every dependency of a job was found unsatisfied and none of
+ * the dependees changed state since */
+static bool _depend_unchanged(List depend_list)
+{
+	ListIterator depend_iter;
+	struct depend_spec *dep_ptr;
+	depend_event_t *ev_ptr;
+	bool unchanged = true;
+
+	depend_iter = list_iterator_create(depend_list);
+	while ((dep_ptr = list_next(depend_iter))) {
+		if ((dep_ptr->depend_seq == 0) ||
+		    !(ev_ptr = _depend_event_find(dep_ptr->job_id)) ||
+		    (ev_ptr->seq != dep_ptr->depend_seq)) {
+			unchanged = false;
+			break;
+		}
+	}
+	list_iterator_destroy(depend_iter);
+
+	return unchanged;
+}
+
 /*
  * Copy a job's dependency list
  * IN depend_list_src - a job's depend_lst
@@ -2301,12 +2459,24 @@ extern int test_job_dependency(struct job_record *job_ptr)
 		return cache_results;
 	}
 
+	if (_depend_unchanged(job_ptr->details->depend_list))
+		return 1;
+
 	depend_iter = list_iterator_create(job_ptr->details->depend_list);
 	while ((dep_ptr = list_next(depend_iter))) {
 		bool clear_dep = false;
+		dep_ptr->depend_seq = 0;
 		dep_ptr->job_ptr = find_job_array_rec(dep_ptr->job_id,
 						      dep_ptr->array_task_id);
 		djob_ptr = dep_ptr->job_ptr;
+		/* Only the dependee's state matters for these dependency types,
+		 * so the result can be reused until the dependee changes */
+		if (djob_ptr &&
+		    ((dep_ptr->depend_type == SLURM_DEPEND_AFTER) ||
+		     (dep_ptr->depend_type == SLURM_DEPEND_AFTER_ANY) ||
+		     (dep_ptr->depend_type == SLURM_DEPEND_AFTER_NOT_OK) ||
+		     (dep_ptr->depend_type == SLURM_DEPEND_AFTER_OK)))
+			dep_ptr->depend_seq = _depend_event_seq(dep_ptr->job_id);
  		if ((dep_ptr->depend_type == SLURM_DEPEND_SINGLETON) &&
  		    job_ptr->name) {
  			/* get user jobs with the same user and name */
@@ -2450,6 +2620,16 @@ extern int test_job_dependency(struct job_record *job_ptr)
 	else if (depends)
 		results = 1;
 
+	/* Only remaining dependencies may be reused, and not after a loop
+	 * exit which left some of them untested */
+	if ((results != 1) && job_ptr->details->depend_list) {
+		depend_iter = list_iterator_create(
+			job_ptr->details->depend_list);
+		while ((dep_ptr = list_next(depend_iter)))
+			dep_ptr->depend_seq = 0;
+		list_iterator_destroy(depend_iter);
+	}
+
 	if ((job_ptr->array_task_id != NO_VAL) &&
 	    (job_ptr->array_recs == NULL)) {
 		cache_job_id  = job_ptr->job_id;
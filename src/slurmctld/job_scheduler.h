@@ -70,10 +70,13 @@ extern int build_feature_list(struct job_record *job_ptr);
  */
 extern List build_job_queue(bool clear_start, bool backfill);
 
-/* Given a scheduled job, return a pointer to it batch_job_launch_msg_t data */
+/* Given a scheduled job, return a pointer to it batch_job_launch_msg_t data.
+ * If load_files is false the script and environment are not read, the caller
+ * must use load_job_launch_data() without holding the job lock. */
 extern batch_job_launch_msg_t *build_launch_job_msg(
 					struct job_record *job_ptr,
-					uint16_t protocol_versin);
+					uint16_t protocol_versin,
+					bool load_files);
 /*
  * epilog_slurmctld - execute the prolog_slurmctld for a job that has just
  *	terminated.
@@ -169,6 +172,9 @@ extern bool replace_batch_job(slurm_msg_t * msg, void *fini_job, bool locked);
  */
 extern int schedule(uint32_t job_limit);
 
+/* Free memory used by the job scheduler, call once it no longer runs */
+extern void schedule_fini(void);
+
 /*
  * set_job_elig_time - set the eligible time for pending jobs once their
  *	dependencies are lifted (in job->details->begin_time)
@@ -193,6 +199,19 @@ extern int sort_job_queue2(void *x, void *y);
  */
 extern int test_job_dependency(struct job_record *job_ptr);
 
+/*
+ * Note that a job started, ended or was requeued, which may change the state
+ * of other jobs' dependencies upon it (or upon its job array)
+ * NOTE: Call with job write lock set
+ */
+extern void depend_notify_job(struct job_record *job_ptr);
+
+/*
+ * Note that a job record is being purged
+ * NOTE: Call with job write lock set
+ */
+extern void depend_purge_job(struct job_record *job_ptr);
+
 /*
  * Parse a job dependency string and use it to establish a "depend_spec"
  * list of dependencies. We accept both old format (a single job ID) and
@@ -0,0 +1,704 @@
+/*****************************************************************************\
+ *  job_store.c - Content addressed store of batch job script and environment
+ *	files under StateSaveLocation, shared by jobs with identical contents
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "slurm/slurm_errno.h"
+
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmctld/job_file_cache.h"
+#include "src/slurmctld/job_store.h"
+#include "src/slurmctld/state_save.h"
+
+#define JOB_STORE_FILE_CNT	2
+#define JOB_STORE_INDEX		"/job_store_index"
+#define JOB_STORE_PROBE_MAX	16	/* blob keys tried on hash collision */
+#define JOB_STORE_STALE_MIN	1000	/* stale records before index rewrite */
+
+typedef struct job_blob {
+	char *key;		/* content hash and size, also the file name */
+	int ref_cnt;		/* count of job_store_rec_t using this blob */
+} job_blob_t;
+
+typedef struct job_store_rec {
+	char id[16];		/* job ID as a string, hash table key */
+	uint32_t job_id;
+	job_blob_t *blob[JOB_STORE_FILE_CNT];	/* NULL if no such file */
+} job_store_rec_t;
+
+static const char *job_store_files[JOB_STORE_FILE_CNT] =
+	{ "environment", "script" };
+
+static pthread_mutex_t job_store_mutex = PTHREAD_MUTEX_INITIALIZER;
+static xhash_t *blob_hash = NULL;	/* job_blob_t by key */
+static xhash_t *rec_hash = NULL;	/* job_store_rec_t by job ID */
+static bool index_exists = false;	/* index file was read or written */
+static bool index_pending = false;	/* write index at job_store_save() */
+static off_t index_size = 0;		/* bytes of index file processed */
+static int stale_rec_cnt = 0;		/* superseded records in index */
+
+static const char *_blob_id(void *item)
+{
+	job_blob_t *blob = (job_blob_t *) item;
+	return blob->key;
+}
+
+static void _blob_free(void *item)
+{
+	job_blob_t *blob = (job_blob_t *) item;
+
+	if (blob) {
+		xfree(blob->key);
+		xfree(blob);
+	}
+}
+
+/* Return a blob's path name, must be xfreed */
+static char *_blob_path(const char *key)
+{
+	char *path = slurm_get_state_save_location();
+
+	/* Spread blobs over directories, as done with job directories, due
+	 * to limits on the number of files in a directory on some file
+	 * system types */
+	xstrfmtcat(path, "/blob.%d/%s",
+		   (int) (strtoull(key, NULL, 16) % 10), key);
+	return path;
+}
+
+/* Return the blob with a given key, creating it if needed */
+static job_blob_t *_blob_get(const char *key)
+{
+	job_blob_t *blob;
+
+	if (!(blob = xhash_get(blob_hash, key))) {
+		blob = xmalloc(sizeof(job_blob_t));
+		blob->key = xstrdup(key);
+		xhash_add(blob_hash, blob);
+	}
+	return blob;
+}
+
+/* Release a reference to a blob. If no longer used, forget the blob and
+ * optionally delete its file */
+static void _blob_unref(job_blob_t *blob, bool remove_file)
+{
+	char *path;
+
+	if (!blob || (--blob->ref_cnt > 0))
+		return;
+	if (remove_file) {
+		path = _blob_path(blob->key);
+		job_file_cache_remove(path);
+		if ((unlink(path) < 0) && (errno != ENOENT))
+			error("unlink(%s): %m", path);
+		xfree(path);
+	}
+	xhash_delete(blob_hash, blob->key);
+}
+
+static const char *_rec_id(void *item)
+{
+	job_store_rec_t *rec = (job_store_rec_t *) item;
+	return rec->id;
+}
+
+static job_store_rec_t *_rec_create(uint32_t job_id)
+{
+	job_store_rec_t *rec = xmalloc(sizeof(job_store_rec_t));
+
+	snprintf(rec->id, sizeof(rec->id), "%u", job_id);
+	rec->job_id = job_id;
+	return rec;
+}
+
+/* Free a record, releasing its blobs and optionally deleting their files.
+ * Records are only removed from the index file by job_store_delete(), in
+ * other cases the files may still be in use. */
+static void _rec_release(job_store_rec_t *rec, bool remove_files)
+{
+	int i;
+
+	if (!rec)
+		return;
+	for (i = 0; i < JOB_STORE_FILE_CNT; i++)
+		_blob_unref(rec->blob[i], remove_files);
+	xfree(rec);
+}
+
+static void _rec_free(void *item)
+{
+	_rec_release((job_store_rec_t *) item, false);
+}
+
+/* Return the index of a file name in a record's blob array, -1 if invalid */
+static int _file_inx(const char *name)
+{
+	int i;
+
+	for (i = 0; i < JOB_STORE_FILE_CNT; i++) {
+		if (!strcmp(name, job_store_files[i]))
+			return i;
+	}
+	return -1;
+}
+
+/* Read a file into a NUL terminated buffer, RET 0 on success, -1 on error */
+static int _read_file(char *file_name, char **data, int *size)
+{
+	int fd, pos = 0, buf_size = BUF_SIZE, amount;
+	char *buffer;
+
+	*data = NULL;
+	*size = 0;
+	if ((fd = open(file_name, O_RDONLY)) < 0)
+		return -1;
+
+	buffer = xmalloc(buf_size + 1);
+	while (1) {
+		amount = read(fd, &buffer[pos], buf_size - pos);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			error("Error reading file %s, %m", file_name);
+			xfree(buffer);
+			close(fd);
+			return -1;
+		}
+		if (amount == 0)	/* end of file */
+			break;
+		pos += amount;
+		if (pos == buf_size) {
+			buf_size *= 2;
+			xrealloc(buffer, buf_size + 1);
+		}
+	}
+	close(fd);
+
+	*data = buffer;
+	*size = pos;
+	return 0;
+}
+
+/* Write a file by replacing it with a new one, so that readers never see
+ * partial contents. RET SLURM_SUCCESS or ESLURM_WRITING_TO_FILE */
+static int _write_file(char *file_name, char *data, int size)
+{
+	char *new_file = NULL;
+	int fd, pos = 0, amount, rc = SLURM_SUCCESS;
+
+	xstrfmtcat(new_file, "%s.new", file_name);
+	fd = creat(new_file, 0600);
+	if (fd < 0) {
+		error("Error creating file %s, %m", new_file);
+		xfree(new_file);
+		return ESLURM_WRITING_TO_FILE;
+	}
+
+	while (pos < size) {
+		amount = write(fd, &data[pos], size - pos);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			error("Error writing file %s, %m", new_file);
+			rc = ESLURM_WRITING_TO_FILE;
+			break;
+		}
+		pos += amount;
+	}
+	if (fsync_and_close(fd, "job store") && (rc == SLURM_SUCCESS))
+		rc = ESLURM_WRITING_TO_FILE;
+
+	if ((rc == SLURM_SUCCESS) && (rename(new_file, file_name) < 0)) {
+		error("rename(%s, %s): %m", new_file, file_name);
+		rc = ESLURM_WRITING_TO_FILE;
+	}
+	if (rc != SLURM_SUCCESS)
+		(void) unlink(new_file);
+	xfree(new_file);
+	return rc;
+}
+
+/* Return a reference to a blob with the given contents, writing its file if
+ * no such blob exists. RET NULL on error */
+static job_blob_t *_blob_ref(char *data, int size)
+{
+	job_blob_t *blob = NULL;
+	char *base, *key = NULL, *path, *old_data;
+	int i, old_size;
+
+	base = job_file_cache_key(data, size);
+	for (i = 0; i < JOB_STORE_PROBE_MAX; i++) {
+		if (i == 0)
+			key = xstrdup(base);
+		else
+			xstrfmtcat(key, "%s.%d", base, i);
+		path = _blob_path(key);
+
+		if (!(blob = xhash_get(blob_hash, key))) {
+			char *dir_name = xstrdup(path);
+			*strrchr(dir_name, '/') = '\0';
+			(void) mkdir(dir_name, 0700);
+			xfree(dir_name);
+			if (_write_file(path, data, size) == SLURM_SUCCESS) {
+				job_file_cache_add(path, data, size);
+				blob = _blob_get(key);
+			}
+			xfree(path);
+			break;
+		}
+
+		/* Never trust the hash alone, contents from different users
+		 * must not be confused */
+		if ((job_store_read_file(path, &old_data, &old_size) == 0) &&
+		    (old_size == size) && !memcmp(old_data, data, size)) {
+			xfree(old_data);
+			xfree(path);
+			break;
+		}
+		xfree(old_data);
+		xfree(path);
+		xfree(key);
+		blob = NULL;
+	}
+	xfree(key);
+	xfree(base);
+
+	if (blob)
+		blob->ref_cnt++;
+	return blob;
+}
+
+/* Return the index file's path name, must be xfreed */
+static char *_index_name(void)
+{
+	char *file_name = slurm_get_state_save_location();
+
+	xstrcat(file_name, JOB_STORE_INDEX);
+	return file_name;
+}
+
+/* Format a record as a line of the index file */
+static void _index_line(job_store_rec_t *rec, char **line)
+{
+	int i;
+
+	xstrfmtcat(*line, "A %u", rec->job_id);
+	for (i = 0; i < JOB_STORE_FILE_CNT; i++) {
+		xstrfmtcat(*line, " %s",
+			   rec->blob[i] ? rec->blob[i]->key : "-");
+	}
+	xstrcat(*line, "\n");
+}
+
+static void _index_line_walk(void *item, void *arg)
+{
+	_index_line((job_store_rec_t *) item, (char **) arg);
+}
+
+/* Read the index file, adding its records to those in memory.
+ * IN tail - only read records appended since it was last read or written
+ *	(e.g. by another slurmctld daemon) */
+static void _index_read(bool tail)
+{
+	char *file_name, *data = NULL, *line, *save_ptr = NULL;
+	char key[JOB_STORE_FILE_CNT][64];
+	job_store_rec_t *rec, *old_rec;
+	uint32_t job_id;
+	int i, size = 0;
+
+	file_name = _index_name();
+	if (_read_file(file_name, &data, &size) < 0) {
+		xfree(file_name);
+		return;
+	}
+	index_exists = true;
+
+	line = data;
+	if (tail)
+		line += MIN(index_size, size);
+	line = strtok_r(line, "\n", &save_ptr);
+	while (line) {
+		if (sscanf(line, "A %u %63s %63s",
+			   &job_id, key[0], key[1]) == 3) {
+			rec = _rec_create(job_id);
+			if ((old_rec = xhash_pop(rec_hash, rec->id))) {
+				_rec_release(old_rec, false);
+				stale_rec_cnt++;
+			}
+			for (i = 0; i < JOB_STORE_FILE_CNT; i++) {
+				if (!strcmp(key[i], "-"))
+					continue;
+				rec->blob[i] = _blob_get(key[i]);
+				rec->blob[i]->ref_cnt++;
+			}
+			xhash_add(rec_hash, rec);
+		} else if (sscanf(line, "D %u", &job_id) == 1) {
+			rec = _rec_create(job_id);
+			_rec_release(xhash_pop(rec_hash, rec->id), false);
+			_rec_release(rec, false);
+			stale_rec_cnt += 2;
+		} else {
+			error("%s: invalid record in %s: %s",
+			      __func__, file_name, line);
+		}
+		line = strtok_r(NULL, "\n", &save_ptr);
+	}
+	index_size = size;
+
+	xfree(data);
+	xfree(file_name);
+}
+
+/* Read the index file if not already done */
+static void _index_load(void)
+{
+	if (rec_hash)
+		return;
+	blob_hash = xhash_init(_blob_id, _blob_free, NULL, 0);
+	rec_hash = xhash_init(_rec_id, _rec_free, NULL, 0);
+	index_exists = false;
+	index_size = 0;
+	stale_rec_cnt = 0;
+	_index_read(false);
+}
+
+/* Write all records in memory as a new index file */
+static int _index_save(void)
+{
+	char *file_name, *data = NULL;
+	int rc;
+
+	xhash_walk(rec_hash, _index_line_walk, &data);
+	file_name = _index_name();
+	rc = _write_file(file_name, data ? data : "",
+			 data ? strlen(data) : 0);
+	if (rc == SLURM_SUCCESS) {
+		index_exists = true;
+		index_size = data ? strlen(data) : 0;
+		stale_rec_cnt = 0;
+	}
+	xfree(file_name);
+	xfree(data);
+	return rc;
+}
+
+/* Append a line to the index file, or rewrite the file if it has too many
+ * stale records. The file is left unchanged on error.
+ * RET SLURM_SUCCESS or ESLURM_WRITING_TO_FILE */
+static int _index_append(char *line)
+{
+	char *file_name;
+	int fd, pos = 0, size, amount, rc = SLURM_SUCCESS;
+	off_t start;
+
+	if (index_pending)
+		return SLURM_SUCCESS;
+	if (stale_rec_cnt > MAX(JOB_STORE_STALE_MIN, xhash_count(rec_hash)))
+		return _index_save();
+
+	file_name = _index_name();
+	fd = open(file_name, O_WRONLY | O_APPEND | O_CREAT, 0600);
+	if (fd < 0) {
+		error("Error opening file %s, %m", file_name);
+		xfree(file_name);
+		return ESLURM_WRITING_TO_FILE;
+	}
+	start = lseek(fd, 0, SEEK_END);
+	size = strlen(line);
+	while (pos < size) {
+		amount = write(fd, &line[pos], size - pos);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			error("Error writing file %s, %m", file_name);
+			rc = ESLURM_WRITING_TO_FILE;
+			break;
+		}
+		pos += amount;
+	}
+	if (fsync_and_close(fd, "job store index") && (rc == SLURM_SUCCESS))
+		rc = ESLURM_WRITING_TO_FILE;
+
+	if (rc == SLURM_SUCCESS) {
+		index_exists = true;
+		index_size += pos;
+	} else if ((start >= 0) && (truncate(file_name, start) < 0)) {
+		/* Never leave a partial record to be joined with the next */
+		error("truncate(%s): %m", file_name);
+	}
+	xfree(file_name);
+	return rc;
+}
+
+/* Add a record to memory and to the index file. On error the record is
+ * released, along with any blob files no other job uses.
+ * RET SLURM_SUCCESS or ESLURM_WRITING_TO_FILE */
+static int _rec_add(job_store_rec_t *rec)
+{
+	char *line = NULL;
+	int rc;
+
+	xhash_add(rec_hash, rec);
+	_index_line(rec, &line);
+	if ((rc = _index_append(line)) != SLURM_SUCCESS) {
+		error("Unable to record job %u in the job store index",
+		      rec->job_id);
+		_rec_release(xhash_pop(rec_hash, rec->id), true);
+	}
+	xfree(line);
+	return rc;
+}
+
+extern int job_store_add(uint32_t job_id, char *env, int env_size,
+			 char *script, int script_size)
+{
+	char *data[JOB_STORE_FILE_CNT] = { env, script };
+	int size[JOB_STORE_FILE_CNT] = { env_size, script_size };
+	job_store_rec_t *rec;
+	int i, rc = SLURM_SUCCESS;
+
+	slurm_mutex_lock(&job_store_mutex);
+	_index_load();
+	rec = _rec_create(job_id);
+	if (xhash_get(rec_hash, rec->id)) {
+		error("Apparent duplicate job ID %u. Two primary "
+		      "slurmctld daemons might currently be active", job_id);
+		_rec_release(rec, false);
+		rc = ESLURM_WRITING_TO_FILE;
+		goto fini;
+	}
+	for (i = 0; i < JOB_STORE_FILE_CNT; i++) {
+		if (!data[i])
+			continue;
+		if (!(rec->blob[i] = _blob_ref(data[i], size[i]))) {
+			_rec_release(rec, true);
+			rc = ESLURM_WRITING_TO_FILE;
+			goto fini;
+		}
+	}
+	rc = _rec_add(rec);
+
+fini:
+	slurm_mutex_unlock(&job_store_mutex);
+	return rc;
+}
+
+extern int job_store_copy(uint32_t job_id_src, uint32_t job_id_dest)
+{
+	job_store_rec_t *rec, *src_rec;
+	char id[16];
+	int i, rc = SLURM_SUCCESS;
+
+	slurm_mutex_lock(&job_store_mutex);
+	_index_load();
+	rec = _rec_create(job_id_dest);
+	if (xhash_get(rec_hash, rec->id)) {
+		error("Apparent duplicate job ID %u. Two primary "
+		      "slurmctld daemons might currently be active",
+		      job_id_dest);
+		_rec_release(rec, false);
+		rc = ESLURM_WRITING_TO_FILE;
+		goto fini;
+	}
+	snprintf(id, sizeof(id), "%u", job_id_src);
+	if ((src_rec = xhash_get(rec_hash, id))) {
+		for (i = 0; i < JOB_STORE_FILE_CNT; i++) {
+			if ((rec->blob[i] = src_rec->blob[i]))
+				rec->blob[i]->ref_cnt++;
+		}
+	}
+	rc = _rec_add(rec);
+
+fini:
+	slurm_mutex_unlock(&job_store_mutex);
+	return rc;
+}
+
+extern bool job_store_delete(uint32_t job_id)
+{
+	job_store_rec_t *rec;
+	char id[16], *line = NULL;
+
+	snprintf(id, sizeof(id), "%u", job_id);
+	slurm_mutex_lock(&job_store_mutex);
+	_index_load();
+	if ((rec = xhash_pop(rec_hash, id))) {
+		_rec_release(rec, true);
+		stale_rec_cnt += 2;
+		xstrfmtcat(line, "D %u\n", job_id);
+		(void) _index_append(line);
+		xfree(line);
+	}
+	slurm_mutex_unlock(&job_store_mutex);
+
+	return (rec != NULL);
+}
+
+extern bool job_store_test(uint32_t job_id)
+{
+	char id[16], *file_name;
+	struct stat sbuf;
+	bool found;
+
+	snprintf(id, sizeof(id), "%u", job_id);
+	slurm_mutex_lock(&job_store_mutex);
+	_index_load();
+	found = (xhash_get(rec_hash, id) != NULL);
+	if (!found && index_exists && !index_pending) {
+		file_name = _index_name();
+		if ((stat(file_name, &sbuf) == 0) &&
+		    (sbuf.st_size != index_size)) {
+			error("%s modified by another slurmctld, two primary "
+			      "slurmctld daemons might currently be active",
+			      file_name);
+			_index_read(true);
+			found = (xhash_get(rec_hash, id) != NULL);
+		}
+		xfree(file_name);
+	}
+	slurm_mutex_unlock(&job_store_mutex);
+
+	return found;
+}
+
+extern int job_store_read(uint32_t job_id, const char *name,
+			  char **file_name, char **data, int *size)
+{
+	job_store_rec_t *rec;
+	char id[16], *path = NULL;
+	int inx, rc = -1;
+
+	*file_name = NULL;
+	*data = NULL;
+	*size = 0;
+	if ((inx = _file_inx(name)) < 0)
+		return -1;
+
+	snprintf(id, sizeof(id), "%u", job_id);
+	slurm_mutex_lock(&job_store_mutex);
+	_index_load();
+	if ((rec = xhash_get(rec_hash, id)) && rec->blob[inx])
+		path = _blob_path(rec->blob[inx]->key);
+	slurm_mutex_unlock(&job_store_mutex);
+
+	if (path && ((rc = job_store_read_file(path, data, size)) == 0))
+		*file_name = path;
+	else
+		xfree(path);
+	return rc;
+}
+
+extern int job_store_read_file(char *file_name, char **data, int *size)
+{
+	if (job_file_cache_get(file_name, data, size))
+		return 0;
+	if (_read_file(file_name, data, size) < 0)
+		return -1;
+	job_file_cache_add(file_name, *data, *size);
+	return 0;
+}
+
+static void _append_id(void *item, void *arg)
+{
+	job_store_rec_t *rec = (job_store_rec_t *) item;
+	uint32_t *job_id_ptr = xmalloc(sizeof(uint32_t));
+
+	*job_id_ptr = rec->job_id;
+	list_append((List) arg, job_id_ptr);
+}
+
+extern void job_store_get_ids(List job_ids)
+{
+	slurm_mutex_lock(&job_store_mutex);
+	_index_load();
+	xhash_walk(rec_hash, _append_id, job_ids);
+	slurm_mutex_unlock(&job_store_mutex);
+}
+
+/* Free the records in memory without deleting any files */
+static void _free_recs(void)
+{
+	xhash_free(rec_hash);
+	xhash_free(blob_hash);
+}
+
+extern bool job_store_load(bool defer_index)
+{
+	bool rc;
+
+	slurm_mutex_lock(&job_store_mutex);
+	_free_recs();
+	_index_load();
+	rc = index_exists;
+	index_pending = defer_index && !index_exists;
+	slurm_mutex_unlock(&job_store_mutex);
+
+	return rc;
+}
+
+extern int job_store_save(void)
+{
+	int rc;
+
+	slurm_mutex_lock(&job_store_mutex);
+	_index_load();
+	if ((rc = _index_save()) == SLURM_SUCCESS)
+		index_pending = false;
+	slurm_mutex_unlock(&job_store_mutex);
+
+	return rc;
+}
+
+extern void job_store_fini(void)
+{
+	slurm_mutex_lock(&job_store_mutex);
+	_free_recs();
+	slurm_mutex_unlock(&job_store_mutex);
+}
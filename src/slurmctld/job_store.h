@@ -0,0 +1,126 @@
+/*****************************************************************************\
+ *  job_store.h - Content addressed store of batch job script and environment
+ *	files under StateSaveLocation, shared by jobs with identical contents
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+
+#ifndef _JOB_STORE_H
+#define _JOB_STORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "src/common/list.h"
+
+/*
+ * The job store keeps each distinct batch job script and environment once,
+ * as a "blob" file named by a hash of its contents, with a reference count
+ * of the jobs using it. The jobs and the blobs they use are recorded in an
+ * index file which is appended to as jobs are added and removed, and
+ * rewritten when it contains many stale records.
+ *
+ * Files are named "environment" and "script", as in the job directories of
+ * prior versions. All functions may be called without slurmctld locks.
+ */
+
+/*
+ * job_store_add - Record a job's environment and script, writing the data
+ *	only if no other job has identical contents
+ * IN job_id - job to add, must not already be in the store
+ * IN env, env_size - environment file contents, NULL if none
+ * IN script, script_size - script file contents, NULL if none
+ * RET SLURM_SUCCESS or ESLURM_WRITING_TO_FILE
+ */
+extern int job_store_add(uint32_t job_id, char *env, int env_size,
+			 char *script, int script_size);
+
+/*
+ * job_store_copy - Make a job use the same files as another job, used for
+ *	job array tasks. If the source job is not in the store, the new job is
+ *	recorded without any files.
+ * RET SLURM_SUCCESS or ESLURM_WRITING_TO_FILE
+ */
+extern int job_store_copy(uint32_t job_id_src, uint32_t job_id_dest);
+
+/*
+ * job_store_delete - Remove a job from the store, deleting any files no
+ *	longer used by other jobs
+ * RET true if the job was in the store
+ */
+extern bool job_store_delete(uint32_t job_id);
+
+/* Return true if the job is in the store. Also tests for records appended
+ * to the index by another slurmctld daemon */
+extern bool job_store_test(uint32_t job_id);
+
+/*
+ * job_store_read - Read one of a job's files from the store
+ * IN job_id - job whose file is needed
+ * IN name - "environment" or "script"
+ * OUT file_name - path name of the file read, must be xfreed
+ * OUT data - NUL terminated file contents, must be xfreed
+ * OUT size - bytes in data, excluding the added NUL
+ * RET 0 on success, -1 if the job or file is not in the store
+ */
+extern int job_store_read(uint32_t job_id, const char *name,
+			  char **file_name, char **data, int *size);
+
+/*
+ * job_store_read_file - Read a file, from the job file cache if possible
+ * IN file_name - path name of the file
+ * OUT data - NUL terminated file contents, must be xfreed
+ * OUT size - bytes in data, excluding the added NUL
+ * RET 0 on success, -1 on error
+ */
+extern int job_store_read_file(char *file_name, char **data, int *size);
+
+/* Append to the list the job ID (uint32_t, xmalloced) of every job in the
+ * store */
+extern void job_store_get_ids(List job_ids);
+
+/*
+ * job_store_load - (Re)read the store's index, call when the slurmctld takes
+ *	control as its contents may have been changed by another daemon
+ * IN defer_index - if no index exists, keep records in memory only until
+ *	job_store_save() is called, so that the job directories of prior
+ *	versions can all be imported before an index is written
+ * RET true if an index exists
+ */
+extern bool job_store_load(bool defer_index);
+
+/* Rewrite the store's index without stale records */
+extern int job_store_save(void);
+
+/* Free all memory associated with the job store */
+extern void job_store_fini(void);
+
+#endif /* !_JOB_STORE_H */
@@ -48,6 +48,7 @@
 #include "src/common/list.h"
 #include "src/common/log.h"
 #include "src/common/macros.h"
+#include "src/common/xhash.h"
 #include "src/common/xmalloc.h"
 #include "src/common/xstring.h"
 #include "src/slurmctld/licenses.h"
@@ -60,6 +61,15 @@ time_t last_license_update = 0;
 static pthread_mutex_t license_mutex = PTHREAD_MUTEX_INITIALIZER;
 static void _pack_license(struct licenses *lic, Buf buffer, uint16_t protocol_version);
 
+/* Table of license_list records indexed by license id, plus an index by
+ * name used to resolve job licenses to ids. Rebuilt whenever records are
+ * added to or removed from license_list, protected by license_mutex. */
+static licenses_t **license_table = NULL;
+static uint32_t license_table_cnt = 0;
+static xhash_t *license_name_hash = NULL;
+static uint32_t license_table_gen = 0;	/* 0 if table must be rebuilt */
+static uint32_t license_last_gen = 0;
+
 /* Print all licenses on a list */
 static inline void _licenses_print(char *header, List licenses, int job_id)
 {
@@ -110,6 +120,75 @@ static int _license_find_rec(void *x, void *key)
 	return 1;
 }
 
+static const char *_license_name_id(void *item)
+{
+	licenses_t *license_entry = (licenses_t *) item;
+	return license_entry->name;
+}
+
+/* Note that records were added to or removed from license_list.
+ * license_mutex should be locked before calling this. */
+static void _license_table_invalidate(void)
+{
+	license_table_gen = 0;
+}
+
+/* Rebuild the license table if needed.
+ * license_mutex should be locked before calling this. */
+static void _license_table_validate(void)
+{
+	ListIterator iter;
+	licenses_t *license_entry;
+	uint32_t i = 0;
+
+	if (license_table_gen)
+		return;
+
+	if (!license_name_hash) {
+		license_name_hash = xhash_init(_license_name_id, NULL, NULL,
+					       0);
+	} else
+		xhash_clear(license_name_hash);
+	license_table_cnt = license_list ? list_count(license_list) : 0;
+	xrealloc(license_table, sizeof(licenses_t *) *
+		 MAX(license_table_cnt, 1));
+	if (license_list) {
+		iter = list_iterator_create(license_list);
+		while ((license_entry = (licenses_t *) list_next(iter))) {
+			license_entry->id = i;
+			license_table[i++] = license_entry;
+			if (license_entry->name)
+				xhash_add(license_name_hash, license_entry);
+		}
+		list_iterator_destroy(iter);
+	}
+
+	/* 0 marks an invalid table */
+	if (++license_last_gen == 0)
+		license_last_gen = 1;
+	license_table_gen = license_last_gen;
+}
+
+/* Return the license_list record matching a job's license record, caching
+ * its license id in the job's record.
+ * license_mutex should be locked before calling this. */
+static licenses_t *_license_find_job_rec(licenses_t *license_entry)
+{
+	licenses_t *match = NULL;
+
+	_license_table_validate();
+	if (license_entry->id_gen != license_table_gen) {
+		if (license_entry->name)
+			match = xhash_get(license_name_hash,
+					  license_entry->name);
+		license_entry->id = match ? match->id : NO_VAL;
+		license_entry->id_gen = license_table_gen;
+	}
+	if (license_entry->id >= license_table_cnt)
+		return NULL;
+	return license_table[license_entry->id];
+}
+
 /* Find a license_t record by license name (for use by list_find_first) */
 static int _license_find_remote_rec(void *x, void *key)
 {
@@ -214,6 +293,7 @@ static void _add_res_rec_2_lic_list(slurmdb_res_rec_t *rec, bool sync)
 	license_entry->remote = sync ? 2 : 1;
 
 	list_push(license_list, license_entry);
+	_license_table_invalidate();
 	last_license_update = time(NULL);
 }
 
@@ -256,6 +336,7 @@ extern int license_init(char *licenses)
 	license_list = _build_license_list(licenses, &valid);
 	if (!valid)
 		fatal("Invalid configured licenses: %s", licenses);
+	_license_table_invalidate();
 
 	_licenses_print("init_license", license_list, 0);
 	slurm_mutex_unlock(&license_mutex);
@@ -276,6 +357,7 @@ extern int license_update(char *licenses)
                 fatal("Invalid configured licenses: %s", licenses);
 
         slurm_mutex_lock(&license_mutex);
+        _license_table_invalidate();
         if (!license_list) {        /* no licenses before now */
                 license_list = new_list;
                 slurm_mutex_unlock(&license_mutex);
@@ -423,6 +505,7 @@ extern void license_remove_remote(slurmdb_res_rec_t *rec)
 			     "removed with %u in use",
 			     license_entry->name, license_entry->used);
 			list_delete_item(iter);
+			_license_table_invalidate();
 			last_license_update = time(NULL);
 			break;
 		}
@@ -491,6 +574,7 @@ extern void license_sync_remote(List res_list)
 			     "removed with %u in use",
 			     license_entry->name, license_entry->used);
 			list_delete_item(iter);
+			_license_table_invalidate();
 			last_license_update = time(NULL);
 		} else if (license_entry->remote == 2)
 			license_entry->remote = 1;
@@ -505,6 +589,10 @@ extern void license_free(void)
 {
 	slurm_mutex_lock(&license_mutex);
 	FREE_NULL_LIST(license_list);
+	xfree(license_table);
+	license_table_cnt = 0;
+	xhash_free(license_name_hash);
+	_license_table_invalidate();
 	slurm_mutex_unlock(&license_mutex);
 }
 
@@ -543,12 +631,7 @@ extern List license_validate(char *licenses,
 	_licenses_print("request_license", job_license_list, 0);
 	iter = list_iterator_create(job_license_list);
 	while ((license_entry = (licenses_t *) list_next(iter))) {
-		if (license_list) {
-			match = list_find_first(license_list,
-						_license_find_rec,
-						license_entry->name);
-		} else
-			match = NULL;
+		match = _license_find_job_rec(license_entry);
 		if (!match) {
 			debug("License name requested (%s) does not exist",
 			      license_entry->name);
@@ -613,8 +696,7 @@ extern int license_job_test(struct job_record *job_ptr, time_t when)
 	slurm_mutex_lock(&license_mutex);
 	iter = list_iterator_create(job_ptr->license_list);
 	while ((license_entry = (licenses_t *) list_next(iter))) {
-		match = list_find_first(license_list, _license_find_rec,
-			license_entry->name);
+		match = _license_find_job_rec(license_entry);
 		if (!match) {
 			error("could not find license %s for job %u",
 			      license_entry->name, job_ptr->job_id);
@@ -665,6 +747,8 @@ extern List license_job_copy(List license_list_src)
 		license_entry_dest = xmalloc(sizeof(licenses_t));
 		license_entry_dest->name = xstrdup(license_entry_src->name);
 		license_entry_dest->total = license_entry_src->total;
+		license_entry_dest->id = license_entry_src->id;
+		license_entry_dest->id_gen = license_entry_src->id_gen;
 		list_push(license_list_dest, license_entry_dest);
 	}
 	list_iterator_destroy(iter);
@@ -690,8 +774,7 @@ extern int license_job_get(struct job_record *job_ptr)
 	slurm_mutex_lock(&license_mutex);
 	iter = list_iterator_create(job_ptr->license_list);
 	while ((license_entry = (licenses_t *) list_next(iter))) {
-		match = list_find_first(license_list, _license_find_rec,
-			license_entry->name);
+		match = _license_find_job_rec(license_entry);
 		if (match) {
 			match->used += license_entry->total;
 			license_entry->used += license_entry->total;
@@ -726,8 +809,7 @@ extern int license_job_return(struct job_record *job_ptr)
 	slurm_mutex_lock(&license_mutex);
 	iter = list_iterator_create(job_ptr->license_list);
 	while ((license_entry = (licenses_t *) list_next(iter))) {
-		match = list_find_first(license_list, _license_find_rec,
-			license_entry->name);
+		match = _license_find_job_rec(license_entry);
 		if (match) {
 			if (match->used >= license_entry->total)
 				match->used -= license_entry->total;
@@ -839,10 +921,8 @@ extern uint32_t get_total_license_cnt(char *name)
 
 	slurm_mutex_lock(&license_mutex);
 	if (license_list) {
-		lic = list_find_first(
-			license_list, _license_find_rec, name);
-
-		if (lic)
+		_license_table_validate();
+		if (name && (lic = xhash_get(license_name_hash, name)))
 			count = lic->total;
 	}
 	slurm_mutex_unlock(&license_mutex);
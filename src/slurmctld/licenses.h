@@ -47,6 +47,10 @@ typedef struct licenses {
 	uint32_t	total;		/* total license configued */
 	uint32_t	used;		/* used licenses */
 	uint8_t         remote;	        /* non-zero if remote (from database) */
+	uint32_t	id;		/* job license: index of the license
+					 * in the license table, NO_VAL if
+					 * unknown, valid if id_gen matches */
+	uint32_t	id_gen;		/* table generation of id */
 } licenses_t;
 
 extern List license_list;
@@ -68,6 +68,7 @@
 #include "src/common/slurm_priority.h"
 #include "src/common/slurm_topology.h"
 #include "src/common/xassert.h"
+#include "src/common/xhash.h"
 #include "src/common/xmalloc.h"
 #include "src/common/xstring.h"
 #include "src/common/layouts_mgr.h"
@@ -84,10 +85,12 @@
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/sched_plugin.h"
+#include "src/slurmctld/shape_cache.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/slurmctld_plugstack.h"
 
 #define MAX_FEATURES  32	/* max exclusive features "[fs1|fs2]"=2 */
+#define MAX_FEATURE_EXPRS 1024	/* max cached constraint expressions */
 #define MAX_RETRIES   10
 
 struct node_set {		/* set of nodes with same configuration */
@@ -104,6 +107,25 @@ struct node_set {		/* set of nodes with same configuration */
 	bitstr_t *my_bitmap;		/* node bitmap */
 };
 
+/* A job's feature constraint compiled against the node feature bitmaps.
+ * Shared by all jobs with identical constraint strings and discarded when
+ * node features change. */
+typedef struct feature_expr {
+	char *features;		/* job's constraint string, hash key */
+	int feat_cnt;		/* entries in feat_ptr */
+	struct features_record **feat_ptr; /* node feature for each entry in
+				 * the job's feature_list, NULL if unknown */
+	bitstr_t *match_all;	/* AND/OR terms evaluated from all nodes */
+	bitstr_t *match_none;	/* AND/OR terms evaluated from no nodes */
+	bool has_count;		/* some feature has a node count */
+	bool has_xor;		/* some feature uses XOR or XAND */
+} feature_expr_t;
+
+static pthread_mutex_t feature_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t feature_cache_gen = 0;
+static xhash_t *feature_expr_hash = NULL;  /* feature_expr_t records */
+static xhash_t *feature_name_hash = NULL;  /* features_record by name */
+
 static int  _build_node_list(struct job_record *job_ptr,
 			     struct node_set **node_set_pptr,
 			     int *node_set_size, char **err_msg,
@@ -118,6 +140,8 @@ static void _filter_nodes_in_set(struct node_set *node_set_ptr,
 static bool _first_array_task(struct job_record *job_ptr);
 static void _launch_prolog(struct job_record *job_ptr);
 static int  _match_feature(char *seek, struct node_set *node_set_ptr);
+static struct features_record *_find_node_feature(char *name);
+static feature_expr_t *_get_feature_expr(struct job_details *detail_ptr);
 static int _nodes_in_sets(bitstr_t *req_bitmap,
 			  struct node_set * node_set_ptr,
 			  int node_set_size);
@@ -483,6 +507,7 @@ extern void deallocate_nodes(struct job_record *job_ptr, bool timeout,
 	acct_policy_job_fini(job_ptr);
 	if (select_g_job_fini(job_ptr) != SLURM_SUCCESS)
 		error("select_g_job_fini(%u): %m", job_ptr->job_id);
+	shape_cache_invalidate();
 	(void) epilog_slurmctld(job_ptr);
 
 	agent_args = xmalloc(sizeof(agent_arg_t));
@@ -633,8 +658,9 @@ static int _match_feature(char *seek, struct node_set *node_set_ptr)
 	if (seek == NULL)
 		return 1;	/* nothing to look for */
 
-	feat_ptr = list_find_first(feature_list, list_find_feature,
-				   (void *) seek);
+	slurm_mutex_lock(&feature_cache_mutex);
+	feat_ptr = _find_node_feature(seek);
+	slurm_mutex_unlock(&feature_cache_mutex);
 	if (feat_ptr == NULL)
 		return 0;	/* no such feature */
 
@@ -2183,6 +2209,7 @@ extern int select_nodes(struct job_record *job_ptr, bool test_only,
 	configuring = IS_JOB_CONFIGURING(job_ptr);
 
 	job_ptr->job_state = JOB_RUNNING;
+	depend_notify_job(job_ptr);
 	if (nonstop_ops.job_begin)
 		(nonstop_ops.job_begin)(job_ptr);
 
@@ -2472,6 +2499,134 @@ extern int list_find_feature(void *feature_entry, void *key)
 	return 0;
 }
 
+static const char *_feature_name_id(void *item)
+{
+	struct features_record *feat_ptr = (struct features_record *) item;
+	return feat_ptr->name;
+}
+
+static const char *_feature_expr_id(void *item)
+{
+	feature_expr_t *expr = (feature_expr_t *) item;
+	return expr->features;
+}
+
+static void _feature_expr_free(void *item)
+{
+	feature_expr_t *expr = (feature_expr_t *) item;
+
+	if (expr) {
+		xfree(expr->features);
+		xfree(expr->feat_ptr);
+		FREE_NULL_BITMAP(expr->match_all);
+		FREE_NULL_BITMAP(expr->match_none);
+		xfree(expr);
+	}
+}
+
+/* Discard the feature caches if node features changed since they were
+ * built. Caller must hold feature_cache_mutex. */
+static void _validate_feature_cache(void)
+{
+	ListIterator feat_iter;
+	struct features_record *feat_ptr;
+
+	if (feature_expr_hash && (feature_cache_gen == feature_list_gen)) {
+		if (xhash_count(feature_expr_hash) >= MAX_FEATURE_EXPRS)
+			xhash_clear(feature_expr_hash);
+		return;
+	}
+
+	xhash_free(feature_expr_hash);
+	xhash_free(feature_name_hash);
+	feature_expr_hash = xhash_init(_feature_expr_id, _feature_expr_free,
+				       NULL, 0);
+	feature_name_hash = xhash_init(_feature_name_id, NULL, NULL, 0);
+	if (feature_list) {
+		feat_iter = list_iterator_create(feature_list);
+		while ((feat_ptr = (struct features_record *)
+				list_next(feat_iter))) {
+			xhash_add(feature_name_hash, feat_ptr);
+		}
+		list_iterator_destroy(feat_iter);
+	}
+	feature_cache_gen = feature_list_gen;
+}
+
+/* Return the node feature record with the given name or NULL if no node
+ * has it. Caller must hold feature_cache_mutex. */
+static struct features_record *_find_node_feature(char *name)
+{
+	_validate_feature_cache();
+	return (struct features_record *) xhash_get(feature_name_hash, name);
+}
+
+/*
+ * _get_feature_expr - Return a job's compiled feature constraint, building
+ *	it if no job with the same constraint string has been tested since
+ *	node features last changed.
+ * Caller must hold feature_cache_mutex and must not free the result.
+ */
+static feature_expr_t *_get_feature_expr(struct job_details *detail_ptr)
+{
+	ListIterator job_feat_iter;
+	struct feature_record *job_feat_ptr;
+	struct features_record *feat_ptr;
+	feature_expr_t *expr;
+	char *features = detail_ptr->features ? detail_ptr->features : "";
+	int last_op = FEATURE_OP_AND, i = 0;
+
+	_validate_feature_cache();
+	expr = xhash_get(feature_expr_hash, features);
+	if (expr && (expr->feat_cnt == list_count(detail_ptr->feature_list)))
+		return expr;
+	if (expr)
+		xhash_delete(feature_expr_hash, features);
+
+	expr = xmalloc(sizeof(feature_expr_t));
+	expr->features = xstrdup(features);
+	expr->feat_cnt = list_count(detail_ptr->feature_list);
+	expr->feat_ptr = xmalloc(sizeof(struct features_record *) *
+				 MAX(expr->feat_cnt, 1));
+	expr->match_all  = bit_alloc(node_record_count);
+	expr->match_none = bit_alloc(node_record_count);
+	if (node_record_count)
+		bit_nset(expr->match_all, 0, (node_record_count - 1));
+
+	job_feat_iter = list_iterator_create(detail_ptr->feature_list);
+	while ((job_feat_ptr = (struct feature_record *)
+			list_next(job_feat_iter))) {
+		feat_ptr = _find_node_feature(job_feat_ptr->name);
+		expr->feat_ptr[i++] = feat_ptr;
+		if (feat_ptr) {
+			if (last_op == FEATURE_OP_AND) {
+				bit_and(expr->match_all, feat_ptr->node_bitmap);
+				bit_and(expr->match_none,
+					feat_ptr->node_bitmap);
+			} else {
+				/* FEATURE_OP_OR, FEATURE_OP_XOR or
+				 * FEATURE_OP_XAND */
+				if (last_op != FEATURE_OP_OR)
+					expr->has_xor = true;
+				bit_or(expr->match_all, feat_ptr->node_bitmap);
+				bit_or(expr->match_none, feat_ptr->node_bitmap);
+			}
+		} else {	/* feature not found */
+			if (last_op == FEATURE_OP_AND) {
+				bit_clear_all(expr->match_all);
+				bit_clear_all(expr->match_none);
+			}
+		}
+		last_op = job_feat_ptr->op_code;
+		if (job_feat_ptr->count)
+			expr->has_count = true;
+	}
+	list_iterator_destroy(job_feat_iter);
+
+	xhash_add(feature_expr_hash, expr);
+	return expr;
+}
+
 /*
  * _valid_feature_counts - validate a job's features can be satisfied
  *	by the selected nodes (NOTE: does not process XOR or XAND operators)
@@ -2484,10 +2639,10 @@ static bool _valid_feature_counts(struct job_details *detail_ptr,
 {
 	ListIterator job_feat_iter;
 	struct feature_record *job_feat_ptr;
-	struct features_record *feat_ptr;
-	int have_count = false, last_op = FEATURE_OP_AND;
+	feature_expr_t *expr;
 	bitstr_t *feature_bitmap, *tmp_bitmap;
 	bool rc = true;
+	int i = 0;
 
 	xassert(detail_ptr);
 	xassert(node_bitmap);
@@ -2497,61 +2652,43 @@ static bool _valid_feature_counts(struct job_details *detail_ptr,
 	if (detail_ptr->feature_list == NULL)	/* no constraints */
 		return rc;
 
+	slurm_mutex_lock(&feature_cache_mutex);
+	expr = _get_feature_expr(detail_ptr);
+	*has_xor = expr->has_xor;
+	if (!expr->has_count) {
+		bit_and(node_bitmap, expr->match_all);
+		slurm_mutex_unlock(&feature_cache_mutex);
+		return rc;
+	}
+
+	/* Nodes matching the AND/OR terms when evaluated starting from
+	 * node_bitmap: node_bitmap & match_all, plus nodes matched from
+	 * any starting set (OR terms after the last AND) */
 	feature_bitmap = bit_copy(node_bitmap);
+	bit_and(feature_bitmap, expr->match_all);
+	bit_or(feature_bitmap, expr->match_none);
+	tmp_bitmap = bit_alloc(bit_size(feature_bitmap));
 	job_feat_iter = list_iterator_create(detail_ptr->feature_list);
 	while ((job_feat_ptr = (struct feature_record *)
 			list_next(job_feat_iter))) {
-		feat_ptr = list_find_first(feature_list, list_find_feature,
-					   (void *) job_feat_ptr->name);
-		if (feat_ptr) {
-			if (last_op == FEATURE_OP_AND)
-				bit_and(feature_bitmap, feat_ptr->node_bitmap);
-			else if (last_op == FEATURE_OP_OR)
-				bit_or(feature_bitmap, feat_ptr->node_bitmap);
-			else {	/* FEATURE_OP_XOR or FEATURE_OP_XAND */
-				*has_xor = true;
-				bit_or(feature_bitmap, feat_ptr->node_bitmap);
-			}
-		} else {	/* feature not found */
-			if (last_op == FEATURE_OP_AND) {
-				bit_nclear(feature_bitmap, 0,
-					   (node_record_count - 1));
-			}
+		i++;
+		if (job_feat_ptr->count == 0)
+			continue;
+		if (!expr->feat_ptr[i - 1]) {
+			rc = false;
+			break;
 		}
-		last_op = job_feat_ptr->op_code;
-		if (job_feat_ptr->count)
-			have_count = true;
-	}
-	list_iterator_destroy(job_feat_iter);
-
-	if (have_count) {
-		job_feat_iter = list_iterator_create(detail_ptr->
-						     feature_list);
-		while ((job_feat_ptr = (struct feature_record *)
-				list_next(job_feat_iter))) {
-			if (job_feat_ptr->count == 0)
-				continue;
-			feat_ptr = list_find_first(feature_list,
-						   list_find_feature,
-						   (void *)job_feat_ptr->name);
-			if (!feat_ptr) {
-				rc = false;
-				break;
-			}
-			tmp_bitmap = bit_copy(feature_bitmap);
-			bit_and(tmp_bitmap, feat_ptr->node_bitmap);
-			if (bit_set_count(tmp_bitmap) < job_feat_ptr->count)
-				rc = false;
-			FREE_NULL_BITMAP(tmp_bitmap);
-			if (!rc)
-				break;
+		bit_copybits(tmp_bitmap, feature_bitmap);
+		bit_and(tmp_bitmap, expr->feat_ptr[i - 1]->node_bitmap);
+		if (bit_set_count(tmp_bitmap) < job_feat_ptr->count) {
+			rc = false;
+			break;
 		}
-		list_iterator_destroy(job_feat_iter);
-		FREE_NULL_BITMAP(feature_bitmap);
-	} else {
-		bit_and(node_bitmap, feature_bitmap);
-		FREE_NULL_BITMAP(feature_bitmap);
 	}
+	list_iterator_destroy(job_feat_iter);
+	slurm_mutex_unlock(&feature_cache_mutex);
+	FREE_NULL_BITMAP(tmp_bitmap);
+	FREE_NULL_BITMAP(feature_bitmap);
 
 	return rc;
 }
@@ -3166,7 +3303,8 @@ static bitstr_t *_valid_features(struct job_details *details_ptr,
 	ListIterator feat_iter;
 	struct feature_record *job_feat_ptr;
 	struct features_record *feat_ptr;
-	int last_op = FEATURE_OP_AND, position = 0;
+	feature_expr_t *expr;
+	int last_op = FEATURE_OP_AND, position = 0, i = 0;
 
 	result_bits = bit_alloc(MAX_FEATURES);
 	if (details_ptr->feature_list == NULL) {	/* no constraints */
@@ -3174,16 +3312,16 @@ static bitstr_t *_valid_features(struct job_details *details_ptr,
 		return result_bits;
 	}
 
+	slurm_mutex_lock(&feature_cache_mutex);
+	expr = _get_feature_expr(details_ptr);
 	feat_iter = list_iterator_create(details_ptr->feature_list);
 	while ((job_feat_ptr = (struct feature_record *)
 			list_next(feat_iter))) {
+		feat_ptr = expr->feat_ptr[i++];
 		if ((job_feat_ptr->op_code == FEATURE_OP_XAND) ||
 		    (job_feat_ptr->op_code == FEATURE_OP_XOR)  ||
 		    (last_op == FEATURE_OP_XAND) ||
 		    (last_op == FEATURE_OP_XOR)) {
-			feat_ptr = list_find_first(feature_list,
-						   list_find_feature,
-						   (void *)job_feat_ptr->name);
 			if (feat_ptr &&
 			    bit_super_set(config_ptr->node_bitmap,
 					  feat_ptr->node_bitmap)) {
@@ -3194,6 +3332,7 @@ static bitstr_t *_valid_features(struct job_details *details_ptr,
 		last_op = job_feat_ptr->op_code;
 	}
 	list_iterator_destroy(feat_iter);
+	slurm_mutex_unlock(&feature_cache_mutex);
 
 	return result_bits;
 }
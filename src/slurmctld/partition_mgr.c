@@ -62,6 +62,7 @@
 #include "src/common/xstring.h"
 #include "src/common/assoc_mgr.h"
 
+#include "src/slurmctld/acct_policy.h"
 #include "src/slurmctld/groups.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/proc_req.h"
@@ -1542,6 +1543,7 @@ extern int update_part (update_part_msg_t * part_desc, bool create_flag)
 		     __func__, part_ptr->qos_char, part_ptr->name);
 		xfree(part_ptr->qos_char);
 		part_ptr->qos_ptr = NULL;
+		acct_policy_limits_changed();
 	} else if (part_desc->qos_char) {
 		slurmdb_qos_rec_t qos_rec, *backup_qos_ptr = part_ptr->qos_ptr;
 
@@ -1563,6 +1565,7 @@ extern int update_part (update_part_msg_t * part_desc, bool create_flag)
 
 			xfree(part_ptr->qos_char);
 			part_ptr->qos_char = xstrdup(part_desc->qos_char);
+			acct_policy_limits_changed();
 		}
 	}
 
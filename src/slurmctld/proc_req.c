@@ -110,6 +110,21 @@ static uint64_t *rpc_user_time = NULL;
 static pthread_mutex_t throttle_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t throttle_cond = PTHREAD_COND_INITIALIZER;
 
+/* Node registrations waiting to be validated, see _node_reg_queue() */
+#define NODE_REG_BATCH_MAX 256
+typedef struct node_reg_req {
+	slurm_node_registration_status_msg_t *reg_msg;
+	uint16_t protocol_version;
+	int error_code;			/* set when done */
+	bool newly_up;			/* set when done */
+	bool done;
+	struct node_reg_req *next;
+} node_reg_req_t;
+static pthread_mutex_t node_reg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t node_reg_cond = PTHREAD_COND_INITIALIZER;
+static node_reg_req_t *node_reg_head = NULL, *node_reg_tail = NULL;
+static bool node_reg_active = false;	/* batch being validated */
+
 static void         _fill_ctld_conf(slurm_ctl_conf_t * build_ptr);
 static void         _kill_job_on_msg_fail(uint32_t job_id);
 static int          _is_prolog_finished(uint32_t job_id);
@@ -119,6 +134,8 @@ static int	    _launch_batch_step(job_desc_msg_t *job_desc_msg,
 static int          _make_step_cred(struct step_record *step_rec,
 				    slurm_cred_t **slurm_cred,
 				    uint16_t protocol_version);
+static void         _node_reg_batch(node_reg_req_t *batch, int batch_cnt);
+static void         _node_reg_queue(node_reg_req_t *req);
 static void         _throttle_fini(int *active_rpc_cnt);
 static void         _throttle_start(int *active_rpc_cnt);
 
@@ -646,6 +663,96 @@ static void _throttle_fini(int *active_rpc_cnt)
 	slurm_mutex_unlock(&throttle_mutex);
 }
 
+/* Validate a batch of node registrations under one lock acquisition */
+static void _node_reg_batch(node_reg_req_t *batch, int batch_cnt)
+{
+	node_reg_req_t *req;
+	/* Locks: Read config, write job, write node */
+	slurmctld_lock_t job_write_lock = {
+		READ_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK };
+#ifndef HAVE_FRONT_END
+	slurm_node_registration_status_msg_t **reg_msgs;
+	int i = 0;
+
+	reg_msgs = xmalloc(sizeof(slurm_node_registration_status_msg_t *) *
+			   batch_cnt);
+	for (req = batch; req; req = req->next)
+		reg_msgs[i++] = req->reg_msg;
+#endif
+
+	lock_slurmctld(job_write_lock);
+#ifdef HAVE_FRONT_END		/* Operates only on front-end */
+	for (req = batch; req; req = req->next) {
+		req->error_code = validate_nodes_via_front_end(
+			req->reg_msg, req->protocol_version, &req->newly_up);
+	}
+#else
+	validate_jobs_on_nodes(reg_msgs, batch_cnt);
+	for (req = batch; req; req = req->next) {
+		req->error_code = validate_node_specs(req->reg_msg,
+						      req->protocol_version,
+						      &req->newly_up);
+	}
+#endif
+	slurmctld_diag_stats.node_reg_cnt += batch_cnt;
+	slurmctld_diag_stats.node_reg_lock_cnt++;
+	if (slurmctld_diag_stats.node_reg_batch_max < batch_cnt)
+		slurmctld_diag_stats.node_reg_batch_max = batch_cnt;
+	unlock_slurmctld(job_write_lock);
+
+#ifndef HAVE_FRONT_END
+	xfree(reg_msgs);
+#endif
+}
+
+/*
+ * _node_reg_queue - Validate a node registration. Registrations arriving
+ *	while an earlier batch holds the locks are queued. The next thread to
+ *	find no batch in progress validates up to NODE_REG_BATCH_MAX of them
+ *	with a single lock acquisition on behalf of the other threads.
+ * IN/OUT req - registration to validate, error_code and newly_up are set
+ */
+static void _node_reg_queue(node_reg_req_t *req)
+{
+	node_reg_req_t *batch, *last;
+	int batch_cnt;
+
+	slurm_mutex_lock(&node_reg_mutex);
+	if (node_reg_tail)
+		node_reg_tail->next = req;
+	else
+		node_reg_head = req;
+	node_reg_tail = req;
+
+	while (!req->done) {
+		if (node_reg_active) {
+			pthread_cond_wait(&node_reg_cond, &node_reg_mutex);
+			continue;
+		}
+		node_reg_active = true;
+		batch = last = node_reg_head;
+		for (batch_cnt = 1; last->next &&
+		     (batch_cnt < NODE_REG_BATCH_MAX); batch_cnt++)
+			last = last->next;
+		node_reg_head = last->next;
+		if (!node_reg_head)
+			node_reg_tail = NULL;
+		last->next = NULL;
+		slurm_mutex_unlock(&node_reg_mutex);
+
+		_node_reg_batch(batch, batch_cnt);
+
+		/* Each record is owned by a thread which can not return
+		 * before we release node_reg_mutex */
+		slurm_mutex_lock(&node_reg_mutex);
+		for ( ; batch; batch = batch->next)
+			batch->done = true;
+		node_reg_active = false;
+		pthread_cond_broadcast(&node_reg_cond);
+	}
+	slurm_mutex_unlock(&node_reg_mutex);
+}
+
 /*
  * _fill_ctld_conf - make a copy of current slurm configuration
  *	this is done with locks set so the data can change at other times
@@ -2571,9 +2678,7 @@ static void _slurm_rpc_node_registration(slurm_msg_t * msg,
 	bool newly_up = false;
 	slurm_node_registration_status_msg_t *node_reg_stat_msg =
 		(slurm_node_registration_status_msg_t *) msg->data;
-	/* Locks: Read config, write job, write node */
-	slurmctld_lock_t job_write_lock = {
-		READ_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK };
+	node_reg_req_t node_reg_req;
 	uid_t uid = g_slurm_auth_get_uid(msg->auth_cred, slurm_get_auth_info());
 
 	START_TIMER;
@@ -2602,20 +2707,26 @@ static void _slurm_rpc_node_registration(slurm_msg_t * msg,
 			      "set DebugFlags=NO_CONF_HASH in your slurm.conf.",
 			      node_reg_stat_msg->node_name);
 		}
-		if (!running_composite)
-			lock_slurmctld(job_write_lock);
+		if (running_composite) {
+			/* Locks already set by the composite message */
 #ifdef HAVE_FRONT_END		/* Operates only on front-end */
-		error_code = validate_nodes_via_front_end(node_reg_stat_msg,
-							  msg->protocol_version,
-							  &newly_up);
+			error_code = validate_nodes_via_front_end(
+				node_reg_stat_msg, msg->protocol_version,
+				&newly_up);
 #else
-		validate_jobs_on_node(node_reg_stat_msg);
-		error_code = validate_node_specs(node_reg_stat_msg,
-						 msg->protocol_version,
-						 &newly_up);
+			validate_jobs_on_node(node_reg_stat_msg);
+			error_code = validate_node_specs(node_reg_stat_msg,
+							 msg->protocol_version,
+							 &newly_up);
 #endif
-		if (!running_composite)
-			unlock_slurmctld(job_write_lock);
+		} else {
+			memset(&node_reg_req, 0, sizeof(node_reg_req_t));
+			node_reg_req.reg_msg = node_reg_stat_msg;
+			node_reg_req.protocol_version = msg->protocol_version;
+			_node_reg_queue(&node_reg_req);
+			error_code = node_reg_req.error_code;
+			newly_up = node_reg_req.newly_up;
+		}
 		END_TIMER2("_slurm_rpc_node_registration");
 		if (newly_up) {
 			queue_job_scheduler();
@@ -4612,7 +4723,7 @@ xduparray(uint32_t size, char ** array)
 }
 
 /* Like xduparray(), but performs one xmalloc().  The output format of this
- * must be identical to _read_data_array_from_file() */
+ * must be identical to _read_data_array() in job_mgr.c */
 static char **
 _xduparray2(uint32_t size, char ** array)
 {
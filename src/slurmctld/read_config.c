@@ -2045,6 +2045,7 @@ static int _restore_job_dependencies(void)
 	assoc_mgr_lock(&locks);
 
 	assoc_mgr_clear_used_info();
+	acct_policy_limits_changed();
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
 		if (job_ptr->array_recs)
@@ -134,6 +134,34 @@ static void _update_constraint_planning(constraint_planning_t* sched,
 static uint32_t _max_constraint_planning(constraint_planning_t* sched,
 					 time_t *start, time_t *end);
 
+/*
+ * Index of resv_list by time: an interval tree stored as an array sorted by
+ * start time, each element being the root of the subtree covering the
+ * elements between its neighbors (see _resv_index_max_end()). Reservations
+ * with RESERVE_FLAG_TIME_FLOAT have times relative to now and are always
+ * returned. Rebuilt when invalidated by any change to resv_list membership
+ * or reservation times.
+ */
+typedef struct resv_index_rec {
+	time_t start;		/* earliest start time */
+	time_t end;		/* end time of the reservation */
+	time_t max_end;		/* latest end time in this subtree */
+	int pos;		/* position in resv_list */
+	slurmctld_resv_t *resv_ptr;
+} resv_index_rec_t;
+
+static resv_index_rec_t *resv_index = NULL;	/* by start time */
+static int resv_index_cnt = 0;
+static resv_index_rec_t *resv_index_float = NULL;
+static int resv_index_float_cnt = 0;
+static time_t resv_index_advance = 0;	/* first recurring reservation end,
+					 * 0 if none */
+static bool resv_index_valid = false;
+
+static void _resv_index_invalidate(void);
+static slurmctld_resv_t **_resv_in_window(time_t start_time,
+					  time_t end_time, int *resv_cnt);
+
 
 static void _advance_resv_time(slurmctld_resv_t *resv_ptr);
 static void _advance_time(time_t *res_time, int day_cnt);
@@ -421,6 +449,7 @@ static void _del_resv_rec(void *x)
 	slurmctld_resv_t *resv_ptr = (slurmctld_resv_t *) x;
 
 	if (resv_ptr) {
+		_resv_index_invalidate();
 		xassert(resv_ptr->magic == RESV_MAGIC);
 		resv_ptr->magic = 0;
 		xfree(resv_ptr->accounts);
@@ -445,6 +474,158 @@ static void _del_resv_rec(void *x)
 	}
 }
 
+static void _resv_index_invalidate(void)
+{
+	resv_index_valid = false;
+}
+
+static int _resv_index_sort(const void *x, const void *y)
+{
+	const resv_index_rec_t *rec1 = (const resv_index_rec_t *) x;
+	const resv_index_rec_t *rec2 = (const resv_index_rec_t *) y;
+
+	if (rec1->start < rec2->start)
+		return -1;
+	if (rec1->start > rec2->start)
+		return 1;
+	return rec1->pos - rec2->pos;
+}
+
+static int _resv_pos_sort(const void *x, const void *y)
+{
+	const resv_index_rec_t *rec1 = *(resv_index_rec_t * const *) x;
+	const resv_index_rec_t *rec2 = *(resv_index_rec_t * const *) y;
+
+	return rec1->pos - rec2->pos;
+}
+
+/* Set max_end of the subtree rooted at the middle of resv_index[lo:hi-1],
+ * RET the latest end time in that subtree */
+static time_t _resv_index_max_end(int lo, int hi)
+{
+	int mid;
+	time_t max_end, sub_end;
+
+	if (lo >= hi)
+		return (time_t) 0;
+	mid = (lo + hi) / 2;
+	max_end = resv_index[mid].end;
+	sub_end = _resv_index_max_end(lo, mid);
+	max_end = MAX(max_end, sub_end);
+	sub_end = _resv_index_max_end(mid + 1, hi);
+	max_end = MAX(max_end, sub_end);
+	resv_index[mid].max_end = max_end;
+
+	return max_end;
+}
+
+static void _resv_index_build(void)
+{
+	ListIterator iter;
+	slurmctld_resv_t *resv_ptr;
+	resv_index_rec_t *rec;
+	int cnt = list_count(resv_list), pos = 0;
+
+	xrealloc(resv_index, sizeof(resv_index_rec_t) * MAX(cnt, 1));
+	xrealloc(resv_index_float, sizeof(resv_index_rec_t) * MAX(cnt, 1));
+	resv_index_cnt = 0;
+	resv_index_float_cnt = 0;
+	resv_index_advance = 0;
+
+	iter = list_iterator_create(resv_list);
+	while ((resv_ptr = (slurmctld_resv_t *) list_next(iter))) {
+		if (resv_ptr->flags & RESERVE_FLAG_TIME_FLOAT) {
+			rec = &resv_index_float[resv_index_float_cnt++];
+		} else {
+			rec = &resv_index[resv_index_cnt++];
+			if ((resv_ptr->flags &
+			     (RESERVE_FLAG_DAILY | RESERVE_FLAG_WEEKLY)) &&
+			    ((resv_index_advance == 0) ||
+			     (resv_index_advance > resv_ptr->end_time)))
+				resv_index_advance = resv_ptr->end_time;
+		}
+		rec->start = MIN(resv_ptr->start_time,
+				 resv_ptr->start_time_first);
+		rec->end = resv_ptr->end_time;
+		rec->pos = pos++;
+		rec->resv_ptr = resv_ptr;
+	}
+	list_iterator_destroy(iter);
+
+	qsort(resv_index, resv_index_cnt, sizeof(resv_index_rec_t),
+	      _resv_index_sort);
+	(void) _resv_index_max_end(0, resv_index_cnt);
+	resv_index_valid = true;
+}
+
+/* Add to recs the resv_index[lo:hi-1] records which overlap a time window */
+static void _resv_index_find(int lo, int hi, time_t start_time,
+			     time_t end_time, resv_index_rec_t **recs,
+			     int *rec_cnt)
+{
+	int mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (resv_index[mid].max_end <= start_time)
+			return;		/* whole subtree ends earlier */
+		_resv_index_find(lo, mid, start_time, end_time, recs,
+				 rec_cnt);
+		if (resv_index[mid].start >= end_time)
+			return;		/* this and later start later */
+		if (resv_index[mid].end > start_time)
+			recs[(*rec_cnt)++] = &resv_index[mid];
+		lo = mid + 1;
+	}
+}
+
+/*
+ * Find reservations which might overlap a time window. Reservations with
+ * RESERVE_FLAG_TIME_FLOAT are always included. Expired recurring
+ * reservations are advanced first. Callers must still test the reservation
+ * times themselves.
+ * IN start_time, end_time - time window to test
+ * OUT resv_cnt - number of reservations found
+ * RET reservations in resv_list order, caller must xfree
+ */
+static slurmctld_resv_t **_resv_in_window(time_t start_time,
+					  time_t end_time, int *resv_cnt)
+{
+	ListIterator iter;
+	slurmctld_resv_t *resv_ptr, **resv_array;
+	resv_index_rec_t **recs;
+	time_t now = time(NULL);
+	int i, rec_cnt = 0;
+
+	if (resv_index_valid && resv_index_advance &&
+	    (resv_index_advance <= now)) {
+		iter = list_iterator_create(resv_list);
+		while ((resv_ptr = (slurmctld_resv_t *) list_next(iter))) {
+			if (resv_ptr->end_time <= now)
+				_advance_resv_time(resv_ptr);
+		}
+		list_iterator_destroy(iter);
+	}
+	if (!resv_index_valid)
+		_resv_index_build();
+
+	recs = xmalloc(sizeof(resv_index_rec_t *) *
+		       (resv_index_cnt + resv_index_float_cnt + 1));
+	_resv_index_find(0, resv_index_cnt, start_time, end_time, recs,
+			 &rec_cnt);
+	for (i = 0; i < resv_index_float_cnt; i++)
+		recs[rec_cnt++] = &resv_index_float[i];
+	qsort(recs, rec_cnt, sizeof(resv_index_rec_t *), _resv_pos_sort);
+
+	resv_array = xmalloc(sizeof(slurmctld_resv_t *) * (rec_cnt + 1));
+	for (i = 0; i < rec_cnt; i++)
+		resv_array[i] = recs[i]->resv_ptr;
+	xfree(recs);
+	*resv_cnt = rec_cnt;
+
+	return resv_array;
+}
+
 static int _find_resv_id(void *x, void *key)
 {
 	slurmctld_resv_t *resv_ptr = (slurmctld_resv_t *) x;
@@ -2268,6 +2449,7 @@ extern int create_resv(resv_desc_msg_t *resv_desc_ptr)
 	_set_tres_cnt(resv_ptr, NULL);
 
 	list_append(resv_list, resv_ptr);
+	_resv_index_invalidate();
 	last_resv_update = now;
 	schedule_resv_save();
 
@@ -2288,6 +2470,10 @@ extern int create_resv(resv_desc_msg_t *resv_desc_ptr)
 extern void resv_fini(void)
 {
 	FREE_NULL_LIST(resv_list);
+	xfree(resv_index);
+	xfree(resv_index_float);
+	resv_index_cnt = 0;
+	resv_index_float_cnt = 0;
 }
 
 /* Update an exiting resource reservation */
@@ -2322,6 +2508,7 @@ extern int update_resv(resv_desc_msg_t *resv_desc_ptr)
 
 	/* Make backup to restore state in case of failure */
 	resv_backup = _copy_resv(resv_ptr);
+	_resv_index_invalidate();
 
 	/* Process the request */
 	if (resv_desc_ptr->flags != NO_VAL) {
@@ -3507,6 +3694,7 @@ extern int load_all_resv_state(int recover)
 			break;
 
 		list_append(resv_list, resv_ptr);
+		_resv_index_invalidate();
 		info("Recovered state of reservation %s", resv_ptr->name);
 	}
 
@@ -4462,7 +4650,8 @@ extern burst_buffer_info_msg_t *job_test_bb_resv(struct job_record *job_ptr,
 	slurmctld_resv_t * resv_ptr;
 	time_t job_start_time, job_end_time, now = time(NULL);
 	burst_buffer_info_msg_t *bb_resv = NULL;
-	ListIterator iter;
+	slurmctld_resv_t **resv_array;
+	int i, resv_cnt;
 
 	if ((job_ptr->burst_buffer == NULL) ||
 	    (job_ptr->burst_buffer[0] == '\0'))
@@ -4470,8 +4659,9 @@ extern burst_buffer_info_msg_t *job_test_bb_resv(struct job_record *job_ptr,
 
 	job_start_time = when;
 	job_end_time   = when + _get_job_duration(job_ptr);
-	iter = list_iterator_create(resv_list);
-	while ((resv_ptr = (slurmctld_resv_t *) list_next(iter))) {
+	resv_array = _resv_in_window(job_start_time, job_end_time, &resv_cnt);
+	for (i = 0; i < resv_cnt; i++) {
+		resv_ptr = resv_array[i];
 		if (resv_ptr->end_time <= now)
 			_advance_resv_time(resv_ptr);
 		if ((resv_ptr->start_time >= job_end_time) ||
@@ -4485,7 +4675,7 @@ extern burst_buffer_info_msg_t *job_test_bb_resv(struct job_record *job_ptr,
 
 		_update_bb_resv(&bb_resv, resv_ptr->burst_buffer);
 	}
-	list_iterator_destroy(iter);
+	xfree(resv_array);
 
 	return bb_resv;
 }
@@ -4504,13 +4694,14 @@ extern int job_test_lic_resv(struct job_record *job_ptr, char *lic_name,
 {
 	slurmctld_resv_t * resv_ptr;
 	time_t job_start_time, job_end_time, now = time(NULL);
-	ListIterator iter;
-	int resv_cnt = 0;
+	slurmctld_resv_t **resv_array;
+	int i, array_cnt, resv_cnt = 0;
 
 	job_start_time = when;
 	job_end_time   = when + _get_job_duration(job_ptr);
-	iter = list_iterator_create(resv_list);
-	while ((resv_ptr = (slurmctld_resv_t *) list_next(iter))) {
+	resv_array = _resv_in_window(job_start_time, job_end_time, &array_cnt);
+	for (i = 0; i < array_cnt; i++) {
+		resv_ptr = resv_array[i];
 		if (resv_ptr->end_time <= now)
 			_advance_resv_time(resv_ptr);
 		if ((resv_ptr->start_time >= job_end_time) ||
@@ -4523,7 +4714,7 @@ extern int job_test_lic_resv(struct job_record *job_ptr, char *lic_name,
 
 		resv_cnt += _license_cnt(resv_ptr->license_list, lic_name);
 	}
-	list_iterator_destroy(iter);
+	xfree(resv_array);
 
 	/* info("job %u blocked from %d licenses of type %s",
 	     job_ptr->job_id, resv_cnt, lic_name); */
@@ -4708,18 +4899,20 @@ extern uint32_t job_test_watts_resv(struct job_record *job_ptr, time_t when)
 {
 	slurmctld_resv_t * resv_ptr;
 	time_t job_start_time, job_end_time, now = time(NULL);
-	ListIterator iter;
+	slurmctld_resv_t **resv_array;
 	constraint_planning_t wsched;
 	time_t start, end;
 	char start_str[32] = "-1", end_str[32] = "-1";
 	uint32_t resv_cnt = 0;
+	int i, array_cnt;
 
 	_init_constraint_planning(&wsched);
 
 	job_start_time = when;
 	job_end_time   = when + _get_job_duration(job_ptr);
-	iter = list_iterator_create(resv_list);
-	while ((resv_ptr = (slurmctld_resv_t *) list_next(iter))) {
+	resv_array = _resv_in_window(job_start_time, job_end_time, &array_cnt);
+	for (i = 0; i < array_cnt; i++) {
+		resv_ptr = resv_array[i];
 		if (resv_ptr->end_time <= now)
 			_advance_resv_time(resv_ptr);
 		if (resv_ptr->resv_watts == NO_VAL ||
@@ -4737,7 +4930,7 @@ extern uint32_t job_test_watts_resv(struct job_record *job_ptr, time_t when)
 					    resv_ptr->start_time,
 					    resv_ptr->end_time);
 	}
-	list_iterator_destroy(iter);
+	xfree(resv_array);
 
 	resv_cnt = _max_constraint_planning(&wsched, &start, &end);
 	if (slurm_get_debug_flags() & DEBUG_FLAG_RESERVATION) {
@@ -4777,8 +4970,8 @@ extern int job_test_resv(struct job_record *job_ptr, time_t *when,
 	time_t job_start_time, job_end_time, lic_resv_time;
 	time_t start_relative, end_relative;
 	time_t now = time(NULL);
-	ListIterator iter;
-	int i, rc = SLURM_SUCCESS, rc2;
+	slurmctld_resv_t **resv_array;
+	int i, j, resv_cnt, rc = SLURM_SUCCESS, rc2;
 
 	job_start_time = *when;
 	job_end_time   = *when + _get_job_duration(job_ptr);
@@ -4828,8 +5021,10 @@ extern int job_test_resv(struct job_record *job_ptr, time_t *when,
 
 		/* if there are any overlapping reservations, we need to
 		 * prevent the job from using those nodes (e.g. MAINT nodes) */
-		iter = list_iterator_create(resv_list);
-		while ((res2_ptr = (slurmctld_resv_t *) list_next(iter))) {
+		resv_array = _resv_in_window(job_start_time, job_end_time,
+					     &resv_cnt);
+		for (j = 0; j < resv_cnt; j++) {
+			res2_ptr = resv_array[j];
 			if ((resv_ptr->flags & RESERVE_FLAG_MAINT) ||
 			    ((resv_ptr->flags & RESERVE_FLAG_OVERLAP) &&
 			     !(res2_ptr->flags & RESERVE_FLAG_MAINT)) ||
@@ -4846,7 +5041,7 @@ extern int job_test_resv(struct job_record *job_ptr, time_t *when,
 				bit_not(res2_ptr->node_bitmap);
 			}
 		}
-		list_iterator_destroy(iter);
+		xfree(resv_array);
 
 		if (slurmctld_conf.debug_flags & DEBUG_FLAG_RESERVATION) {
 			char *nodes = bitmap2node_name(*node_bitmap);
@@ -4893,8 +5088,10 @@ extern int job_test_resv(struct job_record *job_ptr, time_t *when,
 	for (i = 0; ; i++) {
 		lic_resv_time = (time_t) 0;
 
-		iter = list_iterator_create(resv_list);
-		while ((resv_ptr = (slurmctld_resv_t *) list_next(iter))) {
+		resv_array = _resv_in_window(job_start_time, job_end_time,
+					     &resv_cnt);
+		for (j = 0; j < resv_cnt; j++) {
+			resv_ptr = resv_array[j];
 			if (resv_ptr->flags & RESERVE_FLAG_TIME_FLOAT) {
 				start_relative = resv_ptr->start_time + now;
 				if (resv_ptr->duration == INFINITE)
@@ -4964,7 +5161,7 @@ extern int job_test_resv(struct job_record *job_ptr, time_t *when,
 				}
 			}
 		}
-		list_iterator_destroy(iter);
+		xfree(resv_array);
 
 		if ((rc == SLURM_SUCCESS) && move_time) {
 			if (license_job_test(job_ptr, job_start_time)
@@ -5100,6 +5297,7 @@ static void _advance_resv_time(slurmctld_resv_t *resv_ptr)
 		resv_ptr->start_time_prev = resv_ptr->start_time;
 		resv_ptr->start_time_first = resv_ptr->start_time;
 		_advance_time(&resv_ptr->end_time, day_cnt);
+		_resv_index_invalidate();
 		_post_resv_create(resv_ptr);
 		last_resv_update = time(NULL);
 		schedule_resv_save();
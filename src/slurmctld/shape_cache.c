@@ -0,0 +1,203 @@
+/*****************************************************************************\
+ *  shape_cache.c - Cache of rejected job resource shapes, used to avoid
+ *	repeating select_g_job_test() for identical pending jobs within a
+ *	scheduling cycle
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <time.h>
+
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmctld/shape_cache.h"
+#include "src/slurmctld/slurmctld.h"
+
+struct shape_cache {
+	uint32_t epoch;		/* value of shape_cache_epoch when filled */
+	xhash_t *hash;		/* shape_rec_t records, keyed by shape */
+};
+
+typedef struct shape_rec {
+	char *key;		/* string describing the job's shape */
+	time_t fail_until;	/* can't start before this time, 0 if unknown */
+} shape_rec_t;
+
+/* Incremented when resources are released, protected by job write lock */
+static uint32_t shape_cache_epoch = 0;
+
+static const char *_shape_rec_id(void *item)
+{
+	shape_rec_t *rec = (shape_rec_t *) item;
+	return rec->key;
+}
+
+static void _shape_rec_free(void *item)
+{
+	shape_rec_t *rec = (shape_rec_t *) item;
+
+	if (rec) {
+		xfree(rec->key);
+		xfree(rec);
+	}
+}
+
+/* Build a string uniquely describing a job's resource shape.
+ * RET shape string (must be xfreed) or NULL if the job can not be cached */
+static char *_build_shape_key(struct job_record *job_ptr)
+{
+	struct job_details *detail_ptr = job_ptr->details;
+	multi_core_data_t *mc_ptr;
+	char *key = NULL;
+
+	/* Jobs with explicit node lists are not worth caching, they also
+	 * alter the available node bitmap used for later jobs */
+	if (!detail_ptr || detail_ptr->req_node_bitmap ||
+	    detail_ptr->exc_node_bitmap || !job_ptr->part_ptr)
+		return NULL;
+
+	xstrfmtcat(key, "%p:%p:%p:%u:%u:%u:%u:%u",
+		   job_ptr->part_ptr, job_ptr->resv_ptr, job_ptr->qos_ptr,
+		   job_ptr->user_id, job_ptr->time_limit, job_ptr->time_min,
+		   job_ptr->req_switch, job_ptr->wait4switch);
+	xstrfmtcat(key, ":%u:%u:%u:%u:%u:%u:%u:%u:%u:%u",
+		   detail_ptr->min_cpus, detail_ptr->max_cpus,
+		   detail_ptr->min_nodes, detail_ptr->max_nodes,
+		   detail_ptr->num_tasks, detail_ptr->ntasks_per_node,
+		   detail_ptr->cpus_per_task, detail_ptr->pn_min_cpus,
+		   detail_ptr->pn_min_memory, detail_ptr->pn_min_tmp_disk);
+	xstrfmtcat(key, ":%u:%u:%u:%u:%u:%u",
+		   detail_ptr->share_res, detail_ptr->whole_node,
+		   detail_ptr->contiguous, detail_ptr->core_spec,
+		   detail_ptr->overcommit, detail_ptr->task_dist);
+	if ((mc_ptr = detail_ptr->mc_ptr)) {
+		xstrfmtcat(key, ":%u:%u:%u:%u:%u:%u:%u:%u:%u",
+			   mc_ptr->boards_per_node, mc_ptr->sockets_per_board,
+			   mc_ptr->sockets_per_node, mc_ptr->cores_per_socket,
+			   mc_ptr->threads_per_core, mc_ptr->ntasks_per_board,
+			   mc_ptr->ntasks_per_socket, mc_ptr->ntasks_per_core,
+			   mc_ptr->plane_size);
+	}
+	xstrfmtcat(key, ":F=%s:G=%s",
+		   detail_ptr->features ? detail_ptr->features : "",
+		   job_ptr->gres ? job_ptr->gres : "");
+
+	return key;
+}
+
+/* Discard the cache's contents if resources were released since it was
+ * last used */
+static void _validate_cache(shape_cache_t *cache)
+{
+	if (cache->epoch == shape_cache_epoch)
+		return;
+	xhash_clear(cache->hash);
+	cache->epoch = shape_cache_epoch;
+}
+
+extern shape_cache_t *shape_cache_create(void)
+{
+	shape_cache_t *cache = xmalloc(sizeof(shape_cache_t));
+
+	cache->hash = xhash_init(_shape_rec_id, _shape_rec_free, NULL, 0);
+	cache->epoch = shape_cache_epoch;
+	return cache;
+}
+
+extern void shape_cache_destroy(shape_cache_t *cache)
+{
+	if (!cache)
+		return;
+	xhash_free(cache->hash);
+	xfree(cache);
+}
+
+extern void shape_cache_clear(shape_cache_t *cache)
+{
+	if (!cache)
+		return;
+	xhash_clear(cache->hash);
+	cache->epoch = shape_cache_epoch;
+}
+
+extern bool shape_cache_test(shape_cache_t *cache,
+			     struct job_record *job_ptr, time_t *fail_until)
+{
+	shape_rec_t *rec;
+	char *key;
+
+	if (!cache)
+		return false;
+	_validate_cache(cache);
+	if (xhash_count(cache->hash) == 0)
+		return false;
+	if (!(key = _build_shape_key(job_ptr)))
+		return false;
+	rec = xhash_get(cache->hash, key);
+	xfree(key);
+	if (!rec)
+		return false;
+	if (rec->fail_until && (rec->fail_until <= time(NULL))) {
+		xhash_delete(cache->hash, rec->key);
+		return false;
+	}
+	if (fail_until)
+		*fail_until = rec->fail_until;
+	return true;
+}
+
+extern void shape_cache_add(shape_cache_t *cache,
+			    struct job_record *job_ptr, time_t fail_until)
+{
+	shape_rec_t *rec;
+	char *key;
+
+	if (!cache)
+		return;
+	_validate_cache(cache);
+	if (!(key = _build_shape_key(job_ptr)))
+		return;
+	if ((rec = xhash_get(cache->hash, key))) {
+		rec->fail_until = fail_until;
+		xfree(key);
+		return;
+	}
+	rec = xmalloc(sizeof(shape_rec_t));
+	rec->key = key;
+	rec->fail_until = fail_until;
+	if (!xhash_add(cache->hash, rec))
+		_shape_rec_free(rec);
+}
+
+extern void shape_cache_invalidate(void)
+{
+	shape_cache_epoch++;
+}
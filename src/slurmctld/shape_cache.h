@@ -0,0 +1,89 @@
+/*****************************************************************************\
+ *  shape_cache.h - Cache of rejected job resource shapes, used to avoid
+ *	repeating select_g_job_test() for identical pending jobs within a
+ *	scheduling cycle
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _SHAPE_CACHE_H
+#define _SHAPE_CACHE_H
+
+#include "src/slurmctld/slurmctld.h"
+
+/*
+ * A shape cache records the resource "shape" of jobs which could not be
+ * allocated resources (partition, reservation, QOS, user, node constraints
+ * and core/memory/GRES requirements) along with the time until which an
+ * identically shaped job can not start. Within one scheduling cycle the
+ * resources available to later jobs only shrink, so a later job with the
+ * same shape can be rejected without calling select_g_job_test().
+ *
+ * Each scheduler owns its own cache. All caches are flushed by
+ * shape_cache_invalidate() whenever resources are released.
+ * Caller must hold the job write lock.
+ */
+typedef struct shape_cache shape_cache_t;
+
+/* Create an empty shape cache, free with shape_cache_destroy() */
+extern shape_cache_t *shape_cache_create(void);
+
+/* Free a shape cache and all of its records */
+extern void shape_cache_destroy(shape_cache_t *cache);
+
+/* Remove all records from a shape cache, at the start of a scheduling cycle
+ * or after locks were released and system state changed */
+extern void shape_cache_clear(shape_cache_t *cache);
+
+/*
+ * shape_cache_test - Test if a job with the same shape was already rejected
+ * IN cache - shape cache to search
+ * IN job_ptr - job to test
+ * OUT fail_until - time until which the job can not start, may be NULL
+ * RET true if an identically shaped job could not be allocated resources
+ */
+extern bool shape_cache_test(shape_cache_t *cache,
+			     struct job_record *job_ptr, time_t *fail_until);
+
+/*
+ * shape_cache_add - Record that a job could not be allocated resources
+ * IN cache - shape cache to update
+ * IN job_ptr - job which was rejected
+ * IN fail_until - time until which the job can not start
+ */
+extern void shape_cache_add(shape_cache_t *cache,
+			    struct job_record *job_ptr, time_t fail_until);
+
+/* Flush the contents of every shape cache. Call when resources are released
+ * (job termination, suspension, resize) so that cached rejections are not
+ * applied to jobs which might now be able to start. */
+extern void shape_cache_invalidate(void);
+
+#endif /* !_SHAPE_CACHE_H */
@@ -182,6 +182,8 @@ typedef struct diag_stats {
 	uint32_t schedule_cycle_counter;
 	uint32_t schedule_cycle_depth;
 	uint32_t schedule_queue_len;
+	uint32_t schedule_shape_hits;
+	uint32_t schedule_shape_misses;
 
 	uint32_t jobs_submitted;
 	uint32_t jobs_started;
@@ -214,6 +216,17 @@ typedef struct diag_stats {
 	uint32_t bf_queue_len_sum;
 	time_t   bf_when_last_cycle;
 	uint32_t bf_active;
+	uint32_t bf_shape_hits;
+	uint32_t bf_shape_misses;
+
+	uint32_t cr_row_update_cnt;	/* select/cons_res row updates */
+	uint64_t cr_row_update_time_sum;
+	uint32_t cr_row_update_time_max;
+	uint32_t cr_row_jobs_moved;
+
+	uint32_t node_reg_cnt;		/* registrations processed */
+	uint32_t node_reg_lock_cnt;	/* lock acquisitions for them */
+	uint32_t node_reg_batch_max;	/* most registrations per lock */
 } diag_stats_t;
 
 /* This is used to point out constants that exist in the
@@ -661,6 +674,9 @@ struct job_record {
 					    * a limit instead of from
 					    * the request, or if the
 					    * limit was set from admin */
+	uint32_t limit_block_gen;	/* acct_policy release generation
+					 * when the job was held by a job
+					 * count limit, 0 if not held */
 	uint16_t mail_type;		/* see MAIL_JOB_* in slurm.h */
 	char *mail_user;		/* user to get e-mail notification */
 	uint32_t magic;			/* magic cookie for data integrity */
@@ -709,6 +725,13 @@ struct job_record {
 	uint32_t *priority_array;	/* partition based priority */
 	priority_factors_object_t *prio_factors; /* cached value used
 						  * by sprio command */
+	double prio_base;		/* weighted job size and TRES factors
+					 * less nice, priority/multifactor
+					 * internal use only, don't save */
+	uint32_t prio_base_epoch;	/* generation of prio_base, 0 if
+					 * never set (Internal use only) */
+	uint16_t prio_base_restart;	/* restart_cnt when prio_base was
+					 * set (Internal use only) */
 	uint32_t profile;		/* Acct_gather_profile option */
 	uint32_t qos_id;		/* quality of service id */
 	void *qos_ptr;			/* pointer to the quality of
@@ -807,6 +830,9 @@ struct	depend_spec {
 	uint16_t	depend_flags;	/* SLURM_FLAGS_* type */
 	uint32_t	job_id;		/* SLURM job_id */
 	struct job_record *job_ptr;	/* pointer to this job */
+	uint32_t	depend_seq;	/* dependee's event sequence number
+					 * when last found unsatisfied,
+					 * 0 if not cached */
 };
 
 struct 	step_record {
@@ -1630,6 +1656,16 @@ extern int load_all_job_state ( void );
  */
 extern int load_all_node_state ( bool state_only );
 
+/*
+ * load_job_launch_data - read a batch job's script and environment into its
+ *	launch message. Needs no slurmctld locks, used for jobs without
+ *	supplemental environment variables.
+ * IN/OUT launch_msg_ptr - message with job and array IDs set
+ * RET SLURM_SUCCESS, ESLURM_JOB_SCRIPT_MISSING if the script can not be
+ *	read or SLURM_ERROR if the environment can not be read
+ */
+extern int load_job_launch_data(batch_job_launch_msg_t *launch_msg_ptr);
+
 /*
  * load_last_job_id - load only the last job ID from state save file.
  * RET 0 or error code
@@ -2312,6 +2348,17 @@ extern int validate_job_create_req(job_desc_msg_t * job_desc, uid_t submit_uid,
  */
 extern void validate_jobs_on_node(slurm_node_registration_status_msg_t *reg_msg);
 
+/*
+ * validate_jobs_on_nodes - validate the jobs reported by a batch of node
+ *	registrations, see validate_jobs_on_node(). Jobs which should be on
+ *	any of the nodes, but are missing, are found with a single pass over
+ *	the job list.
+ * IN reg_msg - node registration messages
+ * IN reg_cnt - number of node registration messages
+ */
+extern void validate_jobs_on_nodes(
+	slurm_node_registration_status_msg_t **reg_msg, int reg_cnt);
+
 /*
  * validate_node_specs - validate the node's specifications as valid,
  *	if not set state to down, in any case update last_response
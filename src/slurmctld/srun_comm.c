@@ -41,6 +41,7 @@
 #  include "config.h"
 #endif
 
+#include <pthread.h>
 #include <string.h>
 
 #include "src/common/node_select.h"
@@ -53,6 +54,77 @@
 
 #define SRUN_LAUNCH_MSG 0
 
+/* Notifications queued between srun_batch_begin() and srun_batch_end(),
+ * one batch per message type and protocol version. Protected by
+ * srun_batch_mutex. srun_ping() runs with only the job read lock, so
+ * batching threads may overlap: the batch belongs to the thread which
+ * started it and notifications from any other thread are sent at once. */
+typedef struct srun_batch {
+	slurm_msg_type_t msg_type;
+	uint16_t protocol_version;
+	uint32_t count;			/* notifications queued */
+	uint32_t size;			/* size of addr and msg_args */
+	slurm_addr_t *addr;		/* srun address of each one */
+	void **msg_args;		/* RPC data of each one */
+	hostlist_t hostlist;		/* srun host of each one */
+} srun_batch_t;
+
+static pthread_mutex_t srun_batch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t srun_batch_owner;
+static int srun_batch_depth = 0;
+static srun_batch_t *srun_batch = NULL;
+static int srun_batch_cnt = 0;
+
+/* Queue a notification into the batch for its type and version.
+ * RET true if queued, false if the message must be sent on its own */
+static bool _srun_batch_add(slurm_addr_t *addr, char *host,
+			    slurm_msg_type_t type, void *msg_args,
+			    uint16_t protocol_version)
+{
+	srun_batch_t *batch = NULL;
+	int i;
+
+	if ((type != SRUN_PING) && (type != SRUN_TIMEOUT) &&
+	    (type != SRUN_JOB_COMPLETE))
+		return false;
+
+	slurm_mutex_lock(&srun_batch_mutex);
+	if ((srun_batch_depth == 0) ||
+	    !pthread_equal(srun_batch_owner, pthread_self())) {
+		slurm_mutex_unlock(&srun_batch_mutex);
+		return false;
+	}
+
+	for (i = 0; i < srun_batch_cnt; i++) {
+		if ((srun_batch[i].msg_type == type) &&
+		    (srun_batch[i].protocol_version == protocol_version)) {
+			batch = &srun_batch[i];
+			break;
+		}
+	}
+	if (!batch) {
+		xrealloc(srun_batch, sizeof(srun_batch_t) *
+				     (srun_batch_cnt + 1));
+		batch = &srun_batch[srun_batch_cnt++];
+		batch->msg_type = type;
+		batch->protocol_version = protocol_version;
+		batch->hostlist = hostlist_create(NULL);
+	}
+	if (batch->count >= batch->size) {
+		batch->size = batch->size ? (batch->size * 2) : 16;
+		xrealloc(batch->addr, sizeof(slurm_addr_t) * batch->size);
+		xrealloc(batch->msg_args, sizeof(void *) * batch->size);
+	}
+	batch->addr[batch->count] = *addr;
+	batch->msg_args[batch->count] = msg_args;
+	batch->count++;
+	hostlist_push_host(batch->hostlist, host);
+	slurm_mutex_unlock(&srun_batch_mutex);
+	xfree(addr);
+
+	return true;
+}
+
 /* Launch the srun request. Note that retry is always zero since
  * we don't want to clog the system up with messages destined for
  * defunct srun processes
@@ -61,7 +133,12 @@ static void _srun_agent_launch(slurm_addr_t *addr, char *host,
 			       slurm_msg_type_t type, void *msg_args,
 			       uint16_t protocol_version)
 {
-	agent_arg_t *agent_args = xmalloc(sizeof(agent_arg_t));
+	agent_arg_t *agent_args;
+
+	if (_srun_batch_add(addr, host, type, msg_args, protocol_version))
+		return;
+
+	agent_args = xmalloc(sizeof(agent_arg_t));
 
 	agent_args->node_count = 1;
 	agent_args->retry      = 0;
@@ -74,6 +151,64 @@ static void _srun_agent_launch(slurm_addr_t *addr, char *host,
 	agent_queue_request(agent_args);
 }
 
+/*
+ * srun_batch_begin - start queueing srun notifications so that all of
+ *	those of one type are sent by a single agent request
+ */
+extern void srun_batch_begin(void)
+{
+	slurm_mutex_lock(&srun_batch_mutex);
+	if (srun_batch_depth == 0) {
+		srun_batch_owner = pthread_self();
+		srun_batch_depth++;
+	} else if (pthread_equal(srun_batch_owner, pthread_self()))
+		srun_batch_depth++;
+	slurm_mutex_unlock(&srun_batch_mutex);
+}
+
+/*
+ * srun_batch_end - send the notifications queued since srun_batch_begin()
+ */
+extern void srun_batch_end(void)
+{
+	agent_arg_t *agent_args;
+	srun_batch_t *batch, *batch_list;
+	int i, batch_cnt;
+
+	slurm_mutex_lock(&srun_batch_mutex);
+	if ((srun_batch_depth == 0) ||
+	    !pthread_equal(srun_batch_owner, pthread_self()) ||
+	    (--srun_batch_depth > 0)) {
+		/* Not the owner (its notifications were not queued)
+		 * or not the outermost srun_batch_end() */
+		slurm_mutex_unlock(&srun_batch_mutex);
+		return;
+	}
+	batch_list = srun_batch;
+	batch_cnt = srun_batch_cnt;
+	srun_batch = NULL;
+	srun_batch_cnt = 0;
+	slurm_mutex_unlock(&srun_batch_mutex);
+
+	for (i = 0; i < batch_cnt; i++) {
+		batch = &batch_list[i];
+		agent_args = xmalloc(sizeof(agent_arg_t));
+		agent_args->node_count = batch->count;
+		agent_args->retry      = 0;
+		agent_args->addr       = batch->addr;
+		agent_args->hostlist   = batch->hostlist;
+		agent_args->msg_type   = batch->msg_type;
+		if (batch->count == 1) {
+			agent_args->msg_args = batch->msg_args[0];
+			xfree(batch->msg_args);
+		} else
+			agent_args->msg_args_list = batch->msg_args;
+		agent_args->protocol_version = batch->protocol_version;
+		agent_queue_request(agent_args);
+	}
+	xfree(batch_list);
+}
+
 /*
  * srun_allocate - notify srun of a resource allocation
  * IN job_id - id of the job allocated resource
@@ -240,6 +375,7 @@ extern void srun_ping (void)
 	if (slurmctld_conf.inactive_limit == 0)
 		return;		/* No limit, don't bother pinging */
 
+	srun_batch_begin();
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
 		xassert (job_ptr->magic == JOB_MAGIC);
@@ -262,6 +398,7 @@ extern void srun_ping (void)
 	}
 
 	list_iterator_destroy(job_iterator);
+	srun_batch_end();
 }
 
 /*
@@ -305,6 +442,7 @@ extern void srun_timeout (struct job_record *job_ptr)
 	if (!IS_JOB_RUNNING(job_ptr))
 		return;
 
+	srun_batch_begin();
 	if (job_ptr->other_port && job_ptr->alloc_node && job_ptr->resp_host) {
 		addr = xmalloc(sizeof(struct sockaddr_in));
 		slurm_set_addr(addr, job_ptr->other_port, job_ptr->resp_host);
@@ -321,6 +459,7 @@ extern void srun_timeout (struct job_record *job_ptr)
 	while ((step_ptr = (struct step_record *) list_next(step_iterator)))
 		srun_step_timeout(step_ptr, job_ptr->end_time);
 	list_iterator_destroy(step_iterator);
+	srun_batch_end();
 }
 
 /*
@@ -401,6 +540,7 @@ extern void srun_job_complete (struct job_record *job_ptr)
 
 	xassert(job_ptr);
 
+	srun_batch_begin();
 	if (job_ptr->other_port && job_ptr->alloc_node && job_ptr->resp_host) {
 		addr = xmalloc(sizeof(struct sockaddr_in));
 		slurm_set_addr(addr, job_ptr->other_port, job_ptr->resp_host);
@@ -419,6 +559,7 @@ extern void srun_job_complete (struct job_record *job_ptr)
 		srun_step_complete(step_ptr);
 	}
 	list_iterator_destroy(step_iterator);
+	srun_batch_end();
 }
 
 /*
@@ -45,6 +45,21 @@
 
 #include "src/slurmctld/slurmctld.h"
 
+/*
+ * srun_batch_begin - start queueing srun notifications (pings, timeouts and
+ *	completions) so that all of those of one type are sent by a single
+ *	agent request rather than one agent per srun. Calls may be nested.
+ *	Only the calling thread's notifications are queued; any other thread
+ *	batching at the same time sends its notifications individually.
+ */
+extern void srun_batch_begin(void);
+
+/*
+ * srun_batch_end - send the notifications queued since the outermost
+ *	srun_batch_begin()
+ */
+extern void srun_batch_end(void);
+
 /*
  * srun_allocate - notify srun of a resource allocation
  * IN job_id - id of the job allocated resource
@@ -117,6 +117,26 @@ extern void pack_all_stat(int resp, char **buffer_ptr, int *buffer_size,
 			pack32(slurmctld_diag_stats.bf_queue_len_sum, buffer);
 			pack32(slurmctld_diag_stats.bf_active,	 buffer);
 		}
+		if (resp &&
+		    (protocol_version >= SLURM_16_05_PROTOCOL_VERSION)) {
+			pack32(slurmctld_diag_stats.schedule_shape_hits,
+			       buffer);
+			pack32(slurmctld_diag_stats.schedule_shape_misses,
+			       buffer);
+			pack32(slurmctld_diag_stats.bf_shape_hits, buffer);
+			pack32(slurmctld_diag_stats.bf_shape_misses, buffer);
+
+			pack32(slurmctld_diag_stats.cr_row_update_cnt, buffer);
+			pack64(slurmctld_diag_stats.cr_row_update_time_sum,
+			       buffer);
+			pack32(slurmctld_diag_stats.cr_row_update_time_max,
+			       buffer);
+			pack32(slurmctld_diag_stats.cr_row_jobs_moved, buffer);
+
+			pack32(slurmctld_diag_stats.node_reg_cnt, buffer);
+			pack32(slurmctld_diag_stats.node_reg_lock_cnt, buffer);
+			pack32(slurmctld_diag_stats.node_reg_batch_max, buffer);
+		}
 	} else if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
 		parts_packed = resp;
 
@@ -188,6 +208,8 @@ extern void reset_stats(int level)
 	slurmctld_diag_stats.schedule_cycle_sum = 0;
 	slurmctld_diag_stats.schedule_cycle_counter = 0;
 	slurmctld_diag_stats.schedule_cycle_depth = 0;
+	slurmctld_diag_stats.schedule_shape_hits = 0;
+	slurmctld_diag_stats.schedule_shape_misses = 0;
 	slurmctld_diag_stats.jobs_submitted = 0;
 	slurmctld_diag_stats.jobs_started = 0;
 	slurmctld_diag_stats.jobs_completed = 0;
@@ -210,6 +232,15 @@ extern void reset_stats(int level)
 	slurmctld_diag_stats.bf_last_depth = 0;
 	slurmctld_diag_stats.bf_last_depth_try = 0;
 	slurmctld_diag_stats.bf_active = 0;
+	slurmctld_diag_stats.bf_shape_hits = 0;
+	slurmctld_diag_stats.bf_shape_misses = 0;
+	slurmctld_diag_stats.cr_row_update_cnt = 0;
+	slurmctld_diag_stats.cr_row_update_time_sum = 0;
+	slurmctld_diag_stats.cr_row_update_time_max = 0;
+	slurmctld_diag_stats.cr_row_jobs_moved = 0;
+	slurmctld_diag_stats.node_reg_cnt = 0;
+	slurmctld_diag_stats.node_reg_lock_cnt = 0;
+	slurmctld_diag_stats.node_reg_batch_max = 0;
 
 	last_proc_req_start = time(NULL);
 }
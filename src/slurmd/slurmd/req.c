@@ -179,6 +179,7 @@ static void _rpc_reattach_tasks(slurm_msg_t *);
 static void _rpc_signal_job(slurm_msg_t *);
 static void _rpc_suspend_job(slurm_msg_t *msg);
 static void _rpc_terminate_job(slurm_msg_t *);
+static void _rpc_terminate_jobs(slurm_msg_t *);
 static void _rpc_update_time(slurm_msg_t *);
 static void _rpc_shutdown(slurm_msg_t *msg);
 static void _rpc_reconfig(slurm_msg_t *msg);
@@ -358,6 +359,12 @@ slurmd_req(slurm_msg_t *msg)
 		_rpc_terminate_job(msg);
 		slurm_free_kill_job_msg(msg->data);
 		break;
+	case REQUEST_TERMINATE_JOBS:
+		debug2("Processing RPC: REQUEST_TERMINATE_JOBS");
+		last_slurmctld_msg = time(NULL);
+		_rpc_terminate_jobs(msg);
+		slurm_free_kill_jobs_msg(msg->data);
+		break;
 	case REQUEST_COMPLETE_BATCH_SCRIPT:
 		debug2("Processing RPC: REQUEST_COMPLETE_BATCH_SCRIPT");
 		_rpc_complete_batch(msg);
@@ -3332,9 +3339,11 @@ _rpc_timelimit(slurm_msg_t *msg)
 	/*
 	 *  Indicate to slurmctld that we've received the message
 	 */
-	slurm_send_rc_msg(msg, SLURM_SUCCESS);
-	slurm_close(msg->conn_fd);
-	msg->conn_fd = -1;
+	if (msg->conn_fd >= 0) {
+		slurm_send_rc_msg(msg, SLURM_SUCCESS);
+		slurm_close(msg->conn_fd);
+		msg->conn_fd = -1;
+	}
 
 	if (req->step_id != NO_VAL) {
 		slurm_ctl_conf_t *cf;
@@ -4730,6 +4739,119 @@ _rpc_complete_batch(slurm_msg_t *msg)
 	_handle_old_batch_job_launch(&resp_msg);
 }
 
+/* Credential of a REQUEST_TERMINATE_JOBS RPC, shared by the threads
+ * terminating its jobs. A munge credential can only be decoded once, so
+ * the threads hold references to the verified credential rather than
+ * copies of it. */
+typedef struct terminate_jobs_cred {
+	void *auth_cred;
+	int ref_cnt;		/* protected by terminate_jobs_mutex */
+} terminate_jobs_cred_t;
+
+/* One job of a REQUEST_TERMINATE_JOBS RPC, owned by its thread */
+typedef struct terminate_jobs_arg {
+	slurm_msg_t msg;
+	terminate_jobs_cred_t *cred;
+} terminate_jobs_arg_t;
+
+static pthread_mutex_t terminate_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void _terminate_jobs_cred_rel(terminate_jobs_cred_t *cred)
+{
+	bool last_ref;
+
+	slurm_mutex_lock(&terminate_jobs_mutex);
+	last_ref = (--cred->ref_cnt == 0);
+	slurm_mutex_unlock(&terminate_jobs_mutex);
+	if (last_ref) {
+		if (cred->auth_cred)
+			(void) g_slurm_auth_destroy(cred->auth_cred);
+		xfree(cred);
+	}
+}
+
+/* Terminate one job of a REQUEST_TERMINATE_JOBS RPC */
+static void *_terminate_jobs_thread(void *arg)
+{
+	terminate_jobs_arg_t *job_arg = (terminate_jobs_arg_t *) arg;
+	slurm_msg_t *msg = &job_arg->msg;
+
+	if (msg->msg_type == REQUEST_TERMINATE_JOB)
+		_rpc_terminate_job(msg);
+	else
+		_rpc_timelimit(msg);
+	slurm_free_kill_job_msg(msg->data);
+	_terminate_jobs_cred_rel(job_arg->cred);
+	xfree(job_arg);
+	return NULL;
+}
+
+/*
+ *  Terminate several jobs sent together by slurmctld: acknowledge the
+ *   whole request, then terminate each job in its own detached thread
+ *   just as if its RPC was received alone with the connection already
+ *   closed, so that each reports its completion with
+ *   MESSAGE_EPILOG_COMPLETE. Each thread gets its own message and job
+ *   data, taken from this message, so that none waits for the others.
+ */
+static void
+_rpc_terminate_jobs(slurm_msg_t *msg)
+{
+	kill_jobs_msg_t *req = msg->data;
+	uid_t           uid  = g_slurm_auth_get_uid(msg->auth_cred,
+						    slurm_get_auth_info());
+	terminate_jobs_cred_t *cred;
+	terminate_jobs_arg_t  *job_arg;
+	pthread_t       thread_id;
+	pthread_attr_t  attr;
+	int             i;
+
+	if (!_slurm_authorized_user(uid)) {
+		error("Security violation: terminate_jobs req from uid %d",
+		      uid);
+		slurm_send_rc_msg(msg, ESLURM_USER_ID_MISSING);
+		return;
+	}
+	debug("_rpc_terminate_jobs for %u jobs", req->job_cnt);
+
+	slurm_send_rc_msg(msg, SLURM_SUCCESS);
+	if (slurm_close(msg->conn_fd) < 0)
+		error("rpc_terminate_jobs: close(%d): %m", msg->conn_fd);
+	msg->conn_fd = -1;
+
+	/* The credential is freed by whichever thread finishes last */
+	cred = xmalloc(sizeof(terminate_jobs_cred_t));
+	cred->auth_cred = msg->auth_cred;
+	cred->ref_cnt = 1;
+	msg->auth_cred = NULL;
+
+	slurm_attr_init(&attr);
+	if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED))
+		error("%s: pthread_attr_setdetachstate: %m", __func__);
+	for (i = 0; i < req->job_cnt; i++) {
+		job_arg = xmalloc(sizeof(terminate_jobs_arg_t));
+		slurm_msg_t_init(&job_arg->msg);
+		job_arg->msg.protocol_version = msg->protocol_version;
+		job_arg->msg.address = msg->address;
+		job_arg->msg.orig_addr = msg->orig_addr;
+		job_arg->msg.msg_type = req->msg_type;
+		job_arg->msg.data = req->kill_job[i];
+		job_arg->msg.auth_cred = cred->auth_cred;
+		job_arg->cred = cred;
+		req->kill_job[i] = NULL;
+		slurm_mutex_lock(&terminate_jobs_mutex);
+		cred->ref_cnt++;
+		slurm_mutex_unlock(&terminate_jobs_mutex);
+		if (pthread_create(&thread_id, &attr,
+				   _terminate_jobs_thread, job_arg)) {
+			error("%s: pthread_create: %m", __func__);
+			_terminate_jobs_thread(job_arg);
+		}
+	}
+	slurm_attr_destroy(&attr);
+	_terminate_jobs_cred_rel(cred);
+}
+
 static void
 _rpc_terminate_job(slurm_msg_t *msg)
 {
@@ -0,0 +1,207 @@
+/*****************************************************************************\
+ *  malleable-tst.c - run a synthetic workload of shared jobs and report
+ *	the resulting wait times and makespan, used to compare placement of
+ *	malleable jobs by select/cons_res
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Usage: malleable-tst [job_count [max_nodes [max_run_time [seed]]]]
+ *
+ * Submits job_count batch jobs requesting shared resources, each on 1 to
+ * max_nodes nodes and sleeping for 1 to max_run_time seconds, then waits
+ * for all of them to finish. Run it against a cluster configured with
+ * SelectType=select/cons_res and a partition with Shared=YES, once per
+ * configuration to be compared, using the same seed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+#define POLL_INTERVAL	5	/* seconds between job state tests */
+
+typedef struct bench_job {
+	uint32_t job_id;
+	int done;		/* set once the job is seen finished */
+	time_t submit_time;
+	time_t start_time;
+	time_t end_time;
+} bench_job_t;
+
+static int _cmp_job_id(const void *a, const void *b)
+{
+	const bench_job_t *job_a = (const bench_job_t *) a;
+	const bench_job_t *job_b = (const bench_job_t *) b;
+
+	if (job_a->job_id < job_b->job_id)
+		return -1;
+	return (job_a->job_id > job_b->job_id) ? 1 : 0;
+}
+
+/* Submit one job of the workload, RET its job ID or 0 on error */
+static uint32_t _submit_job(int max_nodes, int max_run_time)
+{
+	job_desc_msg_t job_mesg;
+	submit_response_msg_t *resp_msg;
+	char script[64];
+	uint32_t job_id;
+	int nodes, run_time;
+
+	nodes = 1 + (rand() % max_nodes);
+	run_time = 1 + (rand() % max_run_time);
+	snprintf(script, sizeof(script), "#!/bin/sh\nsleep %d\n", run_time);
+
+	slurm_init_job_desc_msg(&job_mesg);
+	job_mesg.name = "malleable-tst";
+	job_mesg.min_nodes = nodes;
+	job_mesg.max_nodes = nodes;
+	job_mesg.shared = 1;
+	job_mesg.time_limit = 1 + (run_time / 60);
+	job_mesg.user_id = getuid();
+	job_mesg.group_id = getgid();
+	job_mesg.script = script;
+	job_mesg.std_out = "/dev/null";
+	job_mesg.std_err = "/dev/null";
+	job_mesg.work_dir = "/tmp";
+
+	if (slurm_submit_batch_job(&job_mesg, &resp_msg)) {
+		slurm_perror("slurm_submit_batch_job");
+		return 0;
+	}
+	job_id = resp_msg->job_id;
+	slurm_free_submit_response_response_msg(resp_msg);
+	return job_id;
+}
+
+/* Record the times of workload jobs which have finished,
+ * RET count of workload jobs still pending or running */
+static int _test_jobs(bench_job_t *jobs, int job_cnt)
+{
+	job_info_msg_t *job_info_msg;
+	slurm_job_info_t *job_info;
+	bench_job_t key, *job;
+	uint32_t i;
+	int active_cnt = 0;
+
+	if (slurm_load_jobs((time_t) 0, &job_info_msg, SHOW_ALL)) {
+		slurm_perror("slurm_load_jobs");
+		return -1;
+	}
+	for (i = 0; i < job_info_msg->record_count; i++) {
+		job_info = &job_info_msg->job_array[i];
+		key.job_id = job_info->job_id;
+		job = bsearch(&key, jobs, job_cnt, sizeof(bench_job_t),
+			      _cmp_job_id);
+		if (!job || job->done)
+			continue;
+		if ((job_info->job_state & JOB_STATE_BASE) <= JOB_SUSPENDED) {
+			active_cnt++;
+			continue;
+		}
+		job->done = 1;
+		job->submit_time = job_info->submit_time;
+		job->start_time = job_info->start_time;
+		job->end_time = job_info->end_time;
+	}
+	slurm_free_job_info_msg(job_info_msg);
+
+	return active_cnt;
+}
+
+/* main is used here for testing purposes only */
+int main(int argc, char *argv[])
+{
+	bench_job_t *jobs;
+	int job_cnt = 100, max_nodes = 4, max_run_time = 60;
+	int active_cnt, done_cnt = 0, i, j;
+	unsigned int seed = 1;
+	time_t first_submit = 0, last_end = 0, run, wait, wait_max = 0;
+	double wait_sum = 0.0, slowdown_sum = 0.0;
+
+	if (argc > 1)
+		job_cnt = atoi(argv[1]);
+	if (argc > 2)
+		max_nodes = atoi(argv[2]);
+	if (argc > 3)
+		max_run_time = atoi(argv[3]);
+	if (argc > 4)
+		seed = (unsigned int) strtoul(argv[4], NULL, 10);
+	if ((job_cnt < 1) || (max_nodes < 1) || (max_run_time < 1)) {
+		fprintf(stderr, "Usage: %s [job_count [max_nodes "
+			"[max_run_time [seed]]]]\n", argv[0]);
+		exit(1);
+	}
+	srand(seed);
+
+	jobs = calloc(job_cnt, sizeof(bench_job_t));
+	if (!jobs) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0, j = 0; i < job_cnt; i++) {
+		if ((jobs[j].job_id = _submit_job(max_nodes, max_run_time)))
+			j++;
+	}
+	job_cnt = j;
+	printf("%d jobs submitted\n", job_cnt);
+	if (job_cnt == 0)
+		exit(1);
+	qsort(jobs, job_cnt, sizeof(bench_job_t), _cmp_job_id);
+
+	while ((active_cnt = _test_jobs(jobs, job_cnt)) > 0)
+		sleep(POLL_INTERVAL);
+	if (active_cnt < 0)
+		exit(1);
+
+	for (i = 0; i < job_cnt; i++) {
+		if (!jobs[i].done || (jobs[i].start_time == 0))
+			continue;	/* purged before seen or never ran */
+		done_cnt++;
+		if ((first_submit == 0) ||
+		    (jobs[i].submit_time < first_submit))
+			first_submit = jobs[i].submit_time;
+		if (jobs[i].end_time > last_end)
+			last_end = jobs[i].end_time;
+		wait = jobs[i].start_time - jobs[i].submit_time;
+		if (wait > wait_max)
+			wait_max = wait;
+		wait_sum += wait;
+		run = jobs[i].end_time - jobs[i].start_time;
+		if (run < 1)
+			run = 1;
+		slowdown_sum += (double) (wait + run) / run;
+	}
+	free(jobs);
+
+	printf("Jobs completed: %d\n", done_cnt);
+	if (done_cnt == 0)
+		exit(1);
+	printf("Makespan:       %ld seconds\n",
+	       (long) (last_end - first_submit));
+	printf("Mean wait:      %.1f seconds\n", wait_sum / done_cnt);
+	printf("Max wait:       %ld seconds\n", (long) wait_max);
+	printf("Mean slowdown:  %.2f\n", slowdown_sum / done_cnt);
+	exit(0);
+}
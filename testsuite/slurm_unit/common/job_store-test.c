@@ -0,0 +1,236 @@
+/*****************************************************************************\
+ *  job_store-test.c - test the slurmctld job store and the replay of its
+ *	index file
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "src/common/list.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+#include "src/slurmctld/job_store.h"
+
+#include <testsuite/dejagnu.h>
+
+/* Test for failure: */
+#define TEST(_tst, _msg) do {			\
+	if (_tst)				\
+		fail( _msg );			\
+	else					\
+		pass( _msg );			\
+} while (0)
+
+#define STALE_JOB_CNT	501	/* jobs added and deleted to force an index
+				 * rewrite, see JOB_STORE_STALE_MIN */
+
+static char *index_name = NULL;
+
+/* Defined by the slurmctld's state_save.c, which is not linked here */
+extern int fsync_and_close(int fd, char *file_type)
+{
+	int rc = fsync(fd);
+
+	if (close(fd) < 0)
+		rc = -1;
+	return rc;
+}
+
+/* Point the StateSaveLocation of a minimal configuration file at a new
+ * temporary directory, RET the directory name */
+static char *_setup_state_dir(void)
+{
+	char *dir_name, *conf_name = NULL;
+	FILE *fp;
+
+	dir_name = xstrdup("/tmp/job_store-test.XXXXXX");
+	if (!mkdtemp(dir_name)) {
+		perror("mkdtemp");
+		exit(1);
+	}
+	xstrfmtcat(conf_name, "%s/slurm.conf", dir_name);
+	if (!(fp = fopen(conf_name, "w"))) {
+		perror(conf_name);
+		exit(1);
+	}
+	fprintf(fp, "ControlMachine=localhost\n");
+	fprintf(fp, "StateSaveLocation=%s\n", dir_name);
+	fprintf(fp, "PluginDir=%s\n", dir_name);
+	fclose(fp);
+	setenv("SLURM_CONF", conf_name, 1);
+	xfree(conf_name);
+
+	xstrfmtcat(index_name, "%s/job_store_index", dir_name);
+	return dir_name;
+}
+
+/* Count the lines of the index file starting with the given record type */
+static int _index_rec_cnt(char type)
+{
+	char line[256];
+	int cnt = 0;
+	FILE *fp;
+
+	if (!(fp = fopen(index_name, "r")))
+		return -1;
+	while (fgets(line, sizeof(line), fp)) {
+		if (line[0] == type)
+			cnt++;
+	}
+	fclose(fp);
+	return cnt;
+}
+
+/* Return the path name of a job's script blob, must be xfreed */
+static char *_script_name(uint32_t job_id)
+{
+	char *file_name, *data;
+	int size;
+
+	if (job_store_read(job_id, "script", &file_name, &data, &size) < 0)
+		return NULL;
+	xfree(data);
+	return file_name;
+}
+
+static void _destroy_uint32_ptr(void *object)
+{
+	xfree(object);
+}
+
+static bool _file_exists(char *file_name)
+{
+	struct stat sbuf;
+
+	return (file_name && (stat(file_name, &sbuf) == 0));
+}
+
+int main(int argc, char *argv[])
+{
+	char env[] = "PATH=/bin", script[] = "#!/bin/sh\nhostname\n";
+	char other[] = "#!/bin/sh\ndate\n";
+	char *dir_name, *cmd = NULL, *file_name, *file_name2, *data;
+	int i, size;
+	List job_ids;
+	FILE *fp;
+
+	dir_name = _setup_state_dir();
+
+	TEST(job_store_load(false), "job_store_load of empty directory");
+
+	/* Jobs with identical contents share one blob */
+	TEST(job_store_add(1, env, sizeof(env), script, sizeof(script)),
+	     "job_store_add job 1");
+	TEST(job_store_add(2, env, sizeof(env), script, sizeof(script)),
+	     "job_store_add job 2");
+	TEST(job_store_copy(1, 3), "job_store_copy job 1 to 3");
+	TEST(!job_store_test(3), "job_store_test of copied job");
+	file_name = _script_name(1);
+	file_name2 = _script_name(3);
+	TEST(!file_name || !file_name2 || strcmp(file_name, file_name2),
+	     "blob shared by identical jobs");
+	xfree(file_name2);
+	TEST(_index_rec_cnt('A') != 3, "A records appended to index");
+
+	/* A blob is deleted only with its last reference */
+	TEST(!job_store_delete(1), "job_store_delete job 1");
+	TEST(!job_store_delete(2), "job_store_delete job 2");
+	TEST(!_file_exists(file_name), "blob kept while still referenced");
+	TEST(!job_store_delete(3), "job_store_delete job 3");
+	TEST(_file_exists(file_name), "blob deleted with last reference");
+	TEST(job_store_delete(3), "job_store_delete of deleted job");
+	TEST(_index_rec_cnt('D') != 3, "D records appended to index");
+	xfree(file_name);
+
+	/* Replay the index as a newly started slurmctld */
+	TEST(job_store_add(4, NULL, 0, other, sizeof(other)),
+	     "job_store_add job 4");
+	job_store_fini();
+	TEST(!job_store_load(false), "job_store_load of index");
+	TEST(!job_store_test(4), "job 4 replayed from index");
+	TEST(job_store_test(1) || job_store_test(3),
+	     "deleted jobs not replayed from index");
+	TEST(job_store_read(4, "script", &file_name, &data, &size) ||
+	     (size != sizeof(other)) || memcmp(data, other, size),
+	     "job_store_read of replayed job");
+	xfree(file_name);
+	xfree(data);
+	TEST(!job_store_read(4, "environment", &file_name, &data, &size),
+	     "job_store_read of missing file");
+
+	/* Records appended by another slurmctld are read when tested */
+	if ((fp = fopen(index_name, "a"))) {
+		fprintf(fp, "A 9 - -\n");
+		fclose(fp);
+	}
+	TEST(!job_store_test(9), "job_store_test of appended record");
+
+	/* Compaction drops the A/D records of deleted jobs */
+	TEST(job_store_save(), "job_store_save");
+	TEST((_index_rec_cnt('A') != 2) || (_index_rec_cnt('D') != 0),
+	     "index compacted by job_store_save");
+	job_ids = list_create(_destroy_uint32_ptr);
+	job_store_get_ids(job_ids);
+	TEST(list_count(job_ids) != 2, "job_store_get_ids");
+	list_destroy(job_ids);
+
+	/* A job whose index record can not be written is not added */
+	xstrfmtcat(cmd, "%s.save", index_name);
+	if ((rename(index_name, cmd) < 0) || (mkdir(index_name, 0700) < 0))
+		perror(index_name);
+	TEST(!job_store_add(50, env, sizeof(env), other, sizeof(other)),
+	     "job_store_add with unwritable index");
+	if ((rmdir(index_name) < 0) || (rename(cmd, index_name) < 0))
+		perror(index_name);
+	xfree(cmd);
+	TEST(job_store_test(50), "job not added with unwritable index");
+	TEST(_index_rec_cnt('A') != 2, "index unchanged with unwritable index");
+
+	/* Many stale records cause the index to be rewritten */
+	for (i = 0; i < STALE_JOB_CNT; i++) {
+		(void) job_store_add(100 + i, NULL, 0, script,
+				     sizeof(script));
+		(void) job_store_delete(100 + i);
+	}
+	TEST(_index_rec_cnt('A') + _index_rec_cnt('D') >= STALE_JOB_CNT * 2,
+	     "index rewritten with many stale records");
+	job_store_fini();
+	TEST(!job_store_load(false) || !job_store_test(4) ||
+	     !job_store_test(9) || job_store_test(100),
+	     "job_store_load of rewritten index");
+	job_store_fini();
+
+	xstrfmtcat(cmd, "rm -rf %s", dir_name);
+	(void) system(cmd);
+	xfree(cmd);
+	xfree(dir_name);
+	xfree(index_name);
+
+	totals();
+	return failed;
+}
@@ -0,0 +1,132 @@
+/*****************************************************************************\
+ *  kill_jobs_msg-test.c - test packing of REQUEST_TERMINATE_JOBS messages
+ *****************************************************************************
+ *  This file is part of SLURM, a resource management program.
+ *  For details, see <http://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  SLURM is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  SLURM is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with SLURM; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "src/common/pack.h"
+#include "src/common/slurm_protocol_defs.h"
+#include "src/common/slurm_protocol_pack.h"
+#include "src/common/xmalloc.h"
+
+/* testsuite/dejagnu.h can not be used here, its wait() conflicts with
+ * the one of <sys/wait.h> included by slurm_protocol_defs.h */
+static int failed = 0;
+
+/* Test for failure: */
+#define TEST(_tst, _msg) do {			\
+	if (_tst) {				\
+		printf("FAIL: %s\n", _msg);	\
+		failed++;			\
+	} else					\
+		printf("PASS: %s\n", _msg);	\
+} while (0)
+
+/* Pack a message body and unpack it again into a new message.
+ * The kill_job records of a batch are neither packed nor unpacked here:
+ * their select plugin data can not be handled without loading a select
+ * plugin. */
+static int _round_trip(kill_jobs_msg_t *in, uint16_t protocol_version,
+		       kill_jobs_msg_t **out)
+{
+	slurm_msg_t msg;
+	Buf buffer;
+	char *data;
+	int data_size, rc;
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = REQUEST_TERMINATE_JOBS;
+	msg.protocol_version = protocol_version;
+	msg.data = in;
+	buffer = init_buf(0);
+	pack_msg(&msg, buffer);
+	data_size = get_buf_offset(buffer);
+	data = xfer_buf_data(buffer);
+	buffer = create_buf(data, data_size);
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = REQUEST_TERMINATE_JOBS;
+	msg.protocol_version = protocol_version;
+	rc = unpack_msg(&msg, buffer);
+	*out = msg.data;
+	free_buf(buffer);
+	return rc;
+}
+
+/* Unpack a message body claiming job_cnt jobs but holding none */
+static int _unpack_job_cnt(uint32_t job_cnt, kill_jobs_msg_t **out)
+{
+	slurm_msg_t msg;
+	Buf buffer;
+	int rc;
+
+	buffer = init_buf(0);
+	pack16(REQUEST_TERMINATE_JOB, buffer);
+	pack32(job_cnt, buffer);
+	set_buf_offset(buffer, 0);
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = REQUEST_TERMINATE_JOBS;
+	msg.protocol_version = SLURM_PROTOCOL_VERSION;
+	rc = unpack_msg(&msg, buffer);
+	*out = msg.data;
+	free_buf(buffer);
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	kill_jobs_msg_t in, *out = NULL;
+	int rc;
+
+	memset(&in, 0, sizeof(kill_jobs_msg_t));
+	in.msg_type = REQUEST_KILL_TIMELIMIT;
+
+	rc = _round_trip(&in, SLURM_PROTOCOL_VERSION, &out);
+	TEST(rc != SLURM_SUCCESS, "un/pack REQUEST_TERMINATE_JOBS");
+	TEST(!out || (out->msg_type != REQUEST_KILL_TIMELIMIT),
+	     "un/pack REQUEST_TERMINATE_JOBS msg_type");
+	TEST(!out || (out->job_cnt != 0),
+	     "un/pack REQUEST_TERMINATE_JOBS job_cnt");
+	slurm_free_kill_jobs_msg(out);
+
+	rc = _round_trip(&in, SLURM_15_08_PROTOCOL_VERSION, &out);
+	TEST(rc == SLURM_SUCCESS,
+	     "REQUEST_TERMINATE_JOBS rejected for 15.08 protocol");
+	slurm_free_kill_jobs_msg(out);
+
+	rc = _unpack_job_cnt(KILL_JOB_BATCH_MAX + 1, &out);
+	TEST((rc == SLURM_SUCCESS) || out,
+	     "REQUEST_TERMINATE_JOBS job_cnt above KILL_JOB_BATCH_MAX");
+	slurm_free_kill_jobs_msg(out);
+
+	rc = _unpack_job_cnt(0xffffffff, &out);
+	TEST((rc == SLURM_SUCCESS) || out,
+	     "REQUEST_TERMINATE_JOBS job_cnt of 0xffffffff");
+	slurm_free_kill_jobs_msg(out);
+
+	return failed;
+}